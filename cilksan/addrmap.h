@@ -8,130 +8,153 @@
 #include "checking.h"
 #include "debug_util.h"
 
+// Map from addresses to DATA_T values, implemented as an open-addressing hash
+// table with linear probing.  The table holds one entry per mapped address, so
+// its size is proportional to the number of mapped addresses rather than to
+// the span of memory they cover.
 template <typename DATA_T>
 class AddrMap_t {
-  // log_2 of lines per page.
-  static constexpr unsigned LG_PAGE_SIZE = 24;
-  // log_2 of number of pages in the top-level table.
-  static constexpr unsigned LG_TABLE_SIZE = 48 - LG_PAGE_SIZE;
-
-  // Mask to identify the byte within a page.
-  static constexpr uintptr_t BYTE_MASK = ((1UL << LG_PAGE_SIZE) - 1);
-
-  // Helper methods to get the indices into the dictionary from a given address.
-  __attribute__((always_inline)) static uintptr_t byte(uintptr_t addr) {
-    return addr & BYTE_MASK;
-  }
-  __attribute__((always_inline)) static uintptr_t page(uintptr_t addr) {
-    return addr >> LG_PAGE_SIZE;
-  }
-
-  struct Page_t {
-    // Bitmap identifying bytes in the page that were previously accessed in
-    // the current strand.
-    static constexpr size_t VALID_ARR_SIZE =
-        (1UL << LG_PAGE_SIZE) / (8 * sizeof(uint64_t));
-    uint64_t Valid[VALID_ARR_SIZE] = {0};
-
-    DATA_T Bytes[1UL << LG_PAGE_SIZE];
-
-    // To accommodate the size and sparse access pattern of a Page_t, use
-    // mmap/munmap to allocate and free Page_t's.
-    void *operator new(size_t size) {
-      CheckingRAII nocheck;
-      return mmap(nullptr, sizeof(Page_t), PROT_READ | PROT_WRITE,
-                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-    }
-    void operator delete(void *ptr) {
-      CheckingRAII nocheck;
-      munmap(ptr, sizeof(Page_t));
-    }
+  // Key marking an empty slot.  This address is never the address of an
+  // allocation or a lock.
+  static constexpr uintptr_t EMPTY_KEY = (uintptr_t)(-1);
+  // log_2 of the initial number of slots in the table.
+  static constexpr unsigned LG_MIN_CAPACITY = 10;
+
+  struct Entry_t {
+    uintptr_t key;
+    DATA_T data;
+  };
 
-    // Operators for accessing lines
-    DATA_T &operator[](uintptr_t byteaddr) { return Bytes[byteaddr]; }
-    const DATA_T &operator[](uintptr_t byteaddr) const {
-      return Bytes[byteaddr];
-    }
+  Entry_t *Table = nullptr;
+  unsigned LgCapacity = 0;
+  size_t Size = 0;
 
-    // Constants for operating on valid bits
-    static constexpr uintptr_t LG_VALID_WORD_SIZE = 6;
-    static constexpr uintptr_t VALID_WORD_SIZE = 1UL << LG_VALID_WORD_SIZE;
-    static_assert(
-        VALID_WORD_SIZE == (8 * sizeof(uint64_t)),
-        "LG_VALID_WORD_SIZE does not correspond with valid-word size");
-    static constexpr uintptr_t VALID_BIT_MASK = VALID_WORD_SIZE - 1;
-    static constexpr uintptr_t VALID_WORD_MASK = ~VALID_BIT_MASK;
-    static constexpr uintptr_t VALID_WORD_IDX =
-        VALID_WORD_MASK ^ ~((1UL << LG_PAGE_SIZE) - 1);
-
-    // Static helper methods for operating on valid bits
-    __attribute__((always_inline)) static uintptr_t validWord(uintptr_t addr) {
-      return (addr & VALID_WORD_IDX) >> LG_VALID_WORD_SIZE;
-    }
-    __attribute__((always_inline)) static uintptr_t
-    validBit(uintptr_t addr) {
-      return addr & VALID_BIT_MASK;
-    }
+  size_t capacity() const { return Table ? (1UL << LgCapacity) : 0; }
+  size_t mask() const { return capacity() - 1; }
 
-    bool isValid(uintptr_t byteaddr) const {
-      return Valid[validWord(byteaddr)] & (1UL << validBit(byteaddr));
-    }
-    void setValid(uintptr_t byteaddr) {
-      Valid[validWord(byteaddr)] |= 1UL << validBit(byteaddr);
-    }
-    void clearValid(uintptr_t byteaddr) {
-      Valid[validWord(byteaddr)] &= ~(1UL << validBit(byteaddr));
-    }
-  };
+  // Fibonacci hashing of the address.  The high bits of the product depend on
+  // all bits of the address, including the low bits that are often equal
+  // because of alignment.
+  __attribute__((always_inline)) size_t hash(uintptr_t addr) const {
+    return (addr * 0x9e3779b97f4a7c15UL) >> (64 - LgCapacity);
+  }
 
-  Page_t *Table[1UL << LG_TABLE_SIZE] = {nullptr};
+  // To accommodate the size of the table, use mmap/munmap to allocate and free
+  // it.  Fresh mmap'd memory is zeroed, so keys must be initialized to
+  // EMPTY_KEY explicitly.
+  static Entry_t *allocateTable(size_t numEntries) {
+    CheckingRAII nocheck;
+    Entry_t *NewTable = reinterpret_cast<Entry_t *>(
+        mmap(nullptr, numEntries * sizeof(Entry_t), PROT_READ | PROT_WRITE,
+             MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+    for (size_t i = 0; i < numEntries; ++i)
+      NewTable[i].key = EMPTY_KEY;
+    return NewTable;
+  }
+  static void freeTable(Entry_t *OldTable, size_t numEntries) {
+    CheckingRAII nocheck;
+    munmap(OldTable, numEntries * sizeof(Entry_t));
+  }
 
-  Page_t *getPage(uintptr_t addr) const {
-    return Table[page(addr)];
+  // Find the slot for addr, which is either the slot containing addr or the
+  // empty slot where addr would be inserted.
+  __attribute__((always_inline)) size_t findSlot(uintptr_t addr) const {
+    size_t i = hash(addr);
+    while (Table[i].key != addr && Table[i].key != EMPTY_KEY)
+      i = (i + 1) & mask();
+    return i;
   }
 
-  Page_t *getOrCreatePage(uintptr_t addr) {
-    Page_t *Page = getPage(addr);
-    if (!Page) {
-      Page = new Page_t;
-      Table[page(addr)] = Page;
+  // Resize the table to have 2^newLgCapacity slots.
+  void resize(unsigned newLgCapacity) {
+    Entry_t *OldTable = Table;
+    size_t oldCapacity = capacity();
+    Table = allocateTable(1UL << newLgCapacity);
+    LgCapacity = newLgCapacity;
+    for (size_t i = 0; i < oldCapacity; ++i) {
+      if (OldTable[i].key == EMPTY_KEY)
+        continue;
+      size_t slot = findSlot(OldTable[i].key);
+      Table[slot] = OldTable[i];
     }
-    return Page;
+    if (OldTable)
+      freeTable(OldTable, oldCapacity);
   }
 
 public:
-
   ~AddrMap_t() {
-    for (uintptr_t i = 0; i < (1UL << LG_TABLE_SIZE); ++i) {
-      if (Table[i]) {
-        delete Table[i];
-        Table[i] = nullptr;
-      }
-    }
+    if (Table)
+      freeTable(Table, capacity());
+    Table = nullptr;
   }
 
+  // Returns the number of addresses in the map.
+  size_t size() const { return Size; }
+
   bool contains(uintptr_t addr) const {
-    if (const Page_t *Page = getPage(addr))
-      return Page->isValid(byte(addr));
-    return false;
+    if (!Table)
+      return false;
+    return Table[findSlot(addr)].key == addr;
   }
 
   const DATA_T *get(uintptr_t addr) const {
-    if (const Page_t *Page = getPage(addr))
-      if (Page->isValid(byte(addr)))
-        return &(*Page)[byte(addr)];
+    if (!Table)
+      return nullptr;
+    const Entry_t &E = Table[findSlot(addr)];
+    if (E.key == addr)
+      return &E.data;
     return nullptr;
   }
 
   void insert(uintptr_t addr, const DATA_T &data) {
-    Page_t *Page = getOrCreatePage(addr);
-    (*Page)[byte(addr)] = data;
-    Page->setValid(byte(addr));
+    cilksan_assert(addr != EMPTY_KEY && "Invalid address for AddrMap_t");
+    // Keep the load factor at most 1/2.
+    if (__builtin_expect(2 * (Size + 1) > capacity(), false))
+      resize(Table ? LgCapacity + 1 : LG_MIN_CAPACITY);
+    size_t slot = findSlot(addr);
+    if (Table[slot].key == EMPTY_KEY) {
+      Table[slot].key = addr;
+      ++Size;
+    }
+    Table[slot].data = data;
   }
 
   void remove(uintptr_t addr) {
-    if (Page_t *Page = getPage(addr))
-      Page->clearValid(byte(addr));
+    if (!Table)
+      return;
+    size_t hole = findSlot(addr);
+    if (Table[hole].key != addr)
+      return;
+    --Size;
+    // Shift later entries in the probe sequence back into the hole, so that
+    // lookups never need to skip over deleted entries.
+    size_t i = hole;
+    while (true) {
+      i = (i + 1) & mask();
+      if (Table[i].key == EMPTY_KEY)
+        break;
+      size_t home = hash(Table[i].key);
+      // Move the entry at i if its home slot does not lie cyclically in
+      // (hole, i].
+      if (((i - home) & mask()) >= ((i - hole) & mask())) {
+        Table[hole] = Table[i];
+        hole = i;
+      }
+    }
+    Table[hole].key = EMPTY_KEY;
+  }
+
+  // Call fn(addr, data) on every address in the map within [low, high).  This
+  // query scans the whole table, so its cost is proportional to the number of
+  // addresses in the map, not to the size of the range.  The callback must not
+  // modify the map.
+  template <typename FnT>
+  void for_each_in_range(uintptr_t low, uintptr_t high, FnT fn) const {
+    for (size_t i = 0; i < capacity(); ++i) {
+      const Entry_t &E = Table[i];
+      if (E.key != EMPTY_KEY && E.key >= low && E.key < high)
+        fn(E.key, E.data);
+    }
   }
 };
 
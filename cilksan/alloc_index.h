@@ -0,0 +1,116 @@
+// -*- C++ -*-
+#ifndef _ALLOC_INDEX_H
+#define _ALLOC_INDEX_H
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <tuple>
+#include <utility>
+
+#include "dictionary.h"
+
+// Index of the memory allocations in the program, represented as a set of
+// disjoint intervals [start, end) of addresses, each mapped to the
+// MemoryAccess_t of the allocation that produced it.  Registering or clearing
+// an allocation costs O(log n) in the number of allocations, regardless of the
+// size of the allocation.
+class AllocIndex_t {
+  struct Interval_t {
+    uintptr_t end;
+    MemoryAccess_t alloc;
+
+    Interval_t(uintptr_t end, DS_t *func, version_t version, csi_id_t acc_id,
+               MAType_t type)
+        : end(end), alloc(func, version, acc_id, type) {}
+    Interval_t(uintptr_t end, const MemoryAccess_t &alloc)
+        : end(end), alloc(alloc) {}
+  };
+  // Map from the start of each interval to that interval.
+  //
+  // NOTE: MemoryAccess_t's move constructor does not release the moved-from
+  // object's reference, so intervals are always constructed in place.
+  using Map_t = std::map<uintptr_t, Interval_t>;
+  Map_t Intervals;
+
+  // Insert the interval [start, end) for alloc before the position hint.
+  void insertCopy(Map_t::iterator hint, uintptr_t start, uintptr_t end,
+                  const MemoryAccess_t &alloc) {
+    Intervals.emplace_hint(hint, std::piecewise_construct,
+                           std::forward_as_tuple(start),
+                           std::forward_as_tuple(end, alloc));
+  }
+
+  // Remove the addresses in [start, end) from the index, trimming or splitting
+  // any interval that partially overlaps that range.
+  void erase(uintptr_t start, uintptr_t end) {
+    Map_t::iterator It = Intervals.upper_bound(start);
+    if (It != Intervals.begin()) {
+      Map_t::iterator Prev = std::prev(It);
+      Interval_t &I = Prev->second;
+      if (I.end > start) {
+        // Keep the part of the preceding interval after the range.  Intervals
+        // are disjoint, so no other interval can overlap the range in this
+        // case.
+        if (I.end > end)
+          insertCopy(It, end, I.end, I.alloc);
+        // Drop the preceding interval if nothing of it remains before the
+        // range.
+        if (Prev->first == start)
+          Intervals.erase(Prev);
+        else
+          I.end = start;
+      }
+    }
+    // Remove intervals that start within the range.
+    while (It != Intervals.end() && It->first < end) {
+      Interval_t &I = It->second;
+      if (I.end > end) {
+        // Keep the part of this interval after the range.
+        insertCopy(std::next(It), end, I.end, I.alloc);
+        Intervals.erase(It);
+        break;
+      }
+      It = Intervals.erase(It);
+    }
+  }
+
+public:
+  // Returns the number of intervals in the index.
+  size_t size() const { return Intervals.size(); }
+
+  // Record the allocation of [start, start + size), replacing any allocations
+  // previously recorded in that range.
+  void set(uintptr_t start, size_t size, DS_t *func, version_t version,
+           csi_id_t acc_id, MAType_t type) {
+    if (0 == size)
+      return;
+    uintptr_t end = start + size;
+    erase(start, end);
+    Intervals.emplace_hint(Intervals.lower_bound(start),
+                           std::piecewise_construct,
+                           std::forward_as_tuple(start),
+                           std::forward_as_tuple(end, func, version, acc_id,
+                                                 type));
+  }
+
+  // Remove any allocations recorded in [start, start + size).
+  void clear(uintptr_t start, size_t size) {
+    if (0 == size || Intervals.empty())
+      return;
+    erase(start, start + size);
+  }
+
+  // Find the allocation containing addr, or nullptr if there is none.
+  const MemoryAccess_t *find(uintptr_t addr) const {
+    Map_t::const_iterator It = Intervals.upper_bound(addr);
+    if (It == Intervals.begin())
+      return nullptr;
+    --It;
+    if (addr < It->second.end)
+      return &It->second.alloc;
+    return nullptr;
+  }
+};
+
+#endif // _ALLOC_INDEX_H
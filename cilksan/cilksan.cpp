@@ -1,7 +1,10 @@
 #include <cstdio>
 #include <cstdlib>
+#include <dlfcn.h>
 #include <iostream>
 #include <inttypes.h>
+#include <link.h>
+#include <string>
 
 #include "cilksan_internal.h"
 #include "debug_util.h"
@@ -49,16 +52,12 @@ int checking_disabled = 0;
 // Stack structure for tracking whether the current execution is parallel, i.e.,
 // whether there are any unsynced spawns in the program execution.
 Stack_t<uint8_t> parallel_execution;
-Stack_t<bool> spbags_frame_skipped;
 
 // Storage for old values of stack_low_addr and stack_high_addr, saved when
 // entering a cilkified region.
 uintptr_t uncilkified_stack_low_addr = (uintptr_t)-1;
 uintptr_t uncilkified_stack_high_addr = 0;
 
-// Stack for tracking whether a stack switch has occurred.
-Stack_t<uint8_t> switched_stack;
-
 // Stack structures for keeping track of MAAPs for pointer arguments to function
 // calls.
 Stack_t<std::pair<csi_id_t, MAAP_t>> MAAPs;
@@ -91,6 +90,8 @@ DisjointSet_t<call_stack_t>::DisjointSet_t(call_stack_t data, SBag_t *bag)
 #endif
 {
   bag->set_ds(this);
+  // Keep the call path of this node in the trie while this node exists.
+  _data.retain();
 
   WHEN_DISJOINTSET_DEBUG(
       DBG_TRACE(DISJOINTSET, "Creating DS %ld for SBag %p\n", _ID, bag));
@@ -106,6 +107,7 @@ DisjointSet_t<call_stack_t>::DisjointSet_t(call_stack_t data, PBag_t *bag)
 #endif
 {
   bag->set_ds(this);
+  _data.retain();
 
   WHEN_DISJOINTSET_DEBUG(
       DBG_TRACE(DISJOINTSET, "Creating DS %ld for PBag %p\n", _ID, bag));
@@ -133,8 +135,15 @@ PBag_t::FreeNode_t *PBag_t::free_list = nullptr;
 uintptr_t stack_low_addr = (uintptr_t)-1;
 uintptr_t stack_high_addr = 0;
 
-// Free list for call-stack nodes
-call_stack_node_t *call_stack_node_t::free_list = nullptr;
+// Trie of interned call paths
+call_path_trie_t call_paths;
+
+// Filters for the inlinable fast path for small memory accesses.
+extern "C" {
+uint64_t __cilksan_strand_epoch = 1;
+FastFilterEntry_t __cilksan_read_filter[1UL << LG_FAST_FILTER_SIZE];
+FastFilterEntry_t __cilksan_write_filter[1UL << LG_FAST_FILTER_SIZE];
+}
 
 // Global object to manage Cilksan data structures.
 CilkSanImpl_t CilkSanImpl;
@@ -146,9 +155,6 @@ MALineAllocator &
 template <>
 MALineAllocator &
     SimpleDictionary<1>::MAAlloc = CilkSanImpl.getMALineAllocator(1);
-template <>
-MALineAllocator &
-    SimpleDictionary<2>::MAAlloc = CilkSanImpl.getMALineAllocator(2);
 
 template <>
 DisjointSet_t<call_stack_t>::DSAllocator &
@@ -298,8 +304,11 @@ inline void CilkSanImpl_t::start_new_function(unsigned num_sync_reg) {
   child_sbag = createNewSBag(frame_id, call_stack);
 
   child->init_new_function(child_sbag);
+  child->ancestors_unsynced = parent->num_unsynced();
+  if (lazy_call_stacks)
+    child->set_call_stack(call_stack);
 
-  if (parent->in_continuation())
+  if (parent->in_stolen_continuation())
     child->set_parent_continuation(1);
   else {
     uint32_t parent_contin = parent->get_parent_continuation();
@@ -334,6 +343,58 @@ inline void CilkSanImpl_t::exit_function() {
   // manually dec the ref counts here.
   frame_stack.head()->reset();
   frame_stack.pop();
+  // Restore the lazily recorded call stack of the parent frame.
+  if (lazy_call_stacks)
+    call_stack = frame_stack.head()->CallStack;
+}
+
+// Maximum number of return addresses to record when unwinding the stack.
+static constexpr unsigned MAX_UNWIND_DEPTH = 64;
+
+// Set call_stack for a Cilk frame about to be entered by the function func_id
+// with base pointer bp.  Walk the frame-pointer chain from bp, recording return
+// addresses, until reaching the base pointer of the current Cilk frame, whose
+// call stack was recorded when it was entered.  The walk stays within the
+// bounds of the current stack.  The new call stack is that of the current Cilk
+// frame, followed by the return addresses, outermost first, and then func_id.
+void CilkSanImpl_t::unwind_call_stack(uintptr_t bp, csi_id_t func_id) {
+  uintptr_t stop = frame_stack.head()->FrameBP;
+  uintptr_t pcs[MAX_UNWIND_DEPTH];
+  unsigned depth = 0;
+  bool complete = false;
+  uintptr_t fp = bp;
+  while (true) {
+    if (fp == stop) {
+      complete = true;
+      break;
+    }
+    if (!fp || fp < stack_low_addr || fp > stack_high_addr ||
+        (fp & (sizeof(uintptr_t) - 1))) {
+      // The chain ended or left the current stack.  That is expected if the
+      // current Cilk frame is the root, which has no base pointer, or lies on
+      // another stack, e.g., before a switch to a Cilk fiber.  The frames in
+      // between then belong to startup code or to the Cilk runtime system.
+      complete = !stop || stop < stack_low_addr || stop > stack_high_addr;
+      break;
+    }
+    if (depth == MAX_UNWIND_DEPTH)
+      break;
+    const uintptr_t *frame = reinterpret_cast<const uintptr_t *>(fp);
+    uintptr_t next_fp = frame[0];
+    pcs[depth++] = frame[1];
+    // The next frame must lie further up the stack.
+    fp = (next_fp > fp) ? next_fp : 0;
+  }
+
+  // If unwinding did not reach the current Cilk frame, keep that frame's call
+  // stack and mark the frames between it and the unwound frames as unknown.
+  call_stack_t stack = call_stack;
+  if (!complete)
+    stack.push(CallID_t(RETURN_PC, typed_id_t<CallType_t>::UNKNOWN_TYPED_ID));
+  for (unsigned i = depth; i > 0; --i)
+    stack.push(CallID_t(RETURN_PC, pcs[i - 1]));
+  stack.push(CallID_t(FUNC, func_id));
+  call_stack = stack;
 }
 
 /// Action performed on entering a Cilk function (excluding spawn helper).
@@ -386,14 +447,18 @@ inline void CilkSanImpl_t::complete_sync(unsigned sync_reg) {
 //---------------------------------------------------------------
 // Callback functions
 //---------------------------------------------------------------
-void CilkSanImpl_t::do_enter(unsigned num_sync_reg) {
+void CilkSanImpl_t::do_enter(csi_id_t func_id, unsigned num_sync_reg,
+                             uintptr_t bp) {
   WHEN_CILKSAN_DEBUG(cilksan_assert(CILKSAN_INITIALIZED));
   WHEN_CILKSAN_DEBUG(cilksan_assert(last_event == NONE));
   WHEN_CILKSAN_DEBUG(last_event = ENTER_FRAME);
   DBG_TRACE(CALLBACK, "frame %ld cilk_enter_frame_begin, stack depth %d\n",
             frame_id + 1, frame_stack.size());
+  if (lazy_call_stacks)
+    unwind_call_stack(bp, func_id);
   enter_cilk_function(num_sync_reg);
   frame_stack.head()->frame_data = EntryFrameType::SPAWNER_SHADOW_FRAME;
+  frame_stack.head()->FrameBP = bp;
 
   WHEN_CILKSAN_DEBUG(
       cilksan_assert(last_event == ENTER_FRAME || last_event == ENTER_HELPER));
@@ -401,14 +466,20 @@ void CilkSanImpl_t::do_enter(unsigned num_sync_reg) {
   DBG_TRACE(CALLBACK, "cilk_enter_end\n");
 }
 
-void CilkSanImpl_t::do_enter_helper(unsigned num_sync_reg) {
+void CilkSanImpl_t::do_enter_helper(csi_id_t detach_id, bool record_spawn,
+                                    unsigned num_sync_reg, uintptr_t bp) {
   WHEN_CILKSAN_DEBUG(cilksan_assert(CILKSAN_INITIALIZED));
   DBG_TRACE(CALLBACK, "frame %ld cilk_enter_helper_begin\n", frame_id + 1);
   WHEN_CILKSAN_DEBUG(cilksan_assert(last_event == NONE));
   WHEN_CILKSAN_DEBUG(last_event = ENTER_HELPER;);
 
+  // A spawn helper is called directly by its spawning frame, so its call stack
+  // needs no unwinding.
+  if (lazy_call_stacks && record_spawn)
+    call_stack.push(CallID_t(SPAWN, detach_id));
   enter_cilk_function(num_sync_reg);
   frame_stack.head()->frame_data = EntryFrameType::DETACHER_SHADOW_FRAME;
+  frame_stack.head()->FrameBP = bp;
 
   WHEN_CILKSAN_DEBUG(
       cilksan_assert(last_event == ENTER_FRAME || last_event == ENTER_HELPER));
@@ -441,20 +512,27 @@ void CilkSanImpl_t::do_detach_continue(unsigned sync_reg) {
   WHEN_CILKSAN_DEBUG(cilksan_assert(CILKSAN_INITIALIZED));
   DBG_TRACE(CALLBACK, "cilk_detach_continue\n");
 
-  reduce_local_views();
+  // If the continuation is not stolen, it keeps using the reducer views of the
+  // preceding strand.
+  bool stolen = steal_policy.steal(frame_stack.size() - 1);
+  if (stolen)
+    reduce_local_views();
+  else
+    ++shared_view_epoch;
   update_strand_stats();
   shadow_memory->clearOccupied();
-  frame_stack.head()->enter_continuation(sync_reg);
+  frame_stack.head()->enter_continuation(sync_reg, stolen);
 }
 
-void CilkSanImpl_t::do_loop_iteration_begin(unsigned num_sync_reg) {
+void CilkSanImpl_t::do_loop_iteration_begin(unsigned num_sync_reg,
+                                            uintptr_t bp) {
   DBG_TRACE(CALLBACK, "do_loop_iteration_begin()\n");
   if (start_new_loop) {
     // The first time we enter the loop, create a LOOP_FRAME at the head of
     // frame_stack.
     DBG_TRACE(CALLBACK, "starting new loop\n");
     // Start a new frame.
-    do_enter_helper(num_sync_reg > 0 ? num_sync_reg : 1);
+    do_enter_helper(0, false, num_sync_reg > 0 ? num_sync_reg : 1, bp);
     // Set this frame's type as LOOP_FRAME.
     FrameData_t *func = frame_stack.head();
     func->frame_data = setLoopFrame(func->frame_data);
@@ -470,7 +548,10 @@ void CilkSanImpl_t::do_loop_iteration_begin(unsigned num_sync_reg) {
     cilksan_assert(in_loop());
     update_strand_stats();
     shadow_memory->clearOccupied();
-    frame_stack.head()->enter_loop_continuation();
+    bool stolen = steal_policy.steal(frame_stack.size() - 1);
+    if (!stolen)
+      ++shared_view_epoch;
+    frame_stack.head()->enter_loop_continuation(stolen);
   }
 }
 
@@ -570,6 +651,28 @@ void CilkSanImpl_t::do_sync(unsigned sync_reg) {
   reduce_local_views();
   complete_sync(sync_reg);
   frame_stack.head()->exit_continuation(sync_reg);
+
+  // If this sync leaves the whole program synced, then all recorded accesses
+  // are in series with all future accesses, and every reducer is back to its
+  // leftmost view.
+  if (is_fully_synced()) {
+    free_reducer_view_pool();
+    if (strand_sampler.enabled())
+      strand_sampler.end_region();
+    if (auto_phase_reset &&
+        shadow_memory->numAllocatedPages() >= phase_reset_min_pages)
+      reset_shadow_memory();
+  }
+}
+
+// Explicit phase boundary from the program-under-test.
+void CilkSanImpl_t::do_phase_boundary() {
+  DBG_TRACE(CALLBACK, "cilksan_phase_boundary\n");
+  if (!is_fully_synced()) {
+    DBG_TRACE(BASIC, "Ignoring phase boundary in parallel code.\n");
+    return;
+  }
+  reset_shadow_memory();
 }
 
 void CilkSanImpl_t::do_leave(unsigned sync_reg) {
@@ -664,12 +767,60 @@ void CilkSanImpl_t::record_free(uintptr_t addr, size_t mem_size,
     return;
 
   FrameData_t *f = frame_stack.head();
-  if (locks_held()) {
-    check_data_races_and_update<false>(acc_id, type, addr, mem_size, f,
-                                       lockset, *shadow_memory);
-  } else {
-    check_races_and_update<false>(acc_id, type, addr, mem_size, f,
-                                  *shadow_memory);
+  auto record = [&](uintptr_t part_addr, size_t part_size) {
+    if (locks_held()) {
+      check_data_races_and_update<false>(acc_id, type, part_addr, part_size, f,
+                                         lockset, *shadow_memory);
+    } else {
+      check_races_and_update<false>(acc_id, type, part_addr, part_size, f,
+                                    *shadow_memory);
+    }
+  };
+  if (__builtin_expect(is_watching(), false)) {
+    // Only record the parts of the freed memory within watched ranges.
+    watch_ranges.for_each_overlap(addr, mem_size, record);
+    return;
+  }
+  record(addr, mem_size);
+}
+
+// Restrict race checking to [addr, addr + size), in addition to any other
+// watched ranges.
+void CilkSanImpl_t::watch(uintptr_t addr, size_t size) {
+  DBG_TRACE(BASIC, "watch %p--%p\n", addr, addr + size);
+  watch_ranges.add(addr, size);
+  // Accesses filtered so far in this strand were checked only within the
+  // previous ranges.
+  fast_filter_new_epoch();
+}
+
+// Watch the objects named by a comma-separated list of symbols.  Symbols are
+// resolved with dlsym, so they must be exported, e.g., by linking the program
+// with -rdynamic.
+void CilkSanImpl_t::watch_symbols(const char *symbols) {
+  std::string list(symbols);
+  size_t pos = 0;
+  while (pos <= list.size()) {
+    size_t comma = list.find(',', pos);
+    if (comma == std::string::npos)
+      comma = list.size();
+    std::string name = list.substr(pos, comma - pos);
+    pos = comma + 1;
+    if (name.empty())
+      continue;
+
+    void *addr = dlsym(RTLD_DEFAULT, name.c_str());
+    Dl_info info;
+    void *sym_ent = nullptr;
+    if (!addr || !dladdr1(addr, &info, &sym_ent, RTLD_DL_SYMENT) || !sym_ent) {
+      std::cerr << "Cilksan: cannot find symbol '" << name
+                << "' to watch.\n";
+      continue;
+    }
+    // Watch at least one byte, even for symbols without a recorded size.
+    const ElfW(Sym) *sym = static_cast<const ElfW(Sym) *>(sym_ent);
+    size_t size = sym->st_size ? sym->st_size : 1;
+    watch((uintptr_t)addr, size);
   }
 }
 
@@ -813,6 +964,20 @@ void CilkSanImpl_t::do_read(const csi_id_t load_id, uintptr_t addr,
   if (on_stack)
     advance_stack_frame(addr);
 
+  if (__builtin_expect(!strand_sampled, false))
+    return;
+
+  if (__builtin_expect(is_watching(), false)) {
+    // Check only the parts of the access within watched ranges.  A clipped
+    // part may not be aligned, so check it via the slow path.
+    watch_ranges.for_each_overlap(
+        addr, mem_size, [&](uintptr_t part_addr, size_t part_size) {
+          record_mem_helper<true, type>(
+              load_id, part_addr, part_size,
+              (part_size == mem_size) ? alignment : 0);
+        });
+    return;
+  }
   record_mem_helper<true, type>(load_id, addr, mem_size, alignment);
 }
 
@@ -829,9 +994,37 @@ void CilkSanImpl_t::do_write(const csi_id_t store_id, uintptr_t addr,
   if (on_stack)
     advance_stack_frame(addr);
 
+  if (__builtin_expect(!strand_sampled, false))
+    return;
+
+  if (__builtin_expect(is_watching(), false)) {
+    // Check only the parts of the access within watched ranges.  A clipped
+    // part may not be aligned, so check it via the slow path.
+    watch_ranges.for_each_overlap(
+        addr, mem_size, [&](uintptr_t part_addr, size_t part_size) {
+          record_mem_helper<false, type>(
+              store_id, part_addr, part_size,
+              (part_size == mem_size) ? alignment : 0);
+        });
+    return;
+  }
   record_mem_helper<false, type>(store_id, addr, mem_size, alignment);
 }
 
+void CilkSanImpl_t::do_filtered_read(uintptr_t addr, size_t mem_size) {
+  if (collect_stats)
+    collect_read_stat(mem_size);
+  if (is_on_stack(addr))
+    advance_stack_frame(addr);
+}
+
+void CilkSanImpl_t::do_filtered_write(uintptr_t addr, size_t mem_size) {
+  if (collect_stats)
+    collect_write_stat(mem_size);
+  if (is_on_stack(addr))
+    advance_stack_frame(addr);
+}
+
 template void CilkSanImpl_t::do_read<MAType_t::RW>(const csi_id_t id,
                                                    uintptr_t addr, size_t len,
                                                    unsigned alignment);
@@ -870,6 +1063,18 @@ void CilkSanImpl_t::do_locked_read(const csi_id_t load_id, uintptr_t addr,
   if (on_stack)
     advance_stack_frame(addr);
 
+  if (__builtin_expect(!strand_sampled, false))
+    return;
+
+  if (__builtin_expect(is_watching(), false)) {
+    watch_ranges.for_each_overlap(
+        addr, mem_size, [&](uintptr_t part_addr, size_t part_size) {
+          record_locked_mem_helper<true, type>(
+              load_id, part_addr, part_size,
+              (part_size == mem_size) ? alignment : 0);
+        });
+    return;
+  }
   record_locked_mem_helper<true, type>(load_id, addr, mem_size, alignment);
 }
 
@@ -887,6 +1092,18 @@ void CilkSanImpl_t::do_locked_write(const csi_id_t store_id, uintptr_t addr,
   if (on_stack)
     advance_stack_frame(addr);
 
+  if (__builtin_expect(!strand_sampled, false))
+    return;
+
+  if (__builtin_expect(is_watching(), false)) {
+    watch_ranges.for_each_overlap(
+        addr, mem_size, [&](uintptr_t part_addr, size_t part_size) {
+          record_locked_mem_helper<false, type>(
+              store_id, part_addr, part_size,
+              (part_size == mem_size) ? alignment : 0);
+        });
+    return;
+  }
   record_locked_mem_helper<false, type>(store_id, addr, mem_size, alignment);
 }
 
@@ -912,6 +1129,25 @@ void CilkSanImpl_t::clear_shadow_memory(size_t start, size_t size) {
   shadow_memory->clear(start, size);
 }
 
+// Returns true if the current strand is not inside a spawned task or parallel
+// loop, and no frame on the stack has an outstanding P-bag, meaning that every
+// access recorded so far is in series with the current strand and all strands
+// after it.
+bool CilkSanImpl_t::is_fully_synced() const {
+  return 0 == frame_stack.head()->num_unsynced();
+}
+
+// Discard all read and write shadow memory.  Only valid when the program is
+// fully synced.
+void CilkSanImpl_t::reset_shadow_memory() {
+  if (0 == shadow_memory->numAllocatedPages())
+    return;
+  DBG_TRACE(MEMORY, "cilksan_reset_shadow_memory(%ld pages)\n",
+            shadow_memory->numAllocatedPages());
+  shadow_memory->resetAccesses();
+  ++phase_reset_count;
+}
+
 void CilkSanImpl_t::record_alloc(size_t start, size_t size,
                                  csi_id_t alloca_id) {
   if (!size)
@@ -941,6 +1177,42 @@ inline void CilkSanImpl_t::print_stats() {
 
   std::cout << "total strands,," << strand_count << "\n";
 
+  std::cout << "phase resets,," << phase_reset_count << "\n";
+
+  std::cout << "reducer views created,," << reducer_views_created << "\n";
+  std::cout << "reducer views reused,," << reducer_views_reused << "\n";
+  std::cout << "reducer views freed,," << reducer_views_freed << "\n";
+  std::cout << "max pooled reducer views,," << max_pooled_views << "\n";
+  std::cout << "shared reducer view clears,," << reducer_view_clears << "\n";
+
+  std::cout << "call paths,," << call_paths.size() << "\n";
+
+  // Footprint of the shadow-memory allocators.
+  static const char *MAAllocNames[2] = {"read", "write"};
+  for (unsigned Idx = 0; Idx < 2; ++Idx) {
+    for (unsigned Lg = 0; Lg < MALineAllocator::NumSizeClasses; ++Lg) {
+      const MALineAllocator::SizeClassStats_t &S =
+          MAAlloc[Idx].getSizeClassStats(Lg);
+      if (!S.SlabsAllocated)
+        continue;
+      const char *Name = MAAllocNames[Idx];
+      std::cout << Name << " line slabs," << (1UL << Lg) << ","
+                << S.SlabsAllocated << "\n";
+      std::cout << Name << " line empty slabs," << (1UL << Lg) << ","
+                << S.FreeSlabs << "\n";
+      std::cout << Name << " lines used," << (1UL << Lg) << ","
+                << S.LinesUsed << "\n";
+      std::cout << Name << " line bytes resident," << (1UL << Lg) << ","
+                << S.SlabsAllocated * SYS_PAGE_SIZE << "\n";
+    }
+  }
+  std::cout << "disjoint-set slabs,," << DSAlloc.getNumSlabs() << "\n";
+  std::cout << "disjoint-set empty slabs,," << DSAlloc.getNumEmptySlabs()
+            << "\n";
+  std::cout << "disjoint-set nodes,," << DSAlloc.getNumNodes() << "\n";
+  std::cout << "disjoint-set bytes resident,," << DSAlloc.getResidentBytes()
+            << "\n";
+
   for (std::pair<size_t, uint64_t> reads : max_num_reads_checked)
     std::cout << "max reads," << reads.first << "," << reads.second << "\n";
 
@@ -959,6 +1231,7 @@ void CilkSanImpl_t::deinit() {
     return; // deinit-ed already
 
   print_race_report();
+  strand_sampler.finish();
   // Optionally print statistics.
   if (collect_stats)
     print_stats();
@@ -991,6 +1264,9 @@ void CilkSanImpl_t::deinit() {
     do_leave(0);
   }
 
+  // Free the buffers of released reducer views.
+  free_reducer_view_pool();
+
   // Free the shadow memory
   if (shadow_memory) {
     delete shadow_memory;
@@ -1014,8 +1290,8 @@ void CilkSanImpl_t::deinit() {
                   << PBag_t::debug_count << "\n";
     });
 
-  // Free the call-stack nodes in the free list.
-  call_stack_node_t::cleanup_freelist();
+  // Free the interned call paths.
+  call_paths.cleanup();
 
   // Free the free lists for SBags and PBags.
   SBag_t::cleanup_freelist();
@@ -1093,6 +1369,58 @@ void CilkSanImpl_t::init() {
     }
   }
 
+  // Pick the kernel for filling occupancy bitmaps based on the CPU.
+  selectOccupancyFill();
+  // Set the policy for simulating steals when checking reducers.
+  steal_policy.init();
+  // Optionally stop after a maximum number of distinct races, or report only
+  // the first race between each pair of instructions.
+  {
+    char *e = getenv("CILKSAN_MAX_RACES");
+    if (e)
+      max_races = strtoull(e, nullptr, 10);
+    e = getenv("CILKSAN_FIRST_RACE_PER_PAIR");
+    if (e && 0 != strcmp(e, "0"))
+      first_race_per_pair = true;
+  }
+  // Disable automatic discarding of shadow memory at fully synced points, or
+  // change how much shadow memory must be in use to discard it, if requested.
+  {
+    char *e = getenv("CILKSAN_PHASE_RESET");
+    if (e && 0 == strcmp(e, "0"))
+      auto_phase_reset = false;
+    e = getenv("CILKSAN_PHASE_RESET_PAGES");
+    if (e)
+      phase_reset_min_pages = strtoull(e, nullptr, 10);
+  }
+  // Check only the memory of the given symbols, if requested.
+  {
+    char *e = getenv("CILKSAN_WATCH_SYMBOLS");
+    if (e)
+      watch_symbols(e);
+  }
+  // Check only a sampled subset of strands, and record the coverage of the
+  // sampled strands, if requested.
+  {
+    char *e = getenv("CILKSAN_SAMPLE_RATE");
+    if (e) {
+      uint64_t seed = 0;
+      char *s = getenv("CILKSAN_SAMPLE_SEED");
+      if (s)
+        seed = strtoull(s, nullptr, 10);
+      strand_sampler.set_rate(strtod(e, nullptr), seed);
+    }
+    e = getenv("CILKSAN_COVERAGE_FILE");
+    if (e)
+      strand_sampler.set_coverage_file(e);
+  }
+  // Record call stacks lazily, by unwinding the stack, if requested.
+  {
+    char *e = getenv("CILKSAN_LAZY_STACKS");
+    if (e && 0 != strcmp(e, "0"))
+      lazy_call_stacks = true;
+  }
+
   std::cerr << "Running Cilksan race detector.\n";
 
   // these are true upon creation of the stack
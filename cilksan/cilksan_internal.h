@@ -2,9 +2,13 @@
 #ifndef __CILKSAN_INTERNAL_H__
 #define __CILKSAN_INTERNAL_H__
 
+#include <algorithm>
 #include <cstdio>
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "addrmap.h"
 #include "csan.h"
@@ -15,6 +19,9 @@
 #include "locksets.h"
 #include "shadow_mem_allocator.h"
 #include "stack.h"
+#include "steal_policy.h"
+#include "strand_sampler.h"
+#include "watch_ranges.h"
 
 extern bool CILKSAN_INITIALIZED;
 
@@ -49,10 +56,14 @@ public:
 
   // Control-flow actions
   inline void record_call(const csi_id_t id, enum CallType_t ty) {
+    if (lazy_call_stacks)
+      return;
     call_stack.push(CallID_t(ty, id));
   }
 
   inline void record_call_return(const csi_id_t id, enum CallType_t ty) {
+    if (lazy_call_stacks)
+      return;
     assert(call_stack.tailMatches(CallID_t(ty, id)) &&
            "Mismatched hooks around call/spawn site");
     call_stack.pop();
@@ -64,31 +75,42 @@ public:
   ((uintptr_t) ((addr - (STACK_ALIGN-1)) & (~(STACK_ALIGN-1))))
 #define PREV_STACK_ALIGN(addr) (addr + STACK_ALIGN)
 
-  inline void push_stack_frame(uintptr_t bp, uintptr_t sp) {
-    DBG_TRACE(STACK, "push_stack_frame %p--%p\n", bp, sp);
-    // Record high location of the stack for this frame.
-    uintptr_t high_stack = bp;
+  // Flags recorded with each stack frame by the function and task entry hooks.
+  enum StackFrameFlags_t : uint8_t {
+    // The program switched stacks upon entering this frame.
+    FRAME_SWITCHED_STACK = 0x1,
+    // Entry into this frame did not create a new frame for the SP-bags.
+    FRAME_SPBAGS_SKIPPED = 0x2,
+  };
 
+  __attribute__((always_inline)) void
+  push_stack_frame(uintptr_t bp, uintptr_t sp, uint8_t flags = 0) {
+    DBG_TRACE(STACK, "push_stack_frame %p--%p\n", bp, sp);
     sp_stack.push();
-    *sp_stack.head() = high_stack;
+    StackFrame_t *frame = sp_stack.head();
+    // Record high location of the stack for this frame.
+    frame->high = bp;
     // Record low location of the stack for this frame.  This value will be
     // updated by reads and writes to the stack.
-    sp_stack.push();
-    *sp_stack.head() = sp;
+    frame->low = sp;
+    frame->flags = flags;
+  }
+
+  __attribute__((always_inline)) uint8_t get_stack_frame_flags() const {
+    return sp_stack.head()->flags;
   }
 
   inline void advance_stack_frame(uintptr_t addr) {
     DBG_TRACE(STACK, "advance_stack_frame %p to include %p\n",
-              *sp_stack.head(), addr);
-    if (addr < *sp_stack.head())
-      *sp_stack.head() = addr;
+              sp_stack.head()->low, addr);
+    if (addr < sp_stack.head()->low)
+      sp_stack.head()->low = addr;
   }
 
   inline void pop_stack_frame() {
     // Pop stack pointers.
-    uintptr_t low_stack = *sp_stack.head();
-    sp_stack.pop();
-    uintptr_t high_stack = *sp_stack.head();
+    uintptr_t low_stack = sp_stack.head()->low;
+    uintptr_t high_stack = sp_stack.head()->high;
     sp_stack.pop();
     DBG_TRACE(STACK, "pop_stack_frame %p--%p\n", high_stack, low_stack);
     assert(low_stack <= high_stack);
@@ -100,11 +122,11 @@ public:
 
   // Restore the stack pointer to the previous value addr
   inline void restore_stack(csi_id_t call_id, uintptr_t addr) {
-    uintptr_t current_stack = *sp_stack.head();
+    uintptr_t current_stack = sp_stack.head()->low;
     if (addr > current_stack) {
       record_free(current_stack, addr - current_stack, call_id,
                   MAType_t::STACK_FREE);
-      *sp_stack.head() = addr;
+      sp_stack.head()->low = addr;
     }
   }
 
@@ -143,12 +165,12 @@ public:
   // Returns true if the current strand could have been stolen.
   bool stealable() const {
     FrameData_t *f = frame_stack.head();
-    return f->in_continuation() || (f->get_parent_continuation() > 0);
+    return f->in_stolen_continuation() || (f->get_parent_continuation() > 0);
   }
 
   hyper_table *get_reducer_views() const {
     FrameData_t *f = frame_stack.head();
-    if (f->in_continuation())
+    if (f->in_stolen_continuation())
       return f->reducer_views;
     if (f->get_parent_continuation() == 0)
       return nullptr;
@@ -157,7 +179,7 @@ public:
 
   hyper_table *get_or_create_reducer_views() {
     FrameData_t *f = frame_stack.head();
-    if (f->in_continuation())
+    if (f->in_stolen_continuation())
       return f->get_or_create_reducer_views();
 
     cilksan_assert(f->get_parent_continuation() > 0);
@@ -183,13 +205,22 @@ public:
     __cilk_identity_fn identity = (__cilk_identity_fn)identity_ptr;
     __cilk_reduce_fn reduce = (__cilk_reduce_fn)reduce_ptr;
 
-    // Allocate and initialize a new view.  Make sure the shadow memory is clear
-    // for that allocation.
-    void *new_view = malloc(size);
+    // Get a view buffer, reusing a released view for this reducer if possible,
+    // and initialize it.  Make sure the shadow memory is clear for that buffer.
+    void *new_view = take_pooled_view(key, size);
+    if (new_view) {
+      // The shadow memory of a released view is cleared lazily, here.
+      clear_shadow_memory((size_t)new_view, size);
+      ++reducer_views_reused;
+    } else {
+      new_view = malloc(size);
+      mark_alloc(new_view, size);
+      ++reducer_views_created;
+    }
     DBG_TRACE(REDUCER, "create_reducer_view(%p): created view %p -> %p\n",
               (void *)reducer_views, (void *)key, new_view);
-    mark_alloc(new_view, size);
     identity(new_view);
+    view_clear_epoch[new_view] = shared_view_epoch;
 
     // Insert the view into the table of reducer_views.
     hyper_table::bucket new_bucket = {
@@ -203,15 +234,46 @@ public:
     return new_view;
   }
 
+  // Prepare an existing reducer view of the reducer with the given key to be
+  // used by the current strand.  A continuation that is not treated as stolen
+  // shares the views of the strands that are logically in parallel with it, but
+  // those strands execute serially with respect to the view.  Hence, the first
+  // time such a continuation touches a shared view, clear the view's shadow
+  // memory, just as create_reducer_view does for a fresh view.  The leftmost
+  // view is the program's own storage and is never cleared.
+  void reuse_reducer_view(uintptr_t key, void *view, size_t size) {
+    if (steal_policy.get_kind() == StealPolicy_t::Kind::ALL ||
+        (uintptr_t)view == key)
+      return;
+    uint64_t &epoch = view_clear_epoch[view];
+    if (epoch == shared_view_epoch)
+      return;
+    epoch = shared_view_epoch;
+    clear_shadow_memory((size_t)view, size);
+    ++reducer_view_clears;
+  }
+
+  // Release a view for the reducer with the given key, after that view has been
+  // reduced into another view.  The view's buffer is kept in a pool for reuse
+  // by a later view of the same reducer, unless that pool is full.
+  void release_reducer_view(uintptr_t key, void *view);
+  // Free the pooled views of the reducer with the given key.
+  void drain_reducer_view_pool(uintptr_t key);
+  // Free all pooled views.
+  void free_reducer_view_pool();
+  // Scratch buffer for merging hyper_tables, reused across merges.
+  std::vector<hyper_table::bucket> hyper_table_scratch;
+
   void reduce_local_views();
 
   // Control-flow actions
-  void do_enter(unsigned num_sync_reg);
-  void do_enter_helper(unsigned num_sync_reg);
+  void do_enter(csi_id_t func_id, unsigned num_sync_reg, uintptr_t bp);
+  void do_enter_helper(csi_id_t detach_id, bool record_spawn,
+                       unsigned num_sync_reg, uintptr_t bp);
   void do_detach();
   void do_detach_continue(unsigned sync_reg);
   void do_loop_begin() { start_new_loop = true; }
-  void do_loop_iteration_begin(unsigned num_sync_reg);
+  void do_loop_iteration_begin(unsigned num_sync_reg, uintptr_t bp);
   void do_loop_iteration_end();
   void do_loop_end(unsigned sync_reg);
   bool in_loop() const {
@@ -219,6 +281,7 @@ public:
   }
   bool handle_loop() const { return in_loop() || start_new_loop; }
   void do_sync(unsigned sync_reg);
+  void do_phase_boundary();
   void do_return();
   void do_leave(unsigned sync_reg);
 
@@ -229,8 +292,32 @@ public:
   template <MAType_t type>
   void do_write(const csi_id_t id, uintptr_t addr, size_t len,
                 unsigned alignment);
+  // Bookkeeping of do_read and do_write for an access whose race check is
+  // skipped, because the same instruction already checked it in this strand.
+  void do_filtered_read(uintptr_t addr, size_t len);
+  void do_filtered_write(uintptr_t addr, size_t len);
 
   void clear_shadow_memory(size_t start, size_t end);
+  void watch(uintptr_t addr, size_t size);
+  void watch_symbols(const char *symbols);
+  // Returns true if only registered address ranges are checked for races.
+  __attribute__((always_inline)) bool is_watching() const {
+    return !watch_ranges.empty();
+  }
+  bool is_fully_synced() const;
+  // Start a new strand at the given site, and decide whether to check it when
+  // sampling strands.
+  __attribute__((always_inline)) void
+  begin_strand(StrandSampler_t::SiteKind_t kind, csi_id_t id) {
+    if (__builtin_expect(!strand_sampler.enabled(), true))
+      return;
+    uint64_t iteration = 0;
+    if (StrandSampler_t::LOOP_ITER_SITE == kind)
+      iteration = frame_stack.head()->Iterbag->get_version();
+    strand_sampled = strand_sampler.sample(StrandSampler_t::site(kind, id),
+                                           frame_stack.size(), iteration);
+  }
+  void reset_shadow_memory();
   void record_alloc(size_t start, size_t size, csi_id_t alloca_id);
   void record_free(size_t start, size_t size, csi_id_t acc_id, MAType_t type);
   void clear_alloc(size_t start, size_t size);
@@ -279,6 +366,23 @@ public:
   const call_stack_t &get_current_call_stack() const {
     return call_stack;
   }
+  // Returns true if the race check between an earlier access and the current
+  // access can be skipped, because only the first race between each pair of
+  // instructions is reported, and these instructions have already raced.
+  __attribute__((always_inline)) bool
+  skip_raced_pair(const MemoryAccess_t *prev, csi_id_t acc_id,
+                  MAType_t type) const {
+    if (__builtin_expect(!first_race_per_pair, true))
+      return false;
+    // Most instructions never race, so check the current instruction first.
+    uint64_t key = typed_id_t<MAType_t>(type, acc_id).get();
+    if (!raced_ids.count(key))
+      return false;
+    uint64_t prev_key =
+        typed_id_t<MAType_t>(prev->getAccType(), prev->getAccID()).get();
+    return reported_pairs.count(
+        std::make_pair(std::min(key, prev_key), std::max(key, prev_key)));
+  }
   void report_race(
       const AccessLoc_t &first_inst, const AccessLoc_t &second_inst,
       uintptr_t addr, enum RaceType_t race_type);
@@ -293,6 +397,48 @@ public:
   AddrMap_t<size_t> malloc_sizes;
 
 private:
+  // Pools of released reducer-view buffers, keyed by the reducer key.  Reusing
+  // these buffers avoids a malloc, a free, and a clearing of the buffer's
+  // shadow memory for every simulated steal.  Each pool holds at most
+  // MAX_POOLED_VIEWS buffers of one size.  A reducer's pool is drained when the
+  // reducer is unregistered, and all pools are drained whenever the program is
+  // fully synced, when no reducer has any view other than its leftmost.
+  static constexpr size_t MAX_POOLED_VIEWS = 8;
+  struct ViewPool_t {
+    size_t size = 0;
+    std::vector<void *> views;
+  };
+  std::unordered_map<uintptr_t, ViewPool_t> reducer_view_pool;
+  // Number of buffers in all pools.
+  size_t num_pooled_views = 0;
+  // Number of continuations so far that were not treated as stolen, and, for
+  // each reducer view, the value of that count when the view's shadow memory
+  // was last cleared.
+  uint64_t shared_view_epoch = 0;
+  std::unordered_map<void *, uint64_t> view_clear_epoch;
+
+  void *take_pooled_view(uintptr_t key, size_t size) {
+    if (reducer_view_pool.empty())
+      return nullptr;
+    auto pool = reducer_view_pool.find(key);
+    if (pool == reducer_view_pool.end() || pool->second.size != size ||
+        pool->second.views.empty())
+      return nullptr;
+    void *view = pool->second.views.back();
+    pool->second.views.pop_back();
+    --num_pooled_views;
+    return view;
+  }
+  // Free a released view, as if the program had freed it.
+  void free_reducer_view(void *view) {
+    mark_free(view);
+    if (malloc_sizes.contains((uintptr_t)view))
+      malloc_sizes.remove((uintptr_t)view);
+    view_clear_epoch.erase(view);
+    free(view);
+    ++reducer_views_freed;
+  }
+
   inline void merge_bag_from_returning_child(bool returning_from_detach,
                                              unsigned sync_reg);
   inline void start_new_function(unsigned num_sync_reg);
@@ -308,8 +454,10 @@ private:
   inline void record_locked_mem_helper(const csi_id_t acc_id, uintptr_t addr,
                                        size_t mem_size, unsigned alignment);
   inline void print_stats();
+  void unwind_call_stack(uintptr_t bp, csi_id_t func_id);
   static bool ColorizeReports();
   static bool PauseOnRace();
+  [[noreturn]] void stop_at_max_races();
 
   // ANGE: Each function that causes a Disjoint set to be created has a
   // unique ID (i.e., Cilk function and spawned C function).
@@ -322,15 +470,37 @@ private:
   // Data associated with the stack of Cilk frames or spawned C frames.
   // head contains the SP bags for the function we are currently processing
   Stack_t<FrameData_t> frame_stack;
-  // Call stack for the current instruction
+  // Call stack for the current instruction.  If call stacks are recorded
+  // lazily, this is instead the call stack of the innermost Cilk frame, found
+  // by unwinding the stack when that frame was entered.
   call_stack_t call_stack;
+  bool lazy_call_stacks = false;
   // Stack maintaining the stack pointer SP, and specifically, the range of
-  // stack memory used by each function instantiation.
-  Stack_t<uintptr_t> sp_stack;
+  // stack memory used by each function instantiation, together with flags
+  // describing how that function was entered.
+  struct StackFrame_t {
+    uintptr_t high;
+    uintptr_t low;
+    uint8_t flags;
+  };
+  Stack_t<StackFrame_t> sp_stack;
 
   // Flag for whether the next loop iteration is the first iteration of a loop
   bool start_new_loop = false;
 
+  // Flag for whether to discard read and write shadow memory automatically at
+  // syncs after which the program is fully synced.  Cleared by setting
+  // CILKSAN_PHASE_RESET=0.
+  bool auto_phase_reset = true;
+  // Minimum number of allocated shadow-memory pages for an automatic discard,
+  // so that programs that sync often do not free and reallocate their shadow
+  // memory at every sync.  Set with CILKSAN_PHASE_RESET_PAGES.
+  size_t phase_reset_min_pages = 4;
+
+  // Policy for which continuations are treated as stolen when checking
+  // reducers.
+  StealPolicy_t steal_policy;
+
   // Flag for whether to check whether a memory address that is accessed by an
   // atomic operation is always accessed by atomic operations
   bool check_atomics = true;
@@ -343,8 +513,21 @@ private:
   // and allocation.
   SimpleShadowMem *shadow_memory = nullptr;
 
+  // Address ranges to check for races, registered by __cilksan_watch() or
+  // CILKSAN_WATCH_SYMBOLS.  If empty, all memory is checked.  Accesses outside
+  // these ranges skip the shadow memory, but the SP-bags are still maintained,
+  // so races on the watched ranges are still found exactly.
+  WatchRanges_t watch_ranges;
+
+  // Sampler of the strands to check, configured by CILKSAN_SAMPLE_RATE,
+  // CILKSAN_SAMPLE_SEED, and CILKSAN_COVERAGE_FILE.  Accesses in strands that
+  // are not sampled skip the shadow memory entirely.  Allocations and frees are
+  // still recorded, so every race reported is a true race.
+  StrandSampler_t strand_sampler;
+  bool strand_sampled = true;
+
   // Use separate allocators for each dictionary in the shadow memory.
-  MALineAllocator MAAlloc[3];
+  MALineAllocator MAAlloc[2];
 
   // Allocator for disjoint sets
   DSAllocator DSAlloc;
@@ -364,11 +547,36 @@ private:
   RaceMap_t races_found;
   // The number of duplicated races found
   uint32_t duplicated_races = 0;
+  // Maximum number of distinct races to report before exiting, or 0 for no
+  // limit.  Set by CILKSAN_MAX_RACES.
+  uint64_t max_races = 0;
+  // If set, report only the first race between each pair of instructions,
+  // regardless of the allocation or the types of the racing accesses, and skip
+  // checking later accesses by such a pair.  Set by
+  // CILKSAN_FIRST_RACE_PER_PAIR.
+  bool first_race_per_pair = false;
+  // Pairs of typed instruction IDs that have already raced, for
+  // first_race_per_pair.
+  struct RacePairHash_t {
+    size_t operator()(const std::pair<uint64_t, uint64_t> &p) const {
+      return std::hash<uint64_t>()(p.first * 0x9e3779b97f4a7c15UL ^ p.second);
+    }
+  };
+  std::unordered_set<std::pair<uint64_t, uint64_t>, RacePairHash_t>
+      reported_pairs;
+  // Typed IDs of the instructions in reported_pairs.
+  std::unordered_set<uint64_t> raced_ids;
   const bool color_report;
 
   // Basic statistics
   bool collect_stats = false;
   uint64_t strand_count = 0;
+  uint64_t phase_reset_count = 0;
+  uint64_t reducer_views_created = 0;
+  uint64_t reducer_views_reused = 0;
+  uint64_t reducer_views_freed = 0;
+  uint64_t reducer_view_clears = 0;
+  uint64_t max_pooled_views = 0;
   uint64_t total_reads_checked = 0;
   uint64_t total_writes_checked = 0;
   std::unordered_map<size_t, uint64_t> num_reads_checked;
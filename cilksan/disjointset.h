@@ -327,6 +327,8 @@ public:
 
   ~DisjointSet_t() {
     WHEN_DISJOINTSET_DEBUG(_destructing = true);
+    // Release the reference that the constructor took on _data.
+    _data.release();
     if (!isRoot()) {
       _parent_or_bag.getParent()->dec_ref_count();
     }
@@ -451,29 +453,36 @@ public:
     DSSlab_t *Next = nullptr;
     DSSlab_t *Prev = nullptr;
 
+    // Number of used disjoint sets in the slab.
+    uint32_t NumUsed = 0;
+    // Index of the first word in UsedMap that might not be full.  All
+    // preceding words are full.
+    uint32_t FreeHint = 0;
+
     static constexpr int UsedMapSize = 2;
     uint64_t UsedMap[UsedMapSize] = { 0 };
 
     static const size_t NumDJSets =
-      (SYS_PAGE_SIZE - (2 * sizeof(DSSlab_t *)) - sizeof(uint64_t[UsedMapSize]))
-      / sizeof(DisjointSet_t);
+      (SYS_PAGE_SIZE - (2 * sizeof(DSSlab_t *)) - sizeof(uint32_t[2]) -
+       sizeof(uint64_t[UsedMapSize])) / sizeof(DisjointSet_t);
 
     alignas(DisjointSet_t) char DJSets[NumDJSets * sizeof(DisjointSet_t)];
 
-    DSSlab_t() { UsedMap[UsedMapSize - 1] |= ~((1UL << (NumDJSets % 64)) - 1); }
+    DSSlab_t() {
+      if (NumDJSets % 64)
+        UsedMap[UsedMapSize - 1] |= ~((1UL << (NumDJSets % 64)) - 1);
+    }
 
     // Returns true if this slab contains no free lines.
-    bool isFull() const {
-      for (int i = 0; i < UsedMapSize; ++i)
-        if (UsedMap[i] != static_cast<uint64_t>(-1))
-          return false;
-      return true;
-    }
+    bool isFull() const { return NumUsed == NumDJSets; }
+
+    // Returns true if this slab contains no used disjoint sets.
+    bool isEmpty() const { return NumUsed == 0; }
 
     // Get a free disjoint set from the slab, marking that disjoint set as used
     // in the process.  Returns nullptr if no free disjoint set is available.
     DisjointSet_t *getFreeDJSet() __attribute__((malloc)) {
-      for (int i = 0; i < UsedMapSize; ++i) {
+      for (int i = FreeHint; i < UsedMapSize; ++i) {
         uint64_t UsedMapVal = UsedMap[i];
         if (UsedMapVal == static_cast<uint64_t>(-1))
           continue;
@@ -484,6 +493,8 @@ public:
 
         // Mark the line as used.
         UsedMap[i] |= UsedMapVal + 1;
+        FreeHint = i;
+        ++NumUsed;
 
         return DJSet;
       }
@@ -511,6 +522,9 @@ public:
       cilksan_assert(0 != (UsedMap[MapIdx] & (1UL << MapBit)) &&
                      "Disjoint set is not marked used.");
       UsedMap[MapIdx] &= ~(1UL << MapBit);
+      if (MapIdx < FreeHint)
+        FreeHint = MapIdx;
+      --NumUsed;
     }
   };
 
@@ -527,13 +541,34 @@ public:
     DSSlab_t *FreeSlabs = nullptr;
     DSSlab_t *FullSlabs = nullptr;
 
-  public:
-    DSAllocator() {
-      FreeSlabs = new (my_aligned_alloc(
-          DSSlab_t::SYS_PAGE_SIZE, DSSlab_t::PAGE_ALIGNED(sizeof(DSSlab_t))))
+    // Allocation statistics.
+    uint64_t SlabsAllocated = 0;
+    uint64_t EmptySlabs = 0;
+    uint64_t NumNodes = 0;
+
+    // Allocate a new, empty slab from the system.
+    DSSlab_t *newSlab() {
+      ++SlabsAllocated;
+      ++EmptySlabs;
+      return new (my_aligned_alloc(DSSlab_t::SYS_PAGE_SIZE,
+                                   DSSlab_t::PAGE_ALIGNED(sizeof(DSSlab_t))))
           DSSlab_t;
     }
 
+  public:
+    DSAllocator() { FreeSlabs = newSlab(); }
+
+    // Number of slabs allocated from the system.
+    uint64_t getNumSlabs() const { return SlabsAllocated; }
+    // Number of allocated slabs with no disjoint sets in use.
+    uint64_t getNumEmptySlabs() const { return EmptySlabs; }
+    // Number of disjoint sets in use.
+    uint64_t getNumNodes() const { return NumNodes; }
+    // Bytes of memory allocated for slabs.
+    uint64_t getResidentBytes() const {
+      return SlabsAllocated * DSSlab_t::PAGE_ALIGNED(sizeof(DSSlab_t));
+    }
+
     ~DSAllocator() {
       cilksan_assert(!FullSlabs && "Full slabs remaining.");
       // Destruct the free slabs and free their memory.
@@ -550,16 +585,16 @@ public:
 
     DisjointSet_t *getDJSet() __attribute__((malloc)) {
       DSSlab_t *Slab = FreeSlabs;
+      if (Slab->isEmpty())
+        --EmptySlabs;
       DisjointSet_t *DJSet = Slab->getFreeDJSet();
+      ++NumNodes;
 
       // If Slab is now full, move it to the Full list.
       if (Slab->isFull()) {
         if (!Slab->Next)
           // Allocate a new slab if necessary.
-          FreeSlabs =
-              new (my_aligned_alloc(DSSlab_t::SYS_PAGE_SIZE,
-                                    DSSlab_t::PAGE_ALIGNED(sizeof(DSSlab_t))))
-                  DSSlab_t;
+          FreeSlabs = newSlab();
         else {
           Slab->Next->Prev = nullptr;
           FreeSlabs = Slab->Next;
@@ -610,6 +645,9 @@ public:
       }
 
       Slab->returnDJSet(static_cast<DisjointSet_t *>(Ptr));
+      --NumNodes;
+      if (Slab->isEmpty())
+        ++EmptySlabs;
     }
   };
 
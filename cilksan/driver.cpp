@@ -12,6 +12,7 @@
 #include "cilksan_internal.h"
 #include "debug_util.h"
 #include "driver.h"
+#include "fast_path.h"
 #include "race_detect_update.h"
 #include "simple_shadow_mem.h"
 #include "stack.h"
@@ -57,16 +58,12 @@ extern int checking_disabled;
 // Stack structure for tracking whether the current execution is parallel, i.e.,
 // whether there are any unsynced spawns in the program execution.
 extern Stack_t<uint8_t> parallel_execution;
-extern Stack_t<bool> spbags_frame_skipped;
 
 // Storage for old values of stack_low_addr and stack_high_addr, saved when
 // entering a cilkified region.
 extern uintptr_t uncilkified_stack_low_addr;
 extern uintptr_t uncilkified_stack_high_addr;
 
-// Stack for tracking whether a stack switch has occurred.
-extern Stack_t<uint8_t> switched_stack;
-
 // Stack structures for keeping track of MAAPs for pointer arguments to function
 // calls.
 extern Stack_t<std::pair<csi_id_t, MAAP_t>> MAAPs;
@@ -95,6 +92,23 @@ CILKSAN_API bool __cilksan_is_checking_enabled(void) {
   return (checking_disabled == 0);
 }
 
+// Callback for user code to restrict race checking to [addr, addr + size),
+// together with any other watched ranges.
+CILKSAN_API void __cilksan_watch(const void *addr, size_t size) {
+  if (!CILKSAN_INITIALIZED)
+    return;
+  CilkSanImpl.watch((uintptr_t)addr, size);
+}
+
+// Callback for user code to mark the end of a phase of the computation.  If
+// the program is fully synced, Cilksan discards its record of the accesses so
+// far, since none of them can race with later accesses.
+CILKSAN_API void __cilksan_phase_boundary(void) {
+  if (!CILKSAN_INITIALIZED)
+    return;
+  CilkSanImpl.do_phase_boundary();
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // Hooks for setting and getting MAAPs.
 
@@ -269,12 +283,15 @@ CILKSAN_API void __csan_func_entry(const csi_id_t func_id,
   // pointers to their previous values.  We use this approach, rather than
   // overlead the Sanitizer methods to communicate fiber switching, to avoid
   // linking headaches and because this approach is faster.
-  if (((uintptr_t)bp - (uintptr_t)sp > DEFAULT_STACK_SIZE) ||
-      (stack_low_addr > (uintptr_t)sp &&
-       stack_low_addr - (uintptr_t)sp > DEFAULT_STACK_SIZE)) {
+  uint8_t frame_flags = 0;
+  if (__builtin_expect(
+          ((uintptr_t)bp - (uintptr_t)sp > DEFAULT_STACK_SIZE) ||
+              (stack_low_addr > (uintptr_t)sp &&
+               stack_low_addr - (uintptr_t)sp > DEFAULT_STACK_SIZE),
+          false)) {
     // It looks like we have switched stacks to start executing Cilk code.
     handle_stack_switch((uintptr_t)bp, (uintptr_t)sp);
-    switched_stack.push_back(1);
+    frame_flags = CilkSanImpl_t::FRAME_SWITCHED_STACK;
     if ((uintptr_t)bp - (uintptr_t)sp > DEFAULT_STACK_SIZE)
       bp = sp;
   } else {
@@ -282,7 +299,6 @@ CILKSAN_API void __csan_func_entry(const csi_id_t func_id,
       stack_high_addr = (uintptr_t)bp;
     if (stack_low_addr > (uintptr_t)sp)
       stack_low_addr = (uintptr_t)sp;
-    switched_stack.push_back(0);
   }
 
   WHEN_CILKSAN_DEBUG({
@@ -291,6 +307,18 @@ CILKSAN_API void __csan_func_entry(const csi_id_t func_id,
               srcloc->name, srcloc->filename, srcloc->line_number);
   });
 
+  if (!prop.may_spawn && CilkSanImpl.is_local_synced()) {
+    // Ignore entry calls into non-Cilk functions when the parent frame is
+    // synced.  Such a function cannot detach or sync, so it shares the
+    // parallel-execution state of its parent, and only the stack-frame record
+    // is needed to clean up its stack memory on exit.
+    CilkSanImpl.push_stack_frame(
+        (uintptr_t)bp, (uintptr_t)sp,
+        frame_flags | CilkSanImpl_t::FRAME_SPBAGS_SKIPPED);
+    enable_instrumentation();
+    return;
+  }
+
   // Propagate the parallel-execution state to the child.
   uint8_t current_pe = parallel_execution.back();
   // First we push the pe value on function entry.
@@ -298,19 +326,10 @@ CILKSAN_API void __csan_func_entry(const csi_id_t func_id,
   // We push a second copy to update aggressively on detaches.
   parallel_execution.push_back(current_pe);
 
-  CilkSanImpl.push_stack_frame((uintptr_t)bp, (uintptr_t)sp);
-
-  if (!prop.may_spawn && CilkSanImpl.is_local_synced()) {
-    spbags_frame_skipped.push_back(true);
-    // Ignore entry calls into non-Cilk functions when the parent frame is
-    // synced.
-    enable_instrumentation();
-    return;
-  }
-  spbags_frame_skipped.push_back(false);
+  CilkSanImpl.push_stack_frame((uintptr_t)bp, (uintptr_t)sp, frame_flags);
 
   // Update the tool for entering a Cilk function.
-  CilkSanImpl.do_enter(prop.num_sync_reg);
+  CilkSanImpl.do_enter(func_id, prop.num_sync_reg, (uintptr_t)bp);
   enable_instrumentation();
 }
 
@@ -331,28 +350,27 @@ CILKSAN_API void __csan_func_exit(const csi_id_t func_exit_id,
             func_exit_id, func_id, srcloc->name, srcloc->filename,
             srcloc->line_number);
 
-  if (!spbags_frame_skipped.back()) {
+  uint8_t frame_flags = CilkSanImpl.get_stack_frame_flags();
+  if (!(frame_flags & CilkSanImpl_t::FRAME_SPBAGS_SKIPPED)) {
     // Update the tool for leaving a Cilk function.
     //
     // NOTE: Technically the sync region that would synchronize any orphaned
     // child tasks is not well defined.  This case should never arise in Cilk
     // programs.
     CilkSanImpl.do_leave(0);
-  }
-  spbags_frame_skipped.pop();
 
-  // Pop both local copies of the parallel-execution state.
-  parallel_execution.pop();
-  parallel_execution.pop();
+    // Pop both local copies of the parallel-execution state.
+    parallel_execution.pop();
+    parallel_execution.pop();
+  }
 
   CilkSanImpl.pop_stack_frame();
 
-  if (switched_stack.back()) {
+  if (frame_flags & CilkSanImpl_t::FRAME_SWITCHED_STACK) {
     // We switched stacks upon entering this function.  Now switch back.
     stack_high_addr = uncilkified_stack_high_addr;
     stack_low_addr = uncilkified_stack_low_addr;
   }
-  switched_stack.pop();
 }
 
 // Hook called just before executing a loop.
@@ -397,6 +415,7 @@ CILKSAN_API void __csan_after_loop(const csi_id_t loop_id,
   DBG_TRACE(CALLBACK, "__csan_after_loop(%ld)\n", loop_id);
 
   CilkSanImpl.do_loop_end(sync_reg);
+  CilkSanImpl.begin_strand(StrandSampler_t::LOOP_EXIT_SITE, loop_id);
 
   // Pop the parallel-execution state.
   parallel_execution.pop();
@@ -490,31 +509,30 @@ __csan_task(const csi_id_t task_id, const csi_id_t detach_id,
     return;
 
   // Update the low address of the stack
+  uint8_t frame_flags = 0;
   if (stack_low_addr > (uintptr_t)sp) {
     // Try to detect stack switching by comparing the current stack and base
     // pointers to their previous values.
     if (stack_low_addr - (uintptr_t)sp > DEFAULT_STACK_SIZE) {
       // It looks like we have switched stacks to start executing Cilk code.
       handle_stack_switch((uintptr_t)bp, (uintptr_t)sp);
-      switched_stack.push_back(1);
+      frame_flags = CilkSanImpl_t::FRAME_SWITCHED_STACK;
       if ((uintptr_t)bp - (uintptr_t)sp > DEFAULT_STACK_SIZE)
         bp = sp;
     } else {
       stack_low_addr = (uintptr_t)sp;
-      switched_stack.push_back(0);
     }
-  } else {
-    switched_stack.push_back(0);
   }
 
   DBG_TRACE(CALLBACK, "__csan_task(%ld, %ld, %d)\n", task_id, detach_id,
             prop.is_tapir_loop_body);
   WHEN_CILKSAN_DEBUG(last_event = NONE);
 
-  CilkSanImpl.push_stack_frame((uintptr_t)bp, (uintptr_t)sp);
+  CilkSanImpl.push_stack_frame((uintptr_t)bp, (uintptr_t)sp, frame_flags);
 
   if (prop.is_tapir_loop_body && CilkSanImpl.handle_loop()) {
-    CilkSanImpl.do_loop_iteration_begin(prop.num_sync_reg);
+    CilkSanImpl.do_loop_iteration_begin(prop.num_sync_reg, (uintptr_t)bp);
+    CilkSanImpl.begin_strand(StrandSampler_t::LOOP_ITER_SITE, detach_id);
     return;
   }
 
@@ -526,8 +544,10 @@ __csan_task(const csi_id_t task_id, const csi_id_t detach_id,
   parallel_execution.push_back(current_pe);
 
   // Update tool for entering detach-helper function and performing detach.
-  CilkSanImpl.do_enter_helper(prop.num_sync_reg);
+  CilkSanImpl.do_enter_helper(detach_id, !prop.is_tapir_loop_body,
+                              prop.num_sync_reg, (uintptr_t)bp);
   CilkSanImpl.do_detach();
+  CilkSanImpl.begin_strand(StrandSampler_t::TASK_SITE, detach_id);
 }
 
 // Hook called when exiting the body of a task.
@@ -559,14 +579,14 @@ __csan_task_exit(const csi_id_t task_exit_id, const csi_id_t task_id,
     parallel_execution.pop();
   }
 
+  uint8_t frame_flags = CilkSanImpl.get_stack_frame_flags();
   CilkSanImpl.pop_stack_frame();
 
-  if (switched_stack.back()) {
+  if (frame_flags & CilkSanImpl_t::FRAME_SWITCHED_STACK) {
     // We switched stacks upon entering this function.  Now switch back.
     stack_high_addr = uncilkified_stack_high_addr;
     stack_low_addr = uncilkified_stack_low_addr;
   }
-  switched_stack.pop();
 }
 
 // Hook called at the continuation of a detach, i.e., a task spawn.
@@ -592,6 +612,8 @@ __csan_detach_continue(const csi_id_t detach_continue_id,
   if (!prop.for_tapir_loop_body) {
     CilkSanImpl.record_call_return(detach_id, SPAWN);
     CilkSanImpl.do_detach_continue(sync_reg);
+    CilkSanImpl.begin_strand(StrandSampler_t::CONTINUE_SITE,
+                             detach_continue_id);
   }
 
   WHEN_CILKSAN_DEBUG(last_event = NONE);
@@ -608,6 +630,7 @@ CILKSAN_API void __csan_sync(csi_id_t sync_id, const unsigned sync_reg) {
   // Because this is a serial tool, we can safely perform all operations related
   // to a sync.
   CilkSanImpl.do_sync(sync_reg);
+  CilkSanImpl.begin_strand(StrandSampler_t::SYNC_SITE, sync_id);
 
   // Restore the parallel-execution state to that of the function/task entry.
   if (CilkSanImpl.is_local_synced()) {
@@ -654,12 +677,25 @@ void __csan_load(csi_id_t load_id, const void *addr, int32_t size,
                                atomic_lock_id);
     return;
   }
-  if (__builtin_expect(CilkSanImpl.locks_held(), false))
+  if (__builtin_expect(CilkSanImpl.locks_held(), false)) {
     CilkSanImpl.do_locked_read<MAType_t::RW>(load_id, (uintptr_t)addr, size,
                                              prop.alignment);
-  else
+    return;
+  }
+  if (__builtin_expect(is_running_under_rr, false)) {
     CilkSanImpl.do_read<MAType_t::RW>(load_id, (uintptr_t)addr, size,
                                       prop.alignment);
+    return;
+  }
+  // Skip the race check for reads that this instruction has already checked in
+  // this strand.
+  if (fast_filter_hit(true, load_id, (uintptr_t)addr, size)) {
+    CilkSanImpl.do_filtered_read((uintptr_t)addr, size);
+    return;
+  }
+  CilkSanImpl.do_read<MAType_t::RW>(load_id, (uintptr_t)addr, size,
+                                    prop.alignment);
+  fast_filter_insert(true, load_id, (uintptr_t)addr, size);
 }
 
 // Hook called for a "large" load instruction, e.g., due to a memory intrinsic.
@@ -734,12 +770,25 @@ void __csan_store(csi_id_t store_id, const void *addr, int32_t size,
                                 atomic_lock_id);
     return;
   }
-  if (__builtin_expect(CilkSanImpl.locks_held(), false))
+  if (__builtin_expect(CilkSanImpl.locks_held(), false)) {
     CilkSanImpl.do_locked_write<MAType_t::RW>(store_id, (uintptr_t)addr, size,
                                               prop.alignment);
-  else
+    return;
+  }
+  if (__builtin_expect(is_running_under_rr, false)) {
     CilkSanImpl.do_write<MAType_t::RW>(store_id, (uintptr_t)addr, size,
                                        prop.alignment);
+    return;
+  }
+  // Skip the race check for writes that this instruction has already checked
+  // in this strand.
+  if (fast_filter_hit(false, store_id, (uintptr_t)addr, size)) {
+    CilkSanImpl.do_filtered_write((uintptr_t)addr, size);
+    return;
+  }
+  CilkSanImpl.do_write<MAType_t::RW>(store_id, (uintptr_t)addr, size,
+                                     prop.alignment);
+  fast_filter_insert(false, store_id, (uintptr_t)addr, size);
 }
 
 // Hook called for a "large" store instruction, e.g., due to a memory intrinsic.
@@ -837,6 +886,9 @@ void __csan_after_allocfn(const csi_id_t allocfn_id,
   if (oldaddr) {
     const size_t *size = CilkSanImpl.malloc_sizes.get((uintptr_t)oldaddr);
     if (oldaddr != addr) {
+      // Inserting the new allocation into malloc_sizes may move the entry for
+      // the old one, so save the old size first.
+      const size_t old_size = size ? *size : 0;
       if (new_size > 0) {
         // Record the new allocation.
         CilkSanImpl.record_alloc((size_t)addr, new_size, 2 * allocfn_id + 1);
@@ -845,12 +897,14 @@ void __csan_after_allocfn(const csi_id_t allocfn_id,
       }
 
       if (CilkSanImpl.malloc_sizes.contains((uintptr_t)oldaddr)) {
+        forget_locks_in_range((uintptr_t)oldaddr,
+                              (uintptr_t)oldaddr + old_size);
         if (!should_check() || !is_execution_parallel()) {
-          CilkSanImpl.clear_alloc((size_t)oldaddr, *size);
-          CilkSanImpl.clear_shadow_memory((size_t)oldaddr, *size);
+          CilkSanImpl.clear_alloc((size_t)oldaddr, old_size);
+          CilkSanImpl.clear_shadow_memory((size_t)oldaddr, old_size);
         } else {
           // Take note of the freeing of the old memory.
-          CilkSanImpl.record_free((uintptr_t)oldaddr, *size, allocfn_id,
+          CilkSanImpl.record_free((uintptr_t)oldaddr, old_size, allocfn_id,
                                   MAType_t::REALLOC);
         }
         CilkSanImpl.malloc_sizes.remove((uintptr_t)oldaddr);
@@ -863,6 +917,8 @@ void __csan_after_allocfn(const csi_id_t allocfn_id,
           CilkSanImpl.clear_shadow_memory((size_t)addr + old_size,
                                           new_size - old_size);
         } else if (old_size > new_size) {
+          forget_locks_in_range((uintptr_t)oldaddr + new_size,
+                                (uintptr_t)oldaddr + old_size);
           if (!should_check() || !is_execution_parallel()) {
             CilkSanImpl.clear_alloc((size_t)oldaddr + new_size,
                                     old_size - new_size);
@@ -1066,6 +1122,11 @@ void __csan_after_free(const csi_id_t free_id,
   if (!CILKSAN_INITIALIZED)
     return;
 
+  // Locks in the freed block no longer exist, even if they were never
+  // destroyed.
+  if (const size_t *size = CilkSanImpl.malloc_sizes.get((uintptr_t)ptr))
+    forget_locks_in_range((uintptr_t)ptr, (uintptr_t)ptr + *size);
+
   if (!should_check()) {
     CilkSanImpl.mark_free(ptr);
     return;
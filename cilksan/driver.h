@@ -115,6 +115,10 @@ static inline bool checkMAAP(MAAP_t val, MAAP_t flag) {
 // Designated lock ID for atomic operations
 constexpr LockID_t atomic_lock_id = 0;
 
+// Forget the locks stored in [low, high), which is being deallocated.
+// Defined in locking.cpp
+void forget_locks_in_range(uintptr_t low, uintptr_t high);
+
 // Range of stack used by the process
 // Defined in cilksan.cpp
 extern uintptr_t stack_low_addr;
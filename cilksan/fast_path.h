@@ -0,0 +1,97 @@
+// -*- C++ -*-
+#ifndef __FAST_PATH_H__
+#define __FAST_PATH_H__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "csan.h"
+
+// Header-only fast path for small memory accesses, designed to be inlined into
+// the program-under-test when the Cilksan hooks are compiled as bitcode.
+//
+// This is a partial fast path: only the check for redundant accesses is
+// inlined.  Accesses that miss the filters still call into the runtime, which
+// checks them against the shadow memory with check_read_fast and the
+// occupancy bitmaps with setOccupiedFast, both of which stay in
+// simple_shadow_mem.h.
+//
+// The fast path consults small direct-mapped filters of the small reads and
+// writes that the current strand has already checked.  When the same
+// instruction in the current strand repeats an access, e.g., in a loop, the
+// repeated access cannot produce a new race report or change the shadow
+// memory, so it can be skipped.  Filter entries are keyed on the instruction
+// as well as the address, so that every instruction still gets checked and
+// race reports are unchanged.  Runs under RR bypass the filters, because RR
+// gives every access a distinct ID, so no access is ever redundant.
+//
+// The filters are accessed only through the stable global symbols declared
+// below, which are defined in the Cilksan runtime.  Rather than clearing the
+// filters at the end of each strand, the runtime increments the strand epoch
+// whenever it clears the occupancy bitmaps, which invalidates all filter
+// entries at once.
+
+// log_2 of the number of entries in each filter.
+static constexpr unsigned LG_FAST_FILTER_SIZE = 10;
+static constexpr uintptr_t FAST_FILTER_MASK = (1UL << LG_FAST_FILTER_SIZE) - 1;
+// Maximum size of an access handled by the fast path.  The size is stored in
+// the high bits of the filter tag above the address.
+static constexpr unsigned FAST_FILTER_SIZE_SHIFT = 48;
+static constexpr size_t MAX_FAST_FILTER_ACCESS_SIZE = 64;
+
+struct FastFilterEntry_t {
+  uintptr_t tag;
+  csi_id_t acc_id;
+  uint64_t epoch;
+};
+
+extern "C" {
+// Epoch of the current strand.  Starts at 1, so that zero-initialized filter
+// entries are never valid.
+extern uint64_t __cilksan_strand_epoch;
+extern FastFilterEntry_t __cilksan_read_filter[1UL << LG_FAST_FILTER_SIZE];
+extern FastFilterEntry_t __cilksan_write_filter[1UL << LG_FAST_FILTER_SIZE];
+}
+
+__attribute__((always_inline)) static inline FastFilterEntry_t &
+fast_filter_entry(bool is_read, uintptr_t addr) {
+  uintptr_t idx = (addr >> 3) & FAST_FILTER_MASK;
+  return is_read ? __cilksan_read_filter[idx] : __cilksan_write_filter[idx];
+}
+
+__attribute__((always_inline)) static inline uintptr_t
+fast_filter_tag(uintptr_t addr, size_t size) {
+  return addr | ((uintptr_t)size << FAST_FILTER_SIZE_SHIFT);
+}
+
+// Returns true if instruction acc_id in the current strand already checked an
+// access of the same kind to [addr, addr+size).
+__attribute__((always_inline)) static inline bool
+fast_filter_hit(bool is_read, csi_id_t acc_id, uintptr_t addr, size_t size) {
+  if (size > MAX_FAST_FILTER_ACCESS_SIZE)
+    return false;
+  const FastFilterEntry_t &entry = fast_filter_entry(is_read, addr);
+  return entry.tag == fast_filter_tag(addr, size) && entry.acc_id == acc_id &&
+         entry.epoch == __cilksan_strand_epoch;
+}
+
+// Record that instruction acc_id in the current strand checked an access to
+// [addr, addr+size).
+__attribute__((always_inline)) static inline void
+fast_filter_insert(bool is_read, csi_id_t acc_id, uintptr_t addr,
+                   size_t size) {
+  if (size > MAX_FAST_FILTER_ACCESS_SIZE)
+    return;
+  FastFilterEntry_t &entry = fast_filter_entry(is_read, addr);
+  entry.tag = fast_filter_tag(addr, size);
+  entry.acc_id = acc_id;
+  entry.epoch = __cilksan_strand_epoch;
+}
+
+// Invalidate all filter entries.  Called by the runtime whenever the current
+// strand ends or shadow memory is cleared.
+__attribute__((always_inline)) static inline void fast_filter_new_epoch() {
+  ++__cilksan_strand_epoch;
+}
+
+#endif // __FAST_PATH_H__
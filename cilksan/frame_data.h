@@ -105,15 +105,29 @@ struct FrameData_t {
   EntryFrameType frame_data;
   // Whether the current instruction is in a continuation in this frame.
   uint8_t InContin = 0;
-  // If this frame was called from the continuation of an ancestor, identifies
-  // that ancestor.  Otherwise equals 0.
+  // Which of the continuations in InContin have been treated as stolen for the
+  // purposes of checking reducers.
+  uint8_t StolenContin = 0;
+  // If this frame was called from a stolen continuation of an ancestor,
+  // identifies that ancestor.  Otherwise equals 0.
   uint32_t ParentContin = 0;
   // Pointers to bags
   unsigned num_Pbags = 0;
+  // Number of non-null P-bags in Pbags.
+  unsigned num_live_Pbags = 0;
+  // Number of unsynced parallel constructs, i.e., non-null P-bags, spawned
+  // helpers and parallel loops, in the ancestors of this frame.  The ancestors
+  // of a frame do not change while it is on the stack.
+  uint32_t ancestors_unsynced = 0;
   SBag_t *Sbag = nullptr;
   PBag_t **Pbags = nullptr;
   SBag_t *Iterbag = nullptr;
   hyper_table *reducer_views = nullptr;
+  // Base pointer of the function that entered this frame, used to unwind the
+  // stack when call stacks are recorded lazily.
+  uintptr_t FrameBP = 0;
+  // Call stack of this frame when call stacks are recorded lazily.
+  call_stack_t CallStack;
 
   // fields that are for debugging purpose only
 #if CILKSAN_DEBUG
@@ -129,9 +143,13 @@ struct FrameData_t {
 
   void set_pbag(unsigned idx, PBag_t *that) {
     cilksan_assert(idx < num_Pbags && "Invalid index");
-    if (Pbags[idx])
+    if (Pbags[idx]) {
       delete Pbags[idx];
+      --num_live_Pbags;
+    }
     Pbags[idx] = that;
+    if (that)
+      ++num_live_Pbags;
   }
 
   void set_iterbag(SBag_t *that) {
@@ -162,10 +180,19 @@ struct FrameData_t {
     num_Pbags = num_pbags;
   }
 
+  void set_call_stack(const call_stack_t &that) {
+    that.retain();
+    CallStack.release();
+    CallStack = that;
+  }
+
   void copy_pbag_array(unsigned copy_num_Pbags, PBag_t **copy_Pbags) {
     clear_pbag_array();
     Pbags = copy_Pbags;
     num_Pbags = copy_num_Pbags;
+    for (unsigned i = 0; i < num_Pbags; ++i)
+      if (Pbags[i])
+        ++num_live_Pbags;
   }
 
   // This function, not the FrameData_t destructor, is the primary way in which
@@ -176,7 +203,11 @@ struct FrameData_t {
     clear_pbag_array();
     set_iterbag(nullptr);
     InContin = 0;
+    StolenContin = 0;
     set_parent_continuation(0);
+    ancestors_unsynced = 0;
+    FrameBP = 0;
+    set_call_stack(call_stack_t());
     // reducer_views = nullptr;
   }
 
@@ -200,6 +231,13 @@ struct FrameData_t {
   bool is_Sbag_used() const { return Sbag_used; }
   bool is_Iterbag_used() const { return Iterbag_used; }
   bool in_continuation() const { return InContin != 0; }
+  // Returns the number of unsynced parallel constructs in this frame and its
+  // ancestors.
+  uint32_t num_unsynced() const {
+    return ancestors_unsynced + num_live_Pbags +
+           ((isHelper(frame_data) || Iterbag) ? 1 : 0);
+  }
+  bool in_stolen_continuation() const { return StolenContin != 0; }
   uint32_t get_parent_continuation() const { return ParentContin; }
   hyper_table *get_or_create_reducer_views() {
     if (!reducer_views)
@@ -213,17 +251,31 @@ struct FrameData_t {
   //   Bit 0 - the computation is in the continuation of a parallel loop.
   //   Bit x > 0 - the computation is in an ordinary continuation for a
   //     particular sync region.
-  void enter_loop_continuation() { InContin |= 0x1; }
-  void exit_loop_continuation() { InContin &= ~0x1; }
-  void enter_continuation(const unsigned sync_reg) {
+  // StolenContin uses the same bits to record which of those continuations
+  // have been treated as stolen since the last sync.  Once a continuation in a
+  // sync region is stolen, subsequent continuations in that region keep using
+  // the views created for it, whether or not they are themselves stolen.
+  void enter_loop_continuation(bool stolen = true) {
+    InContin |= 0x1;
+    if (stolen)
+      StolenContin |= 0x1;
+  }
+  void exit_loop_continuation() {
+    InContin &= ~0x1;
+    StolenContin &= ~0x1;
+  }
+  void enter_continuation(const unsigned sync_reg, bool stolen = true) {
     cilksan_assert(sync_reg < 7 &&
                    "Error marking continuation.  Please report this issue.");
     InContin |= (0x2 << sync_reg);
+    if (stolen)
+      StolenContin |= (0x2 << sync_reg);
   }
   void exit_continuation(const unsigned sync_reg) {
     cilksan_assert(sync_reg < 7 &&
                    "Error marking continuation.  Please report this issue.");
     InContin &= ~(0x2 << sync_reg);
+    StolenContin &= ~(0x2 << sync_reg);
   }
   void set_parent_continuation(uint32_t c) { ParentContin = c; }
   void set_or_merge_reducer_views(CilkSanImpl_t *__restrict__ tool,
@@ -264,22 +316,33 @@ struct FrameData_t {
     Iterbag_used = that.Iterbag_used;
     frame_data = that.frame_data;
     InContin = that.InContin;
+    StolenContin = that.StolenContin;
     ParentContin = that.ParentContin;
     num_Pbags = that.num_Pbags;
+    num_live_Pbags = that.num_live_Pbags;
+    ancestors_unsynced = that.ancestors_unsynced;
     Sbag = that.Sbag;
     Pbags = that.Pbags;
     Iterbag = that.Iterbag;
     reducer_views = that.reducer_views;
+    FrameBP = that.FrameBP;
+    CallStack.release();
+    CallStack = that.CallStack;
 
     that.Sbag_used = false;
     that.Iterbag_used = false;
     that.InContin = 0;
+    that.StolenContin = 0;
     that.ParentContin = 0;
     that.num_Pbags = 0;
+    that.num_live_Pbags = 0;
+    that.ancestors_unsynced = 0;
     that.Sbag = nullptr;
     that.Pbags = nullptr;
     that.Iterbag = nullptr;
     that.reducer_views = nullptr;
+    that.FrameBP = 0;
+    that.CallStack = call_stack_t();
 
     return *this;
   }
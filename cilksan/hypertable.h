@@ -291,6 +291,14 @@ private:
     return nullptr;
   }
 
+  // Helper methods for merge_two_hyper_tables.  Copy the valid buckets of this
+  // table into out, sorted by their hash in a table of size new_capacity, and
+  // return the number of buckets copied.
+  int32_t get_sorted_buckets(bucket *out, index_t new_capacity) const;
+  // Replace the contents of this table with the n buckets in sorted, which
+  // must be sorted by hash for the given capacity.
+  void build_from_sorted(const bucket *sorted, int32_t n, index_t capacity);
+
 public:
   index_t capacity = MIN_CAPACITY;
   int32_t occupancy = 0;
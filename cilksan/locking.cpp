@@ -4,6 +4,7 @@
 #include <threads.h>
 #endif // __STDC_NO_THREADS__
 #include <cilk/cilk_api.h>
+#include <vector>
 
 #include "driver.h"
 
@@ -15,6 +16,28 @@ static LockID_t next_lock_id = atomic_lock_id + 1;
 // Map from memory addresses to locks allocated at those locations.
 static AddrMap_t<LockID_t> lock_ids;
 
+// Scratch space for the addresses of locks to forget.
+static std::vector<uintptr_t> freed_lock_addrs;
+
+void forget_locks_in_range(uintptr_t low, uintptr_t high) {
+  if (!lock_ids.size())
+    return;
+  // Look up each address of a small range individually, rather than scan the
+  // whole map.
+  if (high - low <= lock_ids.size()) {
+    for (uintptr_t addr = low; addr < high; ++addr)
+      lock_ids.remove(addr);
+    return;
+  }
+  lock_ids.for_each_in_range(
+      low, high, [](uintptr_t addr, const LockID_t &) {
+        freed_lock_addrs.push_back(addr);
+      });
+  for (uintptr_t addr : freed_lock_addrs)
+    lock_ids.remove(addr);
+  freed_lock_addrs.clear();
+}
+
 static inline void emit_acquire_release_warning(bool is_aquire,
                                                 const void *mutex) {
   if (is_aquire)
@@ -114,10 +137,8 @@ CILKSAN_API void __csan_mtx_destroy(mtx_t *mutex) {
 // In the future, we might replace the constructor for std::mutex by providing a
 // custom implementation in a distinct header file that is only used when
 // compiling with Cilksan.  But for now we simply allow locking routines to
-// initialize locks.
-//
-// We should also modify Cilksan to properly remove locks when the underlying
-// storage is deallocated, even if the lock is not explicitly destroyed.
+// initialize locks.  Cilksan removes such locks when their storage is freed,
+// even if they are not explicitly destroyed.
 
 CILKSAN_API int __csan_pthread_mutex_lock(pthread_mutex_t *mutex) {
   int result = pthread_mutex_lock(mutex);
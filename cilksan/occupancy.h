@@ -0,0 +1,109 @@
+// -*- C++ -*-
+#ifndef __OCCUPANCY_H__
+#define __OCCUPANCY_H__
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Kernels for setting runs of whole words in the occupancy bitmaps of shadow
+// memory.  Each kernel sets every bit in words[0..n) and returns a combination
+// of the following flags describing the words before they were set.
+enum OccupancyFillResult_t : unsigned {
+  // Some bit in the words was unset.
+  OCC_FOUND_UNOCCUPIED = 0x1,
+  // Some word was entirely unset, meaning it was not yet recorded as touched.
+  OCC_FOUND_EMPTY = 0x2,
+};
+
+using OccupancyFillFn_t = unsigned (*)(uint64_t *words, size_t n);
+
+// A run of whole occupancy words, starting with the word for the byte at addr,
+// that was filled in one step.
+struct OccupancySpan_t {
+  uintptr_t addr;
+  size_t numWords;
+};
+
+inline unsigned fillOccupancyWordsScalar(uint64_t *words, size_t n) {
+  uint64_t all = (uint64_t)(-1);
+  bool foundEmpty = false;
+  for (size_t i = 0; i < n; ++i) {
+    all &= words[i];
+    foundEmpty |= (0UL == words[i]);
+    words[i] = (uint64_t)(-1);
+  }
+  return ((~all) ? OCC_FOUND_UNOCCUPIED : 0) |
+         (foundEmpty ? OCC_FOUND_EMPTY : 0);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) inline unsigned
+fillOccupancyWordsAVX2(uint64_t *words, size_t n) {
+  const __m256i ones = _mm256_set1_epi64x(-1);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i all = ones;
+  __m256i empty = zero;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i *ptr = reinterpret_cast<__m256i *>(&words[i]);
+    __m256i current = _mm256_loadu_si256(ptr);
+    all = _mm256_and_si256(all, current);
+    empty = _mm256_or_si256(empty, _mm256_cmpeq_epi64(current, zero));
+    _mm256_storeu_si256(ptr, ones);
+  }
+  unsigned result = 0;
+  if (!_mm256_testc_si256(all, ones))
+    result |= OCC_FOUND_UNOCCUPIED;
+  if (!_mm256_testz_si256(empty, empty))
+    result |= OCC_FOUND_EMPTY;
+  return result | fillOccupancyWordsScalar(&words[i], n - i);
+}
+
+__attribute__((target("avx512f"))) inline unsigned
+fillOccupancyWordsAVX512(uint64_t *words, size_t n) {
+  const __m512i ones = _mm512_set1_epi64(-1);
+  const __m512i zero = _mm512_setzero_si512();
+  __m512i all = ones;
+  __mmask8 empty = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    void *ptr = &words[i];
+    __m512i current = _mm512_loadu_si512(ptr);
+    all = _mm512_and_si512(all, current);
+    empty |= _mm512_cmpeq_epi64_mask(current, zero);
+    _mm512_storeu_si512(ptr, ones);
+  }
+  unsigned result = 0;
+  if (_mm512_cmpneq_epi64_mask(all, ones))
+    result |= OCC_FOUND_UNOCCUPIED;
+  if (empty)
+    result |= OCC_FOUND_EMPTY;
+  return result | fillOccupancyWordsScalar(&words[i], n - i);
+}
+#endif // defined(__x86_64__)
+
+// Kernel used to fill runs of occupancy words, selected once at startup by
+// selectOccupancyFill() based on the features of the CPU.
+inline OccupancyFillFn_t fillOccupancyWords = fillOccupancyWordsScalar;
+
+// Select the fastest occupancy-fill kernel that the CPU supports.
+inline void selectOccupancyFill() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    fillOccupancyWords = fillOccupancyWordsAVX512;
+    return;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    fillOccupancyWords = fillOccupancyWordsAVX2;
+    return;
+  }
+#endif
+  fillOccupancyWords = fillOccupancyWordsScalar;
+}
+
+#endif // __OCCUPANCY_H__
@@ -4,8 +4,11 @@
 #include <string>
 #include <sstream>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 
+#include <cxxabi.h>
+#include <dlfcn.h>
 #include <inttypes.h>
 #include <unistd.h>
 #include <signal.h>
@@ -147,6 +150,67 @@ static std::string get_info_on_alloca(const csi_id_t alloca_id,
   return convert.str();
 }
 
+// Get the PC of the given memory access.
+static uintptr_t get_mem_access_pc(const csi_id_t acc_id, ACC_TYPE type) {
+  switch (type) {
+  case LOAD_ACC:
+    return load_pc[acc_id];
+  case STORE_ACC:
+    return store_pc[acc_id];
+  case CALL_LOAD_ACC:
+  case CALL_STORE_ACC:
+    return call_pc[acc_id];
+  case ALLOC_LOAD_ACC:
+  case ALLOC_STORE_ACC:
+    return allocfn_pc[acc_id];
+  case FREE_ACC:
+    return free_pc[acc_id];
+  case REALLOC_ACC:
+    return allocfn_pc[acc_id];
+  case STACK_FREE_ACC:
+    return call_pc[acc_id];
+  }
+  return (uintptr_t)nullptr;
+}
+
+// Get the source location of the given memory access.
+static const csan_source_loc_t *
+get_mem_access_src_loc(const csi_id_t acc_id, ACC_TYPE type) {
+  switch (type) {
+  case LOAD_ACC:
+    return __csan_get_load_source_loc(acc_id);
+  case STORE_ACC:
+    return __csan_get_store_source_loc(acc_id);
+  case CALL_LOAD_ACC:
+  case CALL_STORE_ACC:
+    return __csan_get_call_source_loc(acc_id);
+  case ALLOC_LOAD_ACC:
+  case ALLOC_STORE_ACC:
+    return __csan_get_allocfn_source_loc(acc_id);
+  case FREE_ACC:
+    return __csan_get_free_source_loc(acc_id);
+  case REALLOC_ACC:
+    return __csan_get_allocfn_source_loc(acc_id);
+  case STACK_FREE_ACC:
+    return __csan_get_call_source_loc(acc_id);
+  }
+  return nullptr;
+}
+
+// Get the object information for the given memory access.
+static const obj_source_loc_t *
+get_mem_access_obj_src_loc(const csi_id_t acc_id, ACC_TYPE type) {
+  switch (type) {
+  case LOAD_ACC:
+    return __csan_get_load_obj_source_loc(acc_id);
+  case STORE_ACC:
+    return __csan_get_store_obj_source_loc(acc_id);
+  // TODO: Track objects modified by allocfn's, free's, and realloc's.
+  default:
+    return nullptr;
+  }
+}
+
 static std::string
 get_info_on_mem_access(const csi_id_t acc_id, ACC_TYPE type, uint8_t endpoint,
                        const Decorator &d) {
@@ -175,83 +239,21 @@ get_info_on_mem_access(const csi_id_t acc_id, ACC_TYPE type, uint8_t endpoint,
   convert << d.Default();
 
   // Get PC for this access.
-  if (UNKNOWN_CSI_ID != acc_id) {
-    convert << d.InstAddress();
-    switch (type) {
-    case LOAD_ACC:
-      convert << std::hex << load_pc[acc_id];
-      break;
-    case STORE_ACC:
-      convert << std::hex << store_pc[acc_id];
-      break;
-    case CALL_LOAD_ACC:
-    case CALL_STORE_ACC:
-      convert << std::hex << call_pc[acc_id];
-      break;
-    case ALLOC_LOAD_ACC:
-    case ALLOC_STORE_ACC:
-      convert << std::hex << allocfn_pc[acc_id];
-      break;
-    case FREE_ACC:
-      convert << std::hex << free_pc[acc_id];
-      break;
-    case REALLOC_ACC:
-      convert << std::hex << allocfn_pc[acc_id];
-      break;
-    case STACK_FREE_ACC:
-      convert << std::hex << call_pc[acc_id];
-      break;
-    }
-    convert << d.Default();
-  }
+  if (UNKNOWN_CSI_ID != acc_id)
+    convert << d.InstAddress() << std::hex << get_mem_access_pc(acc_id, type)
+            << d.Default();
 
   // Get source information.
   const csan_source_loc_t *src_loc = nullptr;
-  if (UNKNOWN_CSI_ID != acc_id) {
-    switch (type) {
-    case LOAD_ACC:
-      src_loc = __csan_get_load_source_loc(acc_id);
-      break;
-    case STORE_ACC:
-      src_loc = __csan_get_store_source_loc(acc_id);
-      break;
-    case CALL_LOAD_ACC:
-    case CALL_STORE_ACC:
-      src_loc = __csan_get_call_source_loc(acc_id);
-      break;
-    case ALLOC_LOAD_ACC:
-    case ALLOC_STORE_ACC:
-      src_loc = __csan_get_allocfn_source_loc(acc_id);
-      break;
-    case FREE_ACC:
-      src_loc = __csan_get_free_source_loc(acc_id);
-      break;
-    case REALLOC_ACC:
-      src_loc = __csan_get_allocfn_source_loc(acc_id);
-      break;
-    case STACK_FREE_ACC:
-      src_loc = __csan_get_call_source_loc(acc_id);
-      break;
-    }
-  }
+  if (UNKNOWN_CSI_ID != acc_id)
+    src_loc = get_mem_access_src_loc(acc_id, type);
 
   convert << get_src_info_str(src_loc, d);
 
   // Get object information
   const obj_source_loc_t *obj_src_loc = nullptr;
-  if (UNKNOWN_CSI_ID != acc_id) {
-    switch (type) {
-    case LOAD_ACC:
-      obj_src_loc = __csan_get_load_obj_source_loc(acc_id);
-      break;
-    case STORE_ACC:
-      obj_src_loc = __csan_get_store_obj_source_loc(acc_id);
-      break;
-    // TODO: Track objects modified by allocfn's, free's, and realloc's.
-    default:
-      break;
-    }
-  }
+  if (UNKNOWN_CSI_ID != acc_id)
+    obj_src_loc = get_mem_access_obj_src_loc(acc_id, type);
   if (obj_src_loc) {
     convert << "\n" << (endpoint == 0 ? "| " : "||")
             << "       `-to variable ";
@@ -262,11 +264,72 @@ get_info_on_mem_access(const csi_id_t acc_id, ACC_TYPE type, uint8_t endpoint,
   return convert.str();
 }
 
+// Describe the function containing the given return address, using the
+// dynamic symbol table.  Used for call stacks that are recorded lazily.
+static std::string get_info_on_return_pc(uintptr_t pc, const Decorator &d) {
+  std::ostringstream convert;
+  convert << d.InstAddress() << std::hex << pc << std::dec << d.Default();
+
+  Dl_info info;
+  if (!dladdr(reinterpret_cast<void *>(pc), &info)) {
+    convert << " <no information on source location>";
+    return convert.str();
+  }
+  if (info.dli_sname) {
+    int status = 0;
+    char *demangled =
+        abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    convert << " in " << d.Function()
+            << (0 == status ? demangled : info.dli_sname) << d.Default()
+            << "+0x" << std::hex
+            << (pc - reinterpret_cast<uintptr_t>(info.dli_saddr)) << std::dec;
+    free(demangled);
+  }
+  if (info.dli_fname)
+    convert << " (" << info.dli_fname << ")";
+  return convert.str();
+}
+
+// Get the PC of the given call-stack frame.
+static uintptr_t get_call_pc(const CallID_t &call) {
+  switch (call.getType()) {
+  case CALL:
+    return call_pc[call.getID()];
+  case SPAWN:
+    return spawn_pc[call.getID()];
+  case LOOP:
+    return loop_pc[call.getID()];
+  case RETURN_PC:
+    return call.getID();
+  case FUNC:
+    return (uintptr_t)nullptr;
+  }
+  return (uintptr_t)nullptr;
+}
+
+// Get the source location of the given call-stack frame.
+static const csan_source_loc_t *get_call_src_loc(const CallID_t &call) {
+  switch (call.getType()) {
+  case CALL:
+    return __csan_get_call_source_loc(call.getID());
+  case SPAWN:
+    return __csan_get_detach_source_loc(call.getID());
+  case LOOP:
+    return __csan_get_loop_source_loc(call.getID());
+  case RETURN_PC:
+    return nullptr;
+  case FUNC:
+    return __csan_get_func_source_loc(call.getID());
+  }
+  return nullptr;
+}
+
 static std::string get_info_on_call(const CallID_t &call, const Decorator &d) {
   std::ostringstream convert;
   convert << d.RaceLoc();
   switch (call.getType()) {
   case CALL:
+  case RETURN_PC:
     convert << "  Call ";
     break;
   case SPAWN:
@@ -275,42 +338,33 @@ static std::string get_info_on_call(const CallID_t &call, const Decorator &d) {
   case LOOP:
     convert << "Parfor ";
     break;
+  case FUNC:
+    // The source information of the function supplies the separating space.
+    convert << "  Func";
+    break;
   }
   convert << d.Default();
 
   if (call.isUnknownID()) {
-    convert << "<no information on source location>";
+    // An unknown return address marks frames that unwinding could not find.
+    if (RETURN_PC == call.getType())
+      convert << "<unknown frames>";
+    else
+      convert << "<no information on source location>";
     return convert.str();
   }
 
-  uintptr_t pc = (uintptr_t)nullptr;
-  switch (call.getType()) {
-  case CALL:
-    pc = call_pc[call.getID()];
-    break;
-  case SPAWN:
-    pc = spawn_pc[call.getID()];
-    break;
-  case LOOP:
-    pc = loop_pc[call.getID()];
-    break;
+  if (RETURN_PC == call.getType()) {
+    convert << get_info_on_return_pc(call.getID(), d);
+    return convert.str();
   }
-  convert << d.InstAddress() << std::hex << pc << d.Default();
-
-  const csan_source_loc_t *src_loc = nullptr;
-  switch (call.getType()) {
-  case CALL:
-    src_loc = __csan_get_call_source_loc(call.getID());
-    break;
-  case SPAWN:
-    src_loc = __csan_get_detach_source_loc(call.getID());
-    break;
-  case LOOP:
-    src_loc = __csan_get_loop_source_loc(call.getID());
-    break;
+  if (FUNC == call.getType()) {
+    convert << get_src_info_str(get_call_src_loc(call), d);
+    return convert.str();
   }
 
-  convert << get_src_info_str(src_loc, d);
+  convert << d.InstAddress() << std::hex << get_call_pc(call) << d.Default();
+  convert << get_src_info_str(get_call_src_loc(call), d);
 
   return convert.str();
 }
@@ -339,12 +393,13 @@ get_call_stack(const AccessLoc_t &instrAddr) {
   std::unique_ptr<std::pair<CallID_t, uintptr_t>[]>
       call_stack(new std::pair<CallID_t, uintptr_t>[stack_size]);
   {
-    const call_stack_node_t *call_stack_node = instrAddr.getCallStack();
-    for (int i = stack_size - 1;
-         i >= 0;
-         --i, call_stack_node = call_stack_node->getPrev()) {
-      call_stack[i].first = call_stack_node->getCallID();
-      call_stack[i].second = reinterpret_cast<uintptr_t>(call_stack_node);
+    // Rebuild the call stack from the trie of call paths.  The ID of each
+    // prefix of the path identifies that prefix uniquely.
+    uint32_t path = instrAddr.getCallStack();
+    for (int i = stack_size - 1; i >= 0;
+         --i, path = call_paths.get_parent(path)) {
+      call_stack[i].first = call_paths.get_call_id(path);
+      call_stack[i].second = path;
     }
   }
   return call_stack;
@@ -376,6 +431,56 @@ bool CilkSanImpl_t::RunningUnderRR() {
   return false;
 }
 
+// Get the ACC_TYPE of a read with the given MAType_t.
+static ACC_TYPE get_read_acc_type(MAType_t type) {
+  switch (type) {
+  case MAType_t::FNRW:
+    return CALL_LOAD_ACC;
+  case MAType_t::ALLOC:
+    return ALLOC_LOAD_ACC;
+  default:
+    return LOAD_ACC;
+  }
+}
+
+// Get the ACC_TYPE of a write with the given MAType_t.
+static ACC_TYPE get_write_acc_type(MAType_t type) {
+  switch (type) {
+  case MAType_t::FNRW:
+    return CALL_STORE_ACC;
+  case MAType_t::ALLOC:
+    return ALLOC_STORE_ACC;
+  case MAType_t::FREE:
+    return FREE_ACC;
+  case MAType_t::REALLOC:
+    return REALLOC_ACC;
+  case MAType_t::STACK_FREE:
+    return STACK_FREE_ACC;
+  default:
+    return STORE_ACC;
+  }
+}
+
+// Get the ACC_TYPEs of the two accesses involved in a race of the given type.
+static void get_race_acc_types(RaceType_t race_type, MAType_t first,
+                               MAType_t second, ACC_TYPE &first_acc_type,
+                               ACC_TYPE &second_acc_type) {
+  switch (race_type) {
+  case RW_RACE:
+    first_acc_type = get_read_acc_type(first);
+    second_acc_type = get_write_acc_type(second);
+    break;
+  case WW_RACE:
+    first_acc_type = get_write_acc_type(first);
+    second_acc_type = get_write_acc_type(second);
+    break;
+  case WR_RACE:
+    first_acc_type = get_write_acc_type(first);
+    second_acc_type = get_read_acc_type(second);
+    break;
+  }
+}
+
 // static void print_race_info(const RaceInfo_t& race) {
 void RaceInfo_t::print(const AccessLoc_t &first_inst,
                        const AccessLoc_t &second_inst,
@@ -387,116 +492,8 @@ void RaceInfo_t::print(const AccessLoc_t &first_inst,
 
   std::string first_acc_info, second_acc_info;
   ACC_TYPE first_acc_type, second_acc_type;
-  switch(type) {
-  case RW_RACE:
-    switch(first_inst.getType()) {
-    case MAType_t::FNRW:
-      first_acc_type = CALL_LOAD_ACC;
-      break;
-    case MAType_t::ALLOC:
-      first_acc_type = ALLOC_LOAD_ACC;
-      break;
-    default:
-      first_acc_type = LOAD_ACC;
-      break;
-    }
-    switch (second_inst.getType()) {
-    case MAType_t::FNRW:
-      second_acc_type = CALL_STORE_ACC;
-      break;
-    case MAType_t::ALLOC:
-      second_acc_type = ALLOC_STORE_ACC;
-      break;
-    case MAType_t::FREE:
-      second_acc_type = FREE_ACC;
-      break;
-    case MAType_t::REALLOC:
-      second_acc_type = REALLOC_ACC;
-      break;
-    case MAType_t::STACK_FREE:
-      second_acc_type = STACK_FREE_ACC;
-      break;
-    default:
-      second_acc_type = STORE_ACC;
-      break;
-    }
-    break;
-  case WW_RACE:
-    switch (first_inst.getType()) {
-    case MAType_t::FNRW:
-      first_acc_type = CALL_STORE_ACC;
-      break;
-    case MAType_t::ALLOC:
-      first_acc_type = ALLOC_STORE_ACC;
-      break;
-    case MAType_t::FREE:
-      first_acc_type = FREE_ACC;
-      break;
-    case MAType_t::REALLOC:
-      first_acc_type = REALLOC_ACC;
-      break;
-    case MAType_t::STACK_FREE:
-      first_acc_type = STACK_FREE_ACC;
-      break;
-    default:
-      first_acc_type = STORE_ACC;
-      break;
-    }
-    switch (second_inst.getType()) {
-    case MAType_t::FNRW:
-      second_acc_type = CALL_STORE_ACC;
-      break;
-    case MAType_t::ALLOC:
-      second_acc_type = ALLOC_STORE_ACC;
-      break;
-    case MAType_t::FREE:
-      second_acc_type = FREE_ACC;
-      break;
-    case MAType_t::REALLOC:
-      second_acc_type = REALLOC_ACC;
-      break;
-    case MAType_t::STACK_FREE:
-      second_acc_type = STACK_FREE_ACC;
-      break;
-    default:
-      second_acc_type = STORE_ACC;
-      break;
-    }
-    break;
-  case WR_RACE:
-    switch (first_inst.getType()) {
-    case MAType_t::FNRW:
-      first_acc_type = CALL_STORE_ACC;
-      break;
-    case MAType_t::ALLOC:
-      first_acc_type = ALLOC_STORE_ACC;
-      break;
-    case MAType_t::FREE:
-      first_acc_type = FREE_ACC;
-      break;
-    case MAType_t::REALLOC:
-      first_acc_type = REALLOC_ACC;
-      break;
-    case MAType_t::STACK_FREE:
-      first_acc_type = STACK_FREE_ACC;
-      break;
-    default:
-      first_acc_type = STORE_ACC;
-      break;
-    }
-    switch (second_inst.getType()) {
-    case MAType_t::FNRW:
-      second_acc_type = CALL_LOAD_ACC;
-      break;
-    case MAType_t::ALLOC:
-      second_acc_type = ALLOC_LOAD_ACC;
-      break;
-    default:
-      second_acc_type = LOAD_ACC;
-      break;
-    }
-    break;
-  }
+  get_race_acc_types(type, first_inst.getType(), second_inst.getType(),
+                     first_acc_type, second_acc_type);
   first_acc_info =
       get_info_on_mem_access(first_inst.getID(), first_acc_type, 0, d);
   second_acc_info =
@@ -552,6 +549,214 @@ static void open_outf(void) {
     outf.open("cilksan_races.out");
 }
 
+// Streaming log of races, enabled by setting CILKSAN_RACE_LOG to a file name.
+// Each distinct race is appended to the log as a line of JSON as soon as it is
+// found, recording only CSI IDs, call-stack entries, and addresses.  Source
+// information for the IDs referenced in the log is appended once per ID at
+// exit, so programs with many races do not pay to format each one.
+static FILE *race_log = nullptr;
+static bool race_log_opened = false;
+
+// IDs referenced in the race log that must be symbolized at exit.  Accesses
+// are keyed by their ACC_TYPE and ID, and calls by their type and ID.
+static std::unordered_set<uint64_t> logged_accesses;
+static std::unordered_set<uint64_t> logged_calls;
+static std::unordered_set<csi_id_t> logged_allocs;
+
+static constexpr unsigned LOG_KEY_SHIFT = 48;
+static constexpr uint64_t LOG_ID_MASK = (1UL << LOG_KEY_SHIFT) - 1;
+
+static FILE *get_race_log() {
+  if (!race_log_opened) {
+    race_log_opened = true;
+    if (const char *envstr = getenv("CILKSAN_RACE_LOG"))
+      race_log = fopen(envstr, "w");
+  }
+  return race_log;
+}
+
+static const char *get_acc_type_name(ACC_TYPE type) {
+  switch (type) {
+  case LOAD_ACC: return "load";
+  case STORE_ACC: return "store";
+  case CALL_LOAD_ACC: return "call_load";
+  case CALL_STORE_ACC: return "call_store";
+  case ALLOC_LOAD_ACC: return "alloc_load";
+  case ALLOC_STORE_ACC: return "alloc_store";
+  case FREE_ACC: return "free";
+  case REALLOC_ACC: return "realloc";
+  case STACK_FREE_ACC: return "stack_free";
+  }
+  return "unknown";
+}
+
+static const char *get_call_type_name(CallType_t type) {
+  switch (type) {
+  case CALL: return "call";
+  case SPAWN: return "spawn";
+  case LOOP: return "loop";
+  case RETURN_PC: return "return_pc";
+  case FUNC: return "func";
+  }
+  return "unknown";
+}
+
+static const char *get_race_type_name(RaceType_t type) {
+  switch (type) {
+  case RW_RACE: return "RW";
+  case WW_RACE: return "WW";
+  case WR_RACE: return "WR";
+  }
+  return "unknown";
+}
+
+// Write str to the log as a JSON string, or null if str is null.
+static void log_json_string(FILE *log, const char *str) {
+  if (!str) {
+    fputs("null", log);
+    return;
+  }
+  fputc('"', log);
+  for (const char *c = str; *c; ++c) {
+    if (*c == '"' || *c == '\\')
+      fprintf(log, "\\%c", *c);
+    else if ((unsigned char)*c < 0x20)
+      fprintf(log, "\\u%04x", (unsigned char)*c);
+    else
+      fputc(*c, log);
+  }
+  fputc('"', log);
+}
+
+static void log_src_loc(FILE *log, const csan_source_loc_t *src_loc) {
+  if (!src_loc)
+    return;
+  fputs(",\"func\":", log);
+  log_json_string(log, src_loc->name);
+  fputs(",\"file\":", log);
+  log_json_string(log, src_loc->filename);
+  fprintf(log, ",\"line\":%d,\"col\":%d", src_loc->line_number,
+          src_loc->column_number);
+}
+
+static void log_obj_src_loc(FILE *log, const obj_source_loc_t *obj_src_loc) {
+  if (!obj_src_loc)
+    return;
+  fputs(",\"var\":", log);
+  log_json_string(log, obj_src_loc->name);
+  fputs(",\"var_file\":", log);
+  log_json_string(log, obj_src_loc->filename);
+  fprintf(log, ",\"var_line\":%d", obj_src_loc->line_number);
+}
+
+static void log_access(FILE *log, const AccessLoc_t &inst, ACC_TYPE type) {
+  fprintf(log, "{\"acc\":\"%s\",\"id\":", get_acc_type_name(type));
+  if (inst.isValid()) {
+    fprintf(log, "%" PRIu64, inst.getID());
+    logged_accesses.insert(((uint64_t)type << LOG_KEY_SHIFT) | inst.getID());
+  } else {
+    fputs("null", log);
+  }
+
+  // Log the call stack, outermost frame first.
+  fputs(",\"stack\":[", log);
+  int stack_size = inst.getCallStackSize();
+  auto stack = get_call_stack(inst);
+  for (int i = 0; i < stack_size; ++i) {
+    const CallID_t &call = stack[i].first;
+    if (call.isUnknownID()) {
+      fprintf(log, "%s[\"%s\",null]", i ? "," : "",
+              get_call_type_name(call.getType()));
+      continue;
+    }
+    fprintf(log, "%s[\"%s\",%" PRIu64 "]", i ? "," : "",
+            get_call_type_name(call.getType()), call.getID());
+    logged_calls.insert(((uint64_t)call.getType() << LOG_KEY_SHIFT) |
+                        call.getID());
+  }
+  fputs("]}", log);
+}
+
+static void log_race(FILE *log, const AccessLoc_t &first_inst,
+                     const AccessLoc_t &second_inst,
+                     const AccessLoc_t &alloc_inst, uintptr_t addr,
+                     RaceType_t race_type) {
+  ACC_TYPE first_acc_type, second_acc_type;
+  get_race_acc_types(race_type, first_inst.getType(), second_inst.getType(),
+                     first_acc_type, second_acc_type);
+  fprintf(log, "{\"race\":\"%s\",\"addr\":\"0x%" PRIxPTR "\",\"first\":",
+          get_race_type_name(race_type), addr);
+  log_access(log, first_inst, first_acc_type);
+  fputs(",\"second\":", log);
+  log_access(log, second_inst, second_acc_type);
+  if (alloc_inst.isValid()) {
+    fprintf(log, ",\"alloc\":%" PRIu64, alloc_inst.getID());
+    logged_allocs.insert(alloc_inst.getID());
+  }
+  fputs("}\n", log);
+}
+
+// Append source information for every ID referenced in the race log, and
+// close the log.
+static void flush_race_log() {
+  if (!race_log)
+    return;
+  FILE *log = race_log;
+
+  for (uint64_t key : logged_accesses) {
+    ACC_TYPE type = static_cast<ACC_TYPE>(key >> LOG_KEY_SHIFT);
+    csi_id_t acc_id = key & LOG_ID_MASK;
+    fprintf(log,
+            "{\"sym\":\"%s\",\"id\":%" PRIu64 ",\"pc\":\"0x%" PRIxPTR "\"",
+            get_acc_type_name(type), acc_id, get_mem_access_pc(acc_id, type));
+    log_src_loc(log, get_mem_access_src_loc(acc_id, type));
+    log_obj_src_loc(log, get_mem_access_obj_src_loc(acc_id, type));
+    fputs("}\n", log);
+  }
+
+  for (uint64_t key : logged_calls) {
+    CallID_t call(static_cast<CallType_t>(key >> LOG_KEY_SHIFT),
+                  key & LOG_ID_MASK);
+    fprintf(log,
+            "{\"sym\":\"%s\",\"id\":%" PRIu64 ",\"pc\":\"0x%" PRIxPTR "\"",
+            get_call_type_name(call.getType()), call.getID(),
+            get_call_pc(call));
+    if (RETURN_PC == call.getType()) {
+      Dl_info info;
+      if (dladdr(reinterpret_cast<void *>(call.getID()), &info)) {
+        fputs(",\"func\":", log);
+        log_json_string(log, info.dli_sname);
+        fputs(",\"module\":", log);
+        log_json_string(log, info.dli_fname);
+      }
+    } else {
+      log_src_loc(log, get_call_src_loc(call));
+    }
+    fputs("}\n", log);
+  }
+
+  // Odd alloca_id's are heap allocations, even ones are stack allocations.
+  for (csi_id_t alloca_id : logged_allocs) {
+    bool heap = alloca_id % 2;
+    csi_id_t id = alloca_id / 2;
+    fprintf(log,
+            "{\"sym\":\"%s\",\"id\":%" PRIu64 ",\"pc\":\"0x%" PRIxPTR "\"",
+            heap ? "heap_object" : "stack_object", alloca_id,
+            heap ? allocfn_pc[id] : alloca_pc[id]);
+    log_src_loc(log, heap ? __csan_get_allocfn_source_loc(id)
+                          : __csan_get_alloca_source_loc(id));
+    log_obj_src_loc(log, heap ? __csan_get_allocfn_obj_source_loc(id)
+                              : __csan_get_alloca_obj_source_loc(id));
+    fputs("}\n", log);
+  }
+
+  fclose(log);
+  race_log = nullptr;
+  logged_accesses.clear();
+  logged_calls.clear();
+  logged_allocs.clear();
+}
+
 // Log the race detected
 void CilkSanImpl_t::report_race(
     const AccessLoc_t &first_inst, const AccessLoc_t &second_inst,
@@ -559,6 +764,23 @@ void CilkSanImpl_t::report_race(
     enum RaceType_t race_type) {
   static int last_race_count = 0;
   bool found = false;
+
+  // Cheaply skip races between instructions that have already raced.
+  if (first_race_per_pair) {
+    uint64_t first_key =
+        typed_id_t<MAType_t>(first_inst.getType(), first_inst.getID()).get();
+    uint64_t second_key =
+        typed_id_t<MAType_t>(second_inst.getType(), second_inst.getID()).get();
+    if (first_key > second_key)
+      std::swap(first_key, second_key);
+    if (!reported_pairs.insert(std::make_pair(first_key, second_key)).second) {
+      duplicated_races++;
+      return;
+    }
+    raced_ids.insert(first_key);
+    raced_ids.insert(second_key);
+  }
+
   // TODO: Make the key computation consistent with is_equivalent_race().
   uint64_t key = first_inst < second_inst ?
                               first_inst.getID() : second_inst.getID();
@@ -594,16 +816,35 @@ void CilkSanImpl_t::report_race(
              << " racing pairs.";
         last_race_count = get_num_races_found();
       }
-    } else
+    } else if (FILE *log = get_race_log())
+      log_race(log, first_inst, second_inst, alloc_inst, addr, race_type);
+    else
       race.print(first_inst, second_inst, alloc_inst, Decorator(color_report));
     races_found.insert(std::make_pair(key, race));
     if (PauseOnRace())
       // Raise a SIGTRAP to let the user examine the state of the program at
       // this point within the debugger.
       raise(SIGTRAP);
+    if (max_races && races_found.size() >= max_races)
+      stop_at_max_races();
   }
 }
 
+// Stop the program once the maximum number of distinct races has been
+// reported.  We exit immediately, rather than through the normal exit path,
+// because the tool and the program-under-test may be in the middle of an
+// update.
+void CilkSanImpl_t::stop_at_max_races() {
+  print_race_report();
+  outs << "Cilksan stopped the program after " << max_races
+       << " distinct races (CILKSAN_MAX_RACES).\n";
+  outs.flush();
+  if (outf.is_open())
+    outf.close();
+  fflush(stdout);
+  _exit(1);
+}
+
 void CilkSanImpl_t::report_race(
     const AccessLoc_t &first_inst, const AccessLoc_t &second_inst,
     uintptr_t addr, enum RaceType_t race_type) {
@@ -615,6 +856,7 @@ int CilkSanImpl_t::get_num_races_found() {
 }
 
 void CilkSanImpl_t::print_race_report() {
+  flush_race_log();
   outs << "\n";
   outs << "Cilksan detected " << get_num_races_found() << " distinct races.\n";
   if (!is_running_under_rr) {
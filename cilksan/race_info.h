@@ -65,11 +65,16 @@ template <typename TYPE_T> struct typed_id_t {
   }
 };
 
-// Type of frame on the call stack: a function call, a spawn, or a loop.
+// Type of frame on the call stack: a function call, a spawn, or a loop.  When
+// call stacks are recorded lazily, a Cilk frame is instead identified by the
+// return addresses found by unwinding the stack, followed by the ID of the
+// entered function.
 enum CallType_t : uint8_t {
   CALL,
   SPAWN,
-  LOOP
+  LOOP,
+  RETURN_PC,
+  FUNC
 };
 // Class representing the ID of a frame on the call stack.
 class CallID_t {
@@ -122,198 +127,324 @@ public:
     case LOOP:
       os << "LOOP " << id.getID();
       break;
+    case RETURN_PC:
+      os << "RETURN_PC " << std::hex << id.getID() << std::dec;
+      break;
+    case FUNC:
+      os << "FUNC " << id.getID();
+      break;
     }
     return os;
   }
 };
 
-// Specialized stack data structure for representing the call stack.  Cilksan
-// models the call stack using a singly-linked list with reference-counted
-// nodes.  When a race is recorded, the call stack for that race is preserved by
-// saving a pointer to the tail of the call stack.
-
-// Class for reference-counted nodes on the call stack.
-class call_stack_node_t {
-  friend class call_stack_t;
-  friend class AccessLoc_t;
-
-  // A node on the call stack contains a frame, a pointer to a previous (parent)
-  // node, and a reference count.
+// Specialized data structure for representing the call stack.  Cilksan interns
+// call stacks in a trie, where each node represents a call path and is keyed by
+// the ID of its parent path and the CallID_t of its last frame.  A call stack
+// is then just the 32-bit ID of a node in the trie.  Pushing a frame looks up
+// or creates the child node, and popping a frame follows the parent link.
+//
+// Pushing and popping frames does not count references.  Instead, only the
+// structures that keep a call stack after the frame returns, namely the
+// disjoint-set nodes of SP-bags, retain their call paths.  When the trie runs
+// out of nodes, it reclaims the nodes that are not retained, have no children
+// and are not the current call path, before growing.
+
+// A node in the trie of call paths.
+struct call_path_node_t {
+  // The last frame on this call path.
   CallID_t id;
-  call_stack_node_t *prev;
-  int64_t ref_count;
+  // ID of the path without this frame.  For a free node, the ID of the next
+  // free node.
+  uint32_t parent;
+  // Number of frames on this call path, or 0 for a free node.
+  uint32_t depth;
+  // ID of the most recently interned child of this path.  Used as a hint to
+  // avoid hash-table lookups when the same call is made repeatedly.
+  uint32_t last_child;
+  // Number of retained references to this path plus the number of its
+  // children.
+  uint32_t refs;
+};
 
-public:
-  // Constructor
-  call_stack_node_t(CallID_t id, call_stack_node_t *prev = nullptr)
-      // Set ref_count to 1, under the assumption that only call_stack_t
-      // constructs nodes and will immediately set the tail pointer to point to
-      // this node.
-      : id(id), prev(prev), ref_count(1) {
-    if (prev)
-      prev->ref_count++;
-  }
-  // Destructor
-  ~call_stack_node_t() {
-    cilksan_assert(!ref_count);
-    if (prev) {
-      call_stack_node_t *old_prev = prev;
-      prev = nullptr;
-      cilksan_assert(old_prev->ref_count > 0);
-      old_prev->ref_count--;
-      if (!old_prev->ref_count)
-        delete old_prev;
+// Trie of interned call paths.  ID 0 denotes the empty call path.
+class call_path_trie_t {
+  static constexpr uint32_t INIT_NODE_CAPACITY = 1024;
+  static constexpr uint32_t MAX_NODE_CAPACITY = 1U << 30;
+
+  // Array of nodes, indexed by path ID.
+  call_path_node_t *nodes = nullptr;
+  uint32_t num_nodes = 0;
+  uint32_t node_capacity = 0;
+  // Number of nodes in use, not counting the empty path.
+  uint32_t num_live = 0;
+  // List of free nodes below num_nodes, linked through their parent fields.
+  uint32_t free_head = 0;
+
+  // Open-addressing hash table mapping (parent, CallID_t) pairs to path IDs.
+  // Empty slots hold 0, which is never the ID of an interned child.
+  uint32_t *table = nullptr;
+  uint32_t table_capacity = 0;
+
+  static inline uint32_t hash(uint32_t parent, const CallID_t &id) {
+    uint64_t x = (static_cast<uint64_t>(parent) << 32) ^
+                 (static_cast<uint64_t>(id.getType()) << 48) ^ id.getID();
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdUL;
+    x ^= x >> 33;
+    return static_cast<uint32_t>(x);
+  }
+
+  void init() {
+    node_capacity = INIT_NODE_CAPACITY;
+    nodes = new call_path_node_t[node_capacity];
+    // Node 0 is the root, representing the empty call path.
+    nodes[0].parent = 0;
+    nodes[0].depth = 0;
+    nodes[0].last_child = 0;
+    nodes[0].refs = 0;
+    num_nodes = 1;
+    table_capacity = 2 * INIT_NODE_CAPACITY;
+    table = new uint32_t[table_capacity]();
+  }
+
+  void grow_nodes() {
+    if (node_capacity >= MAX_NODE_CAPACITY)
+      die("Too many call paths (%u).\n", num_live);
+    call_path_node_t *old_nodes = nodes;
+    node_capacity *= 2;
+    nodes = new call_path_node_t[node_capacity];
+    for (uint32_t i = 0; i < num_nodes; ++i)
+      nodes[i] = old_nodes[i];
+    delete[] old_nodes;
+  }
+
+  void grow_table() {
+    // The table holds fewer than MAX_NODE_CAPACITY entries at a load factor of
+    // at most 1/2, so it never needs more than 2 * MAX_NODE_CAPACITY slots.
+    if (table_capacity > MAX_NODE_CAPACITY)
+      die("Too many call paths (%u).\n", num_live);
+    uint32_t *old_table = table;
+    uint32_t old_capacity = table_capacity;
+    table_capacity *= 2;
+    table = new uint32_t[table_capacity]();
+    for (uint32_t i = 0; i < old_capacity; ++i) {
+      uint32_t path = old_table[i];
+      if (!path)
+        continue;
+      uint32_t slot =
+          hash(nodes[path].parent, nodes[path].id) & (table_capacity - 1);
+      while (table[slot])
+        slot = (slot + 1) & (table_capacity - 1);
+      table[slot] = path;
+    }
+    delete[] old_table;
+  }
+
+  // Remove path from the hash table, shifting later entries of its probe
+  // sequence back so that lookups never need to skip over deleted entries.
+  void remove_from_table(uint32_t path) {
+    uint32_t mask = table_capacity - 1;
+    uint32_t hole = hash(nodes[path].parent, nodes[path].id) & mask;
+    while (table[hole] != path)
+      hole = (hole + 1) & mask;
+    uint32_t i = hole;
+    while (true) {
+      i = (i + 1) & mask;
+      uint32_t other = table[i];
+      if (!other)
+        break;
+      uint32_t home = hash(nodes[other].parent, nodes[other].id) & mask;
+      // Move the entry at i if its home slot does not lie cyclically in
+      // (hole, i].
+      if (((i - home) & mask) >= ((i - hole) & mask)) {
+        table[hole] = other;
+        hole = i;
+      }
+    }
+    table[hole] = 0;
+  }
+
+  // Free the node for path, and then any ancestors below limit that are left
+  // unreferenced.
+  void free_node(uint32_t path, uint32_t limit) {
+    while (true) {
+      uint32_t parent = nodes[path].parent;
+      remove_from_table(path);
+      if (nodes[parent].last_child == path)
+        nodes[parent].last_child = 0;
+      nodes[path].depth = 0;
+      nodes[path].parent = free_head;
+      free_head = path;
+      --num_live;
+      if (--nodes[parent].refs || !parent || parent >= limit)
+        return;
+      path = parent;
     }
   }
 
-  // Get the ID of this call-stack frame
-  inline const CallID_t &getCallID() const {
-    return id;
+  // Free all unreferenced nodes other than keep.  Returns the number of nodes
+  // freed.
+  uint32_t reclaim(uint32_t keep) {
+    uint32_t old_live = num_live;
+    ++nodes[keep].refs;
+    for (uint32_t path = 1; path < num_nodes; ++path)
+      if (nodes[path].depth && !nodes[path].refs)
+        // Ancestors after path are freed when the scan reaches them.
+        free_node(path, path);
+    --nodes[keep].refs;
+    return old_live - num_live;
+  }
+
+  // Get an unused node ID, reclaiming or allocating nodes as necessary.
+  // Protects the path parent from being reclaimed.
+  uint32_t new_node(uint32_t parent) {
+    if (!free_head && num_nodes == node_capacity) {
+      // Grow the array of nodes if reclaiming frees too few nodes, to bound
+      // the amortized cost of reclaiming.
+      if (reclaim(parent) < node_capacity / 4)
+        grow_nodes();
+    }
+    if (free_head) {
+      uint32_t path = free_head;
+      free_head = nodes[path].parent;
+      return path;
+    }
+    return num_nodes++;
   }
 
-  // Get the previous (parent) call-stack frame
-  inline const call_stack_node_t *getPrev() const {
-    return prev;
+  // Slow path of intern(), which probes the hash table.
+  uint32_t intern_slow(uint32_t parent, const CallID_t &id) {
+    if (__builtin_expect(!nodes, false))
+      init();
+
+    uint32_t slot = hash(parent, id) & (table_capacity - 1);
+    while (uint32_t path = table[slot]) {
+      if (nodes[path].parent == parent && nodes[path].id == id) {
+        nodes[parent].last_child = path;
+        return path;
+      }
+      slot = (slot + 1) & (table_capacity - 1);
+    }
+
+    // Create a new node for this call path.  Getting the node may reclaim
+    // other nodes and change the hash table, so probe for the slot again.
+    uint32_t path = new_node(parent);
+    nodes[path].id = id;
+    nodes[path].parent = parent;
+    nodes[path].depth = nodes[parent].depth + 1;
+    nodes[path].last_child = 0;
+    nodes[path].refs = 0;
+    ++nodes[parent].refs;
+    nodes[parent].last_child = path;
+    ++num_live;
+
+    // Keep the load factor of the hash table at most 1/2.
+    if (2 * num_live > table_capacity)
+      grow_table();
+    slot = hash(parent, id) & (table_capacity - 1);
+    while (table[slot])
+      slot = (slot + 1) & (table_capacity - 1);
+    table[slot] = path;
+    return path;
   }
 
-  // Simple free-list allocator to conserve space and time in managing
-  // call_stack_node_t objects.
-  static call_stack_node_t *free_list;
+public:
+  // Get the ID of the call path formed by appending id to path parent,
+  // creating that path if necessary.
+  __attribute__((always_inline)) uint32_t intern(uint32_t parent,
+                                                 const CallID_t &id) {
+    if (__builtin_expect(nodes != nullptr, true)) {
+      uint32_t hint = nodes[parent].last_child;
+      if (hint && nodes[hint].id == id)
+        return hint;
+    }
+    return intern_slow(parent, id);
+  }
 
-  // Overloaded new operator for free-list allocator
-  void *operator new(size_t size) {
-    if (free_list) {
-      call_stack_node_t *new_node = free_list;
-      free_list = free_list->prev;
-      return new_node;
+  // Keep path from being reclaimed until a matching call to release().
+  __attribute__((always_inline)) void retain(uint32_t path) {
+    if (path)
+      ++nodes[path].refs;
+  }
+  __attribute__((always_inline)) void release(uint32_t path) {
+    // Paths may be released after the trie is cleaned up at the end of the
+    // program.
+    if (path && nodes) {
+      cilksan_assert(nodes[path].refs && "Releasing unretained call path.");
+      --nodes[path].refs;
     }
-    return ::operator new(size);
   }
 
-  // Overloaded delete operator for free-list allocator
-  void operator delete(void *ptr) {
-    call_stack_node_t *del_node = reinterpret_cast<call_stack_node_t *>(ptr);
-    del_node->prev = free_list;
-    free_list = del_node;
+  __attribute__((always_inline)) const CallID_t &
+  get_call_id(uint32_t path) const {
+    return nodes[path].id;
+  }
+  __attribute__((always_inline)) uint32_t get_parent(uint32_t path) const {
+    return nodes[path].parent;
+  }
+  __attribute__((always_inline)) uint32_t get_depth(uint32_t path) const {
+    return path ? nodes[path].depth : 0;
   }
 
-  // Static method for cleaning up the free-list at the end of the program
-  static void cleanup_freelist() {
-    call_stack_node_t *node = free_list;
-    call_stack_node_t *next = nullptr;
-    while (node) {
-      next = node->prev;
-      ::operator delete(node);
-      node = next;
-    }
+  // Number of call paths in use, not counting the empty path.
+  uint32_t size() const { return num_live; }
+
+  // Free all interned call paths at the end of the program.
+  void cleanup() {
+    delete[] nodes;
+    delete[] table;
+    nodes = nullptr;
+    table = nullptr;
+    num_nodes = node_capacity = table_capacity = 0;
+    num_live = free_head = 0;
   }
 };
 
+// Global trie of call paths.
+extern call_path_trie_t call_paths;
+
 // Top-level class for the call stack.
 class call_stack_t {
-  friend class AccessLoc_t;
-  friend class SBag_t;
-
-  call_stack_node_t *tail = nullptr;
+  // ID of the call path in the trie.
+  uint32_t path = 0;
 
 public:
   // Default constructor
   call_stack_t() {}
-  // Copy constructor
-  call_stack_t(const call_stack_t &copy) : tail(copy.tail) {
-    if (tail)
-      tail->ref_count++;
-  }
-  // Destructor
-  ~call_stack_t() {
-    if (tail) {
-      call_stack_node_t *old_tail = tail;
-      tail = nullptr;
-      cilksan_assert(old_tail->ref_count > 0);
-      old_tail->ref_count--;
-      if (!old_tail->ref_count)
-        delete old_tail;
-    }
-  }
 
-  // Get the end of this call stack
-  inline const call_stack_node_t *getTail() const {
-    return tail;
+  // Get the ID of the call path for this call stack
+  inline uint32_t getPath() const {
+    return path;
   }
 
   // Test if the end of this call stack matches the given ID
   inline bool tailMatches(const CallID_t &id) const {
-    return tail->id == id;
+    return path && call_paths.get_call_id(path) == id;
   }
 
-  // Copy-assignment operator
-  inline call_stack_t &operator=(const call_stack_t &copy) {
-    call_stack_node_t *old_tail = tail;
-    tail = copy.tail;
-    if (tail)
-      tail->ref_count++;
-    if (old_tail) {
-      old_tail->ref_count--;
-      if (!old_tail->ref_count)
-        delete old_tail;
-    }
-    return *this;
-  }
-
-  // Move-assignment operator
-  inline call_stack_t &operator=(const call_stack_t &&move) {
-    if (tail) {
-      tail->ref_count--;
-      if (!tail->ref_count)
-        delete tail;
-    }
-    tail = move.tail;
-    return *this;
+  // Keep this call stack's path in the trie until a matching call to release().
+  inline void retain() const {
+    call_paths.retain(path);
   }
-
-  inline void overwrite(const call_stack_t &copy) {
-    tail = copy.tail;
+  inline void release() const {
+    call_paths.release(path);
   }
 
   // Push a new call-stack frame onto this call stack
   inline void push(CallID_t id) {
-    call_stack_node_t *new_node = new call_stack_node_t(id, tail);
-    // new_node has ref_count 1 and, if tail was not null, has incremented
-    // tail's ref count.
-    tail = new_node;
-    // Decrement the tail's ref_count, since we no longer point to that tail
-    if (tail->prev) {
-      cilksan_assert(tail->prev->ref_count > 1);
-      tail->prev->ref_count--;
-    }
-    // Now the ref_count's should reflect the pointer structure.
+    path = call_paths.intern(path, id);
   }
 
   // Pop the call-stack frame off the end of this call stack
   inline void pop() {
-    cilksan_assert(tail);
-    call_stack_node_t *old_node = tail;
-    tail = tail->prev;
-    // Increment the new tail's ref_count, since we now point to it
-    if (tail)
-      tail->ref_count++;
-    // Decrement the old tail's ref_count, and delete it if necessary
-    cilksan_assert(old_node->ref_count > 0);
-    old_node->ref_count--;
-    if (!old_node->ref_count)
-      // Deleting the old node will decrement tail's ref_count.
-      delete old_node;
+    cilksan_assert(path);
+    path = call_paths.get_parent(path);
   }
 
   // Get the size of this call stack
   inline int size() const {
-    call_stack_node_t *node = tail;
-    int size = 0;
-    while (node) {
-      ++size;
-      node = node->prev;
-    }
-    return size;
+    return call_paths.get_depth(path);
   }
 };
 
@@ -338,84 +469,26 @@ public:
               const call_stack_t &_call_stack)
       : acc_loc(_acc_loc), type(_type), call_stack(_call_stack) {}
 
-  // Copy constructor
-  AccessLoc_t(const AccessLoc_t &copy)
-      : acc_loc(copy.acc_loc), type(copy.type), call_stack(copy.call_stack) {}
-
-  // Move constructor
-  AccessLoc_t(AccessLoc_t &&move) : acc_loc(move.acc_loc), type(move.type) {
-    call_stack.overwrite(move.call_stack);
-  }
-
-  // Destructor
-  ~AccessLoc_t() = default;
-
   // Accessors
   inline csi_id_t getID() const { return acc_loc; }
   inline MAType_t getType() const { return type; }
-  inline const call_stack_node_t *getCallStack() const {
-    return call_stack.tail;
-  }
+  inline uint32_t getCallStack() const { return call_stack.getPath(); }
   inline int getCallStackSize() const { return call_stack.size(); }
 
   inline bool isValid() const { return acc_loc != UNKNOWN_CSI_ID; }
 
   inline void invalidate() {
-    dec_ref_count();
-    call_stack.tail = nullptr;
+    call_stack = call_stack_t();
     acc_loc = UNKNOWN_CSI_ID;
   }
 
-  // Copy assignment operator
-  inline AccessLoc_t& operator=(const AccessLoc_t &copy) {
-    acc_loc = copy.acc_loc;
-    type = copy.type;
-    call_stack = copy.call_stack;
-    return *this;
-  }
-  // Move assignment operator
-  inline AccessLoc_t& operator=(AccessLoc_t &&move) {
-    acc_loc = move.acc_loc;
-    type = move.type;
-    call_stack = std::move(move.call_stack);
-    return *this;
-  }
-
-  // Methods for managing the reference count
-  inline int64_t inc_ref_count(int64_t count = 1) {
-    if (!call_stack.tail)
-      return 0;
-    call_stack.tail->ref_count += count;
-    return call_stack.tail->ref_count;
-  }
-
-  inline int64_t dec_ref_count(int64_t count = 1) {
-    if (!call_stack.tail)
-      return 0;
-    cilksan_assert(call_stack.tail->ref_count >= count);
-    call_stack.tail->ref_count -= count;
-    if (!call_stack.tail->ref_count) {
-      delete call_stack.tail;
-      call_stack.tail = nullptr;
-      return 0;
-    }
-    return call_stack.tail->ref_count;
-  }
-
   // Equality comparison operator
   inline bool operator==(const AccessLoc_t &that) const {
     if (acc_loc != that.acc_loc || type != that.type)
       return false;
 #if CHECK_EQUIVALENT_STACKS
-    call_stack_node_t *this_node = call_stack.tail;
-    call_stack_node_t *that_node = that.call_stack.tail;
-    while (this_node && that_node) {
-      if (this_node->id != that_node->id)
-        return false;
-      this_node = this_node->prev;
-      that_node = that_node->prev;
-    }
-    if (this_node || that_node)
+    // Interned call paths are equal if and only if their IDs are equal.
+    if (call_stack.getPath() != that.call_stack.getPath())
       return false;
 #endif // CHECK_EQUIVALENT_STACKS
     return true;
@@ -435,10 +508,10 @@ public:
   inline friend std::ostream &operator<<(std::ostream &os,
                                          const AccessLoc_t &loc) {
     os << loc.acc_loc;
-    // call_stack_node_t *node = loc.call_stack.tail;
-    const call_stack_node_t *node = loc.getCallStack();
-    while (node) {
-      switch (node->getCallID().getType()) {
+    for (uint32_t path = loc.getCallStack(); path;
+         path = call_paths.get_parent(path)) {
+      const CallID_t &id = call_paths.get_call_id(path);
+      switch (id.getType()) {
       case CALL:
         os << " CALL";
         break;
@@ -448,9 +521,14 @@ public:
       case LOOP:
         os << " LOOP";
         break;
+      case RETURN_PC:
+        os << " RETURN_PC";
+        break;
+      case FUNC:
+        os << " FUNC";
+        break;
       }
-      os << " " << std::dec << node->getCallID().getID();
-      node = node->getPrev();
+      os << " " << std::dec << id.getID();
     }
     return os;
   }
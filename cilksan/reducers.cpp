@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
@@ -61,6 +62,8 @@ CILKSAN_API void __csan_llvm_reducer_unregister(const csi_id_t call_id,
   if (hyper_table *reducer_views = CilkSanImpl.get_reducer_views()) {
     reducer_views->remove((uintptr_t)key);
   }
+  // Free the released views of this reducer.
+  CilkSanImpl.drain_reducer_view_pool((uintptr_t)key);
 
   if (!is_execution_parallel())
     return;
@@ -93,6 +96,7 @@ CILKSAN_API void *__csan_llvm_hyper_lookup(const csi_id_t call_id,
     if (void *new_view =
             CilkSanImpl.reducer_lookup(reducer_views, (uintptr_t)key)) {
       DBG_TRACE(REDUCER, "hyper_lookup: found view: %p -> %p\n", key, new_view);
+      CilkSanImpl.reuse_reducer_view((uintptr_t)key, new_view, size);
       return new_view;
     }
     // Create and return a new reducer view.
@@ -152,9 +156,8 @@ void CilkSanImpl_t::reduce_local_views() {
     void *left_view = (void *)b.key;
     reducer_base rb = b.value;
     rb.reduce_fn(left_view, rb.view);
-    // Delete the right view.
-    free(rb.view);
-    mark_free(rb.view);
+    // Release the right view.
+    release_reducer_view(b.key, rb.view);
   }
   enable_checking();
 
@@ -165,6 +168,130 @@ void CilkSanImpl_t::reduce_local_views() {
   f->reducer_views = nullptr;
 }
 
+void CilkSanImpl_t::release_reducer_view(uintptr_t key, void *view) {
+  const size_t *size = malloc_sizes.get((uintptr_t)view);
+  if (!size) {
+    free(view);
+    return;
+  }
+  ViewPool_t &pool = reducer_view_pool[key];
+  if (pool.size != *size) {
+    // The key now names a reducer of a different size.
+    drain_reducer_view_pool(key);
+    pool.size = *size;
+  }
+  if (pool.views.size() >= MAX_POOLED_VIEWS) {
+    free_reducer_view(view);
+    return;
+  }
+  pool.views.push_back(view);
+  if (++num_pooled_views > max_pooled_views)
+    max_pooled_views = num_pooled_views;
+}
+
+void CilkSanImpl_t::drain_reducer_view_pool(uintptr_t key) {
+  auto pool = reducer_view_pool.find(key);
+  if (pool == reducer_view_pool.end())
+    return;
+  for (void *view : pool->second.views)
+    free_reducer_view(view);
+  num_pooled_views -= pool->second.views.size();
+  pool->second.views.clear();
+}
+
+void CilkSanImpl_t::free_reducer_view_pool() {
+  if (reducer_view_pool.empty())
+    return;
+  for (auto &entry : reducer_view_pool)
+    for (void *view : entry.second.views)
+      free_reducer_view(view);
+  reducer_view_pool.clear();
+  num_pooled_views = 0;
+}
+
+int32_t hyper_table::get_sorted_buckets(bucket *out,
+                                        index_t new_capacity) const {
+  int32_t n = 0;
+  if (capacity < MIN_HT_CAPACITY) {
+    // The buckets of a small table are unordered, but there are few of them.
+    // Insertion-sort them by their hash for the new capacity.
+    for (int32_t i = 0; i < occupancy; ++i) {
+      bucket b = buckets[i];
+      b.hash = get_table_entry(new_capacity, b.key);
+      int32_t j = n++;
+      for (; j > 0 && out[j - 1].hash > b.hash; --j)
+        out[j] = out[j - 1];
+      out[j] = b;
+    }
+    return n;
+  }
+
+  // With ordered linear probing, the buckets are sorted by hash, starting
+  // after the run, if any, that wraps around the end of the table.  Find the
+  // end of that wrapped run at the start of the array.
+  index_t start = 0;
+  while (start < capacity && !is_empty(buckets[start].key) &&
+         (is_tombstone(buckets[start].key) || buckets[start].hash > start))
+    ++start;
+  if (start == capacity)
+    start = 0;
+
+  // The hash of a key for the new capacity consists of its hash for this
+  // capacity in the low bits and a group number in the high bits.  Within a
+  // group, the sorted order of this table is also sorted by the new hash, so
+  // walking the sorted buckets once per group yields them in sorted order.
+  // The number of groups is new_capacity / capacity, so these walks take
+  // O(new_capacity) time, as does building a table with the new capacity.
+  index_t num_groups = new_capacity / capacity;
+  for (index_t group = 0; group < num_groups; ++group) {
+    for (index_t k = 0; k < capacity; ++k) {
+      index_t i = start + k;
+      if (i >= capacity)
+        i -= capacity;
+      const bucket &b = buckets[i];
+      if (!is_valid(b.key))
+        continue;
+      index_t new_hash = get_table_entry(new_capacity, b.key);
+      if (num_groups > 1 && new_hash / capacity != group)
+        continue;
+      out[n] = b;
+      out[n].hash = new_hash;
+      ++n;
+    }
+  }
+  return n;
+}
+
+void hyper_table::build_from_sorted(const bucket *sorted, int32_t n,
+                                    index_t new_capacity) {
+  delete[] buckets;
+  buckets = bucket_array_create(new_capacity);
+  capacity = new_capacity;
+  occupancy = 0;
+  ins_rm_count = 0;
+
+  // Place each bucket at its hash or just after the previously placed bucket,
+  // whichever is later.  Because the buckets are sorted, this placement
+  // produces the same runs as inserting the buckets one at a time.
+  index_t next = 0;
+  int32_t i = 0;
+  for (; i < n; ++i) {
+    index_t pos = sorted[i].hash > next ? sorted[i].hash : next;
+    if (pos >= new_capacity)
+      break;
+    buckets[pos] = sorted[i];
+    next = pos + 1;
+    ++occupancy;
+  }
+  // Any remaining buckets must wrap around the end of the table.  There are
+  // few of these, so insert them normally.
+  for (; i < n; ++i) {
+    bool success = insert(sorted[i]);
+    assert(success && "Failed to insert when merging tables.");
+    (void)success;
+  }
+}
+
 hyper_table *
 hyper_table::merge_two_hyper_tables(CilkSanImpl_t *__restrict__ tool,
                                     hyper_table *__restrict__ left,
@@ -197,6 +324,81 @@ hyper_table::merge_two_hyper_tables(CilkSanImpl_t *__restrict__ tool,
     left_dst = false;
   }
 
+  if (src->capacity >= MIN_HT_CAPACITY) {
+    // Both tables are hash tables.  Merge them in a single pass over their
+    // buckets sorted by hash, rather than probing dst for each bucket in src.
+    index_t new_capacity =
+        (left->capacity > right->capacity) ? left->capacity : right->capacity;
+    int32_t max_occupancy = left->occupancy + right->occupancy;
+    while (is_overloaded(max_occupancy, new_capacity))
+      new_capacity *= 2;
+
+    // Sort the buckets of each table, and merge them, in one scratch buffer.
+    // Take the tool's scratch buffer for the duration of the merge, in case a
+    // reduce function causes another merge.
+    std::vector<bucket> scratch;
+    scratch.swap(tool->hyper_table_scratch);
+    if (scratch.size() < 2 * (size_t)max_occupancy)
+      scratch.resize(2 * (size_t)max_occupancy);
+    bucket *sorted_left = scratch.data();
+    bucket *sorted_right = sorted_left + left->occupancy;
+    bucket *merged = sorted_left + max_occupancy;
+    int32_t num_left = left->get_sorted_buckets(sorted_left, new_capacity);
+    int32_t num_right = right->get_sorted_buckets(sorted_right, new_capacity);
+
+    int32_t l = 0, r = 0, m = 0;
+    while (l < num_left && r < num_right) {
+      index_t left_hash = sorted_left[l].hash;
+      index_t right_hash = sorted_right[r].hash;
+      if (left_hash < right_hash) {
+        merged[m++] = sorted_left[l++];
+        continue;
+      }
+      if (right_hash < left_hash) {
+        merged[m++] = sorted_right[r++];
+        continue;
+      }
+
+      // Both tables contain buckets with this hash.  Find the extent of those
+      // buckets in each table.
+      int32_t left_end = l, right_end = r;
+      while (left_end < num_left && sorted_left[left_end].hash == left_hash)
+        ++left_end;
+      while (right_end < num_right && sorted_right[right_end].hash == left_hash)
+        ++right_end;
+
+      // Merge the views of any key that appears in both tables, being sure to
+      // preserve left-to-right ordering.  Keep the left view and release the
+      // right view.
+      for (int32_t i = r; i < right_end; ++i) {
+        bucket &rb = sorted_right[i];
+        for (int32_t j = l; j < left_end; ++j) {
+          bucket &lb = sorted_left[j];
+          if (lb.key != rb.key)
+            continue;
+          lb.value.reduce_fn(lb.value.view, rb.value.view);
+          tool->release_reducer_view(rb.key, rb.value.view);
+          rb.key = KEY_EMPTY;
+          break;
+        }
+      }
+      for (; l < left_end; ++l)
+        merged[m++] = sorted_left[l];
+      for (; r < right_end; ++r)
+        if (!is_empty(sorted_right[r].key))
+          merged[m++] = sorted_right[r];
+    }
+    while (l < num_left)
+      merged[m++] = sorted_left[l++];
+    while (r < num_right)
+      merged[m++] = sorted_right[r++];
+
+    dst->build_from_sorted(merged, m, new_capacity);
+    scratch.swap(tool->hyper_table_scratch);
+    delete src;
+    return dst;
+  }
+
   int32_t src_capacity =
       (src->capacity < MIN_HT_CAPACITY) ? src->occupancy : src->capacity;
   hyper_table::bucket *src_buckets = src->buckets;
@@ -216,16 +418,14 @@ hyper_table::merge_two_hyper_tables(CilkSanImpl_t *__restrict__ tool,
       dst->insert(b);
     } else {
       // Merge the two views in the source and destination buckets, being sure
-      // to preserve left-to-right ordering.  Free the right view when done.
+      // to preserve left-to-right ordering.  Release the right view when done.
       reducer_base dst_rb = dst_bucket->value;
       if (left_dst) {
         dst_rb.reduce_fn(dst_rb.view, b.value.view);
-        free(b.value.view);
-        tool->mark_free(b.value.view);
+        tool->release_reducer_view(b.key, b.value.view);
       } else {
         dst_rb.reduce_fn(b.value.view, dst_rb.view);
-        free(dst_rb.view);
-        tool->mark_free(dst_rb.view);
+        tool->release_reducer_view(b.key, dst_rb.view);
         dst_bucket->value.view = b.value.view;
       }
     }
@@ -24,7 +24,12 @@
 // 2) A back pointer to a previous slab.  Together with the pointer in the
 // header, this back pointer allows for doubly-linked lists of slabs.
 //
-// 3) A bit map identifying used and free MemoryAccess_t arrays in the slab.
+// 3) A count of the used MemoryAccess_t arrays in the slab, along with a hint
+// of the first word of the bit map that might have a free array.  These allow
+// the allocator to check whether a slab is full or empty, and to find a free
+// array in a slab, in constant time.
+//
+// 4) A bit map identifying used and free MemoryAccess_t arrays in the slab.
 // Slabs for different fixed-size arrays of MemoryAccess_t objects have
 // different lengths, since different numbers of such arrays can fit within a
 // single system page.
@@ -79,6 +84,7 @@ template<unsigned Size, uint64_t NumLines>
 struct Slab_t {
   using SlabType = Slab_t<Size, NumLines>;
   using LineType = MemoryAccess_t[Size];
+  static constexpr unsigned LineSize = Size;
   static constexpr int UsedMapSize = (NumLines + 63) / 64;
 
   // Slab header.
@@ -86,6 +92,12 @@ struct Slab_t {
   // Slab back pointer, for creating doubly-linked lists of slabs.
   SlabType *Back = nullptr;
 
+  // Number of used lines in the slab.
+  uint32_t NumUsed = 0;
+  // Index of the first word in UsedMap that might not be full.  All preceding
+  // words are full.
+  uint32_t FreeHint = 0;
+
   // Bit map of used lines.
   uint64_t UsedMap[UsedMapSize] = { 0 };
 
@@ -99,21 +111,20 @@ struct Slab_t {
     // Not all bits in the allocated bit map correspond to lines in the slab.
     // Initialize the slab by setting equal to 1 the bits in the bit map that
     // don't correspond to valid lines in the slab.
-    UsedMap[UsedMapSize-1] |= ~((1UL << (NumLines % 64)) - 1);
+    if (NumLines % 64)
+      UsedMap[UsedMapSize-1] |= ~((1UL << (NumLines % 64)) - 1);
   }
 
   // Returns true if this slab contains no free lines.
-  bool isFull() const {
-    for (int i = 0; i < UsedMapSize; ++i)
-      if (UsedMap[i] != static_cast<uint64_t>(-1))
-        return false;
-    return true;
-  }
+  bool isFull() const { return NumUsed == NumLines; }
+
+  // Returns true if this slab contains no used lines.
+  bool isEmpty() const { return NumUsed == 0; }
 
   // Get a free line from the slab, marking that line as used in the process.
   // Returns nullptr if no free line is available.
   LineType *getFreeLine() __attribute__((malloc)) {
-    for (int i = 0; i < UsedMapSize; ++i) {
+    for (int i = FreeHint; i < UsedMapSize; ++i) {
       if (UsedMap[i] == static_cast<uint64_t>(-1))
         continue;
 
@@ -123,6 +134,8 @@ struct Slab_t {
 
       // Mark the line as used.
       UsedMap[i] |= UsedMap[i] + 1;
+      FreeHint = i;
+      ++NumUsed;
 
       return Line;
     }
@@ -150,6 +163,9 @@ struct Slab_t {
     cilksan_assert(0 != (UsedMap[MapIdx] & (1UL << MapBit)) &&
                    "Line is not marked used.");
     UsedMap[MapIdx] &= ~(1UL << MapBit);
+    if (MapIdx < FreeHint)
+      FreeHint = MapIdx;
+    --NumUsed;
   }
 };
 
@@ -158,7 +174,7 @@ struct Slab_t {
 
 // Slab of MemoryAccess_t[1].
 using Slab1_t =
-    Slab_t<1, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[64])) /
+    Slab_t<1, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[64])) /
                   sizeof(MemoryAccess_t[1])>;
 
 static_assert(sizeof(SlabHead_t<Slab1_t, 1>) == sizeof(uintptr_t),
@@ -173,7 +189,7 @@ static_assert((member_size(Slab1_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[2].
 using Slab2_t =
-    Slab_t<2, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[32])) /
+    Slab_t<2, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[32])) /
                   sizeof(MemoryAccess_t[2])>;
 
 static_assert(sizeof(SlabHead_t<Slab2_t, 2>) == sizeof(uintptr_t),
@@ -188,7 +204,7 @@ static_assert((member_size(Slab2_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[4].
 using Slab4_t =
-    Slab_t<4, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[16])) /
+    Slab_t<4, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[16])) /
                   sizeof(MemoryAccess_t[4])>;
 
 static_assert(sizeof(SlabHead_t<Slab4_t, 4>) == sizeof(uintptr_t),
@@ -203,7 +219,7 @@ static_assert((member_size(Slab4_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[8].
 using Slab8_t =
-    Slab_t<8, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[8])) /
+    Slab_t<8, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[8])) /
                   sizeof(MemoryAccess_t[8])>;
 
 static_assert(sizeof(SlabHead_t<Slab8_t, 8>) == sizeof(uintptr_t),
@@ -218,7 +234,7 @@ static_assert((member_size(Slab8_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[16].
 using Slab16_t =
-    Slab_t<16, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[4])) /
+    Slab_t<16, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[4])) /
                    sizeof(MemoryAccess_t[16])>;
 
 static_assert(sizeof(SlabHead_t<Slab16_t, 16>) == sizeof(uintptr_t),
@@ -233,7 +249,7 @@ static_assert((member_size(Slab16_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[32].
 using Slab32_t =
-    Slab_t<32, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[2])) /
+    Slab_t<32, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[2])) /
                    sizeof(MemoryAccess_t[32])>;
 
 static_assert(sizeof(SlabHead_t<Slab32_t, 32>) == sizeof(uintptr_t),
@@ -248,7 +264,7 @@ static_assert((member_size(Slab32_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[64].
 using Slab64_t =
-    Slab_t<64, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[1])) /
+    Slab_t<64, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[1])) /
                    sizeof(MemoryAccess_t[64])>;
 
 static_assert(sizeof(SlabHead_t<Slab64_t, 64>) == sizeof(uintptr_t),
@@ -263,7 +279,7 @@ static_assert((member_size(Slab64_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[128].
 using Slab128_t =
-    Slab_t<128, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[1])) /
+    Slab_t<128, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[1])) /
                     sizeof(MemoryAccess_t[128])>;
 
 static_assert(sizeof(SlabHead_t<Slab128_t, 128>) == sizeof(uintptr_t),
@@ -278,7 +294,7 @@ static_assert((member_size(Slab128_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[256].
 using Slab256_t =
-    Slab_t<256, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[1])) /
+    Slab_t<256, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[1])) /
                     sizeof(MemoryAccess_t[256])>;
 
 static_assert(sizeof(SlabHead_t<Slab256_t, 256>) == sizeof(uintptr_t),
@@ -293,7 +309,7 @@ static_assert((member_size(Slab256_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[512].
 using Slab512_t =
-    Slab_t<512, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[1])) /
+    Slab_t<512, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[1])) /
                     sizeof(MemoryAccess_t[512])>;
 
 static_assert(sizeof(SlabHead_t<Slab512_t, 512>) == sizeof(uintptr_t),
@@ -308,7 +324,7 @@ static_assert((member_size(Slab512_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[1024].
 using Slab1024_t =
-    Slab_t<1024, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[1])) /
+    Slab_t<1024, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[1])) /
                      sizeof(MemoryAccess_t[1024])>;
 
 static_assert(sizeof(SlabHead_t<Slab1024_t, 1024>) == sizeof(uintptr_t),
@@ -325,7 +341,7 @@ static_assert((member_size(Slab1024_t, UsedMap) * 8) - 64 <
 
 // Slab of MemoryAccess_t[2048].
 using Slab2048_t =
-    Slab_t<2048, (SYS_PAGE_SIZE - sizeof(uintptr_t[2]) - sizeof(uint64_t[1])) /
+    Slab_t<2048, (SYS_PAGE_SIZE - sizeof(uintptr_t[3]) - sizeof(uint64_t[1])) /
                      sizeof(MemoryAccess_t[2048])>;
 
 static_assert(sizeof(SlabHead_t<Slab2048_t, 2048>) == sizeof(uintptr_t),
@@ -385,42 +401,51 @@ class MALineAllocator {
   Slab1024_t *FullMA1024 = nullptr;
   // Slab2048_t *FullMA2048 = nullptr;
 
+public:
+  // Allocation statistics for the slabs of one line size.
+  struct SizeClassStats_t {
+    // Number of slabs allocated from the system.
+    uint64_t SlabsAllocated = 0;
+    // Number of allocated slabs with no used lines.
+    uint64_t FreeSlabs = 0;
+    // Number of lines in use.
+    uint64_t LinesUsed = 0;
+  };
+  // Number of supported line sizes, 1 through 1024.
+  static constexpr unsigned NumSizeClasses = 11;
+
+private:
+  // Statistics for each line size, indexed by the log_2 of the line size.
+  SizeClassStats_t Stats[NumSizeClasses];
+
+  template <typename ST> SizeClassStats_t &getStats() {
+    static_assert(__builtin_ctz(ST::LineSize) < NumSizeClasses,
+                  "Unsupported line size.");
+    return Stats[__builtin_ctz(ST::LineSize)];
+  }
+
+  // Allocate a new, empty slab from the system.
+  template <typename ST> ST *newSlab() {
+    SizeClassStats_t &S = getStats<ST>();
+    ++S.SlabsAllocated;
+    ++S.FreeSlabs;
+    return new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(ST)))) ST;
+  }
+
 public:
   MALineAllocator() {
     // Initialize the allocator with 1 page of each type of line.
-    MA1Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab1_t))))
-            Slab1_t;
-    MA2Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab2_t))))
-            Slab2_t;
-    MA4Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab4_t))))
-            Slab4_t;
-    MA8Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab8_t))))
-            Slab8_t;
-    MA16Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab16_t))))
-            Slab16_t;
-    MA32Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab32_t))))
-            Slab32_t;
-    MA64Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab64_t))))
-            Slab64_t;
-    MA128Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab128_t))))
-            Slab128_t;
-    MA256Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab256_t))))
-            Slab256_t;
-    MA512Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab512_t))))
-            Slab512_t;
-    MA1024Lines =
-        new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab1024_t))))
-            Slab1024_t;
+    MA1Lines = newSlab<Slab1_t>();
+    MA2Lines = newSlab<Slab2_t>();
+    MA4Lines = newSlab<Slab4_t>();
+    MA8Lines = newSlab<Slab8_t>();
+    MA16Lines = newSlab<Slab16_t>();
+    MA32Lines = newSlab<Slab32_t>();
+    MA64Lines = newSlab<Slab64_t>();
+    MA128Lines = newSlab<Slab128_t>();
+    MA256Lines = newSlab<Slab256_t>();
+    MA512Lines = newSlab<Slab512_t>();
+    MA1024Lines = newSlab<Slab1024_t>();
     // MA2048Lines =
     //     new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(Slab2048_t))))
     //         Slab2048_t;
@@ -440,6 +465,11 @@ public:
     List = nullptr;
   }
 
+  // Returns the allocation statistics for lines with 2^LgSize entries.
+  const SizeClassStats_t &getSizeClassStats(unsigned LgSize) const {
+    return Stats[LgSize];
+  }
+
   ~MALineAllocator() {
     cilksan_assert(!FullMA1 && "Full slabs remaining.");
     cilksan_assert(!FullMA2 && "Full slabs remaining.");
@@ -513,6 +543,10 @@ public:
     }
 
     Slab->returnLine(Line);
+    SizeClassStats_t &S = getStats<ST>();
+    --S.LinesUsed;
+    if (Slab->isEmpty())
+      ++S.FreeSlabs;
   }
 
   // Deallocate the line pointed to by Ptr.
@@ -592,12 +626,16 @@ public:
     // TODO: Consider getting a Line from the fullest slab.  We still want this
     // process to be fast in the common case.
     ST *Slab = List;
+    SizeClassStats_t &S = getStats<ST>();
+    if (Slab->isEmpty())
+      --S.FreeSlabs;
     LT *Line = Slab->getFreeLine();
+    ++S.LinesUsed;
 
     // If Slab is now full, move it to the Full list.
     if (Slab->isFull()) {
       if (!Slab->Head.getNext())
-        List = new (my_aligned_alloc(SYS_PAGE_SIZE, PAGE_ALIGNED(sizeof(ST)))) ST;
+        List = newSlab<ST>();
       else {
         Slab->Head.getNext()->Back = nullptr;
         List = Slab->Head.getNext();
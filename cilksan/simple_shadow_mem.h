@@ -3,15 +3,19 @@
 #define __SIMPLE_SHADOW_MEM__
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <inttypes.h>
 #include <sys/mman.h>
 
+#include "alloc_index.h"
 #include "checking.h"
 #include "cilksan_internal.h"
 #include "debug_util.h"
 #include "dictionary.h"
+#include "fast_path.h"
 #include "locksets.h"
+#include "occupancy.h"
 #include "shadow_mem_allocator.h"
 #include "vector.h"
 
@@ -19,7 +23,6 @@ class SimpleShadowMem;
 
 static const unsigned ReadMAAllocator = 0;
 static const unsigned WriteMAAllocator = 1;
-static const unsigned AllocMAAllocator = 2;
 
 // A simple dictionary implementation that uses a two-level table structure.
 // The table structure involves a table of pages, where each page represents a
@@ -116,6 +119,14 @@ private:
       return Chunk_t(nextAddr, size - chunkSize);
     }
 
+    // Get the chunk after this chunk that starts at nextAddr.
+    __attribute__((always_inline)) Chunk_t advance(uintptr_t nextAddr) const {
+      size_t chunkSize = nextAddr - addr;
+      if (chunkSize > size)
+        return Chunk_t(nextAddr, 0);
+      return Chunk_t(nextAddr, size - chunkSize);
+    }
+
     // Returns true if this Chunk_t is entirely contained within the line.
     __attribute__((always_inline)) bool withinLine() const {
       uintptr_t nextLineAddr = alignByNextGrainsize(addr, LG_LINE_SIZE);
@@ -186,6 +197,16 @@ private:
     __attribute__((always_inline)) static void invalidate(MemoryAccess_t &MA) {
       MA.invalidate();
     }
+    // Lines of MemoryAccess_t's may store runs of identical entries compactly.
+    static constexpr bool SupportsRuns = true;
+    // Returns true if MA and That are interchangeable in the shadow memory.
+    // Unlike operator==, this comparison also checks the access ID.
+    __attribute__((always_inline)) static bool
+    isIdentical(const MemoryAccess_t &MA, const MemoryAccess_t &That) {
+      if (!MA.isValid() || !That.isValid())
+        return MA.isValid() == That.isValid();
+      return MA.ver_func == That.ver_func && MA.ver_acc_id == That.ver_acc_id;
+    }
   };
 
   struct MASetFn {
@@ -222,6 +243,95 @@ private:
     // The array of LineData_t objects in this line is allocated lazily.
     LineData_t *DataPtr = nullptr;
 
+    // A line refined below this grainsize, e.g., by an unaligned or odd-sized
+    // access, stores its entries as runs of identical entries, if the
+    // LineData_t supports it.
+    static constexpr unsigned LG_RUN_ENCODE_GRAINSIZE = 3;
+    // Maximum number of runs in a run-encoded line.  A line that needs more
+    // runs is stored as a dense array of byte-granular entries instead.
+    static constexpr unsigned MAX_RUNS = 16;
+    // Value of the grainsize field that marks a run-encoded line.
+    static constexpr uintptr_t RUN_ENCODED = GrainsizeMask;
+    static_assert(RUN_ENCODED > LG_LINE_SIZE,
+                  "Grainsize field cannot mark run-encoded lines.");
+
+    // Runs of identical entries covering the whole line.  Run i covers bytes
+    // [End[i-1], End[i]) of the line, where End[-1] is 0, and invalid entries
+    // form runs like any other.  In a run-encoded line, DataPtr points to a
+    // Runs_t, and the count of non-null elements counts valid bytes.
+    struct Runs_t {
+      unsigned NumRuns = 0;
+      uint16_t End[MAX_RUNS];
+      LineData_t Value[MAX_RUNS];
+
+      // Get the index of the run containing byte.
+      __attribute__((always_inline)) unsigned find(uintptr_t byte) const {
+        unsigned i = 0;
+        while (End[i] <= byte)
+          ++i;
+        return i;
+      }
+      __attribute__((always_inline)) uintptr_t start(unsigned i) const {
+        return i ? End[i - 1] : 0;
+      }
+
+      // Append a run of Val ending at end, extending the last run if it holds
+      // an identical entry.  Returns false if there is no room for a new run.
+      bool append(const LineData_t &Val, uintptr_t end) {
+        if (NumRuns && LineDataMethods::isIdentical(Value[NumRuns - 1], Val)) {
+          End[NumRuns - 1] = end;
+          return true;
+        }
+        if (NumRuns == MAX_RUNS)
+          return false;
+        Value[NumRuns] = Val;
+        End[NumRuns++] = end;
+        return true;
+      }
+
+      // Returns the number of bytes covered by valid entries.
+      unsigned numValidBytes() const {
+        unsigned count = 0;
+        for (unsigned i = 0; i < NumRuns; ++i)
+          if (LineDataMethods::isValid(Value[i]))
+            count += End[i] - start(i);
+        return count;
+      }
+    };
+
+    // Runs_t's are stored in lines from the line allocator, whose line sizes
+    // are powers of 2.  Get the number of LineData_t's in such a line that can
+    // hold a Runs_t.
+    static constexpr size_t numRunsLineEls() {
+      size_t NumEls = 1;
+      while (NumEls * sizeof(LineData_t) < sizeof(Runs_t))
+        NumEls <<= 1;
+      return NumEls;
+    }
+    static_assert(alignof(Runs_t) <= alignof(LineData_t),
+                  "Runs_t cannot be stored in a line of LineData_t's.");
+
+    // Allocate an empty Runs_t from the line allocator.
+    static Runs_t *newRuns() {
+      LineData_t *Storage = LineDataMethods::allocate(numRunsLineEls());
+      // The allocator constructs the entries of the line, which the Runs_t
+      // replaces.
+      for (size_t i = 0; i < numRunsLineEls(); ++i)
+        Storage[i].~LineData_t();
+      return new (Storage) Runs_t;
+    }
+
+    // Return the storage of Runs to the line allocator.
+    static void deleteRuns(Runs_t *Runs) {
+      Runs->~Runs_t();
+      // The allocator destructs the entries of the line it frees, so
+      // reconstruct them first.
+      LineData_t *Storage = reinterpret_cast<LineData_t *>(Runs);
+      for (size_t i = 0; i < numRunsLineEls(); ++i)
+        new (&Storage[i]) LineData_t;
+      LineDataMethods::deallocate(Storage);
+    }
+
     __attribute__((always_inline)) LineData_t *getData() const {
       return reinterpret_cast<LineData_t *>(
           reinterpret_cast<uintptr_t>(DataPtr) & DataMask);
@@ -238,6 +348,12 @@ private:
            ~(GrainsizeMask << LgGrainsizeRShift)) |
           (static_cast<uintptr_t>(newLgGrainsize) << LgGrainsizeRShift));
     }
+    __attribute__((always_inline)) void setNumNonNullEls(uintptr_t count) {
+      DataPtr = reinterpret_cast<LineData_t *>(
+          (reinterpret_cast<uintptr_t>(DataPtr) &
+           ~(NumNonNullMask << NumNonNullElsRShift)) |
+          (count << NumNonNullElsRShift));
+    }
     __attribute__((always_inline)) void scaleNumNonNullEls(int replFactor) {
       DataPtr = reinterpret_cast<LineData_t *>(
           (reinterpret_cast<uintptr_t>(DataPtr) &
@@ -259,15 +375,35 @@ private:
     }
     ~AbstractLine_t() {
       if (isMaterialized()) {
-        LineDataMethods::deallocate(getData());
+        release();
         DataPtr = nullptr;
       }
     }
 
+    // Run-encoded lines behave like lines with byte-granular entries.
     __attribute__((always_inline)) unsigned getLgGrainsize() const {
-      return static_cast<unsigned>(
+      uintptr_t LgGrainsize =
           (reinterpret_cast<uintptr_t>(DataPtr) >> LgGrainsizeRShift) &
-          GrainsizeMask);
+          GrainsizeMask;
+      return (RUN_ENCODED == LgGrainsize) ? 0
+                                          : static_cast<unsigned>(LgGrainsize);
+    }
+
+    // Returns true if this line stores its entries as runs.
+    __attribute__((always_inline)) bool isRunEncoded() const {
+      return RUN_ENCODED ==
+             ((reinterpret_cast<uintptr_t>(DataPtr) >> LgGrainsizeRShift) &
+              GrainsizeMask);
+    }
+
+    // Returns true if this line stores, or upon materialization will store,
+    // its entries as runs.  The entries of such a line must be modified only
+    // through set(), insert(), and clear().
+    __attribute__((always_inline)) bool usesRuns() const {
+      if constexpr (LineDataMethods::SupportsRuns)
+        return isRunEncoded() ||
+               (!isMaterialized() && getLgGrainsize() < LG_RUN_ENCODE_GRAINSIZE);
+      return false;
     }
 
     __attribute__((always_inline)) bool isEmpty() const {
@@ -306,10 +442,123 @@ private:
     // Allocate the array of LineData_t's for this line.
     void materialize() {
       cilksan_assert(!getData() && "Data already materialized.");
+      if constexpr (LineDataMethods::SupportsRuns) {
+        if (getLgGrainsize() < LG_RUN_ENCODE_GRAINSIZE) {
+          // Start with a single run of invalid entries.
+          Runs_t *Runs = newRuns();
+          Runs->append(LineData_t(), LINE_SIZE);
+          setData(reinterpret_cast<LineData_t *>(Runs));
+          setLgGrainsize(RUN_ENCODED);
+          return;
+        }
+      }
       int NumData = (1 << LG_LINE_SIZE) / (1 << getLgGrainsize());
       setData(LineDataMethods::allocate(NumData));
     }
 
+  protected:
+    __attribute__((always_inline)) Runs_t *getRuns() const {
+      return reinterpret_cast<Runs_t *>(getData());
+    }
+
+    // Free the storage for the entries of this line.
+    void release() {
+      if (isRunEncoded())
+        deleteRuns(getRuns());
+      else
+        LineDataMethods::deallocate(getData());
+    }
+
+    // Try to convert the materialized dense array of this line into runs.
+    // Returns false, leaving the line unchanged, if the array has too many
+    // runs.
+    bool encodeRuns() {
+      LineData_t *Data = getData();
+      unsigned LgGrainsize = getLgGrainsize();
+      int NumDataEls = (1 << LG_LINE_SIZE) / (1 << LgGrainsize);
+      unsigned NumRuns = 1;
+      for (int i = 1; i < NumDataEls; ++i)
+        if (!LineDataMethods::isIdentical(Data[i - 1], Data[i]))
+          if (++NumRuns > MAX_RUNS)
+            return false;
+
+      Runs_t *Runs = newRuns();
+      for (int i = 0; i < NumDataEls; ++i)
+        Runs->append(Data[i], (i + 1) << LgGrainsize);
+      unsigned NumValidBytes = getNumNonNullEls() << LgGrainsize;
+      LineDataMethods::deallocate(Data);
+      setData(reinterpret_cast<LineData_t *>(Runs));
+      setLgGrainsize(RUN_ENCODED);
+      setNumNonNullEls(NumValidBytes);
+      return true;
+    }
+
+    // Convert this run-encoded line into a dense array of byte-granular
+    // entries.
+    void decodeRuns() {
+      cilksan_assert(isRunEncoded() && "Decoding line without runs.");
+      Runs_t *Runs = getRuns();
+      LineData_t *NewData = LineDataMethods::allocate(LINE_SIZE);
+      for (unsigned i = 0; i < Runs->NumRuns; ++i)
+        if (LineDataMethods::isValid(Runs->Value[i]))
+          for (uintptr_t j = Runs->start(i); j < Runs->End[i]; ++j)
+            NewData[j] = Runs->Value[i];
+      // The count of valid bytes is also the count of byte-granular entries.
+      deleteRuns(Runs);
+      setData(NewData);
+      setLgGrainsize(0);
+    }
+
+    // Set the bytes [lo, hi) of this run-encoded line to Val, which may be
+    // invalid.  Returns false, leaving the line unchanged, if the result needs
+    // more than MAX_RUNS runs.
+    bool assignRuns(uintptr_t lo, uintptr_t hi, const LineData_t &Val) {
+      const Runs_t *Runs = getRuns();
+      Runs_t NewRuns;
+      unsigned i = 0;
+      // Copy the runs before lo.
+      for (; Runs->End[i] <= lo; ++i)
+        NewRuns.append(Runs->Value[i], Runs->End[i]);
+      // Keep the part of the run containing lo before lo.
+      if (Runs->start(i) < lo)
+        if (!NewRuns.append(Runs->Value[i], lo))
+          return false;
+      if (!NewRuns.append(Val, hi))
+        return false;
+      // Copy the parts of the remaining runs after hi.
+      for (; i < Runs->NumRuns; ++i)
+        if (Runs->End[i] > hi)
+          if (!NewRuns.append(Runs->Value[i], Runs->End[i]))
+            return false;
+
+      Runs_t *Dst = getRuns();
+      Dst->NumRuns = NewRuns.NumRuns;
+      for (unsigned j = 0; j < NewRuns.NumRuns; ++j) {
+        Dst->End[j] = NewRuns.End[j];
+        Dst->Value[j] = NewRuns.Value[j];
+      }
+      // Release the references held by unused runs.
+      for (unsigned j = NewRuns.NumRuns; j < MAX_RUNS; ++j)
+        LineDataMethods::invalidate(Dst->Value[j]);
+      setNumNonNullEls(Dst->numValidBytes());
+      return true;
+    }
+
+    // Get the end, within this line, of the part of Accessed in this line.
+    __attribute__((always_inline)) static uintptr_t
+    endByteInLine(const Chunk_t &Accessed) {
+      uintptr_t End = byte(Accessed.addr) + Accessed.size;
+      return (End > LINE_SIZE) ? LINE_SIZE : End;
+    }
+    // Get the chunk after the part of Accessed that ends at byte end of this
+    // line.
+    __attribute__((always_inline)) static Chunk_t
+    advanceInLine(const Chunk_t &Accessed, uintptr_t end) {
+      return Accessed.advance((Accessed.addr & LINE_MASK) + end);
+    }
+
+  public:
+
     // Reduce the grainsize of this line to newLgGrainsize, which must fall
     // within [0, LgGrainsize].
     void refine(unsigned newLgGrainsize) {
@@ -321,6 +570,12 @@ private:
         return;
       }
 
+      // Store the line as runs, rather than replicating its entries into a
+      // large array, if possible.
+      if constexpr (LineDataMethods::SupportsRuns)
+        if (newLgGrainsize < LG_RUN_ENCODE_GRAINSIZE && encodeRuns())
+          return;
+
       LineData_t *Data = getData();
       // Create a new array of LineData_t's.
       int newNumDataEls = (1 << LG_LINE_SIZE) / (1 << newLgGrainsize);
@@ -353,7 +608,7 @@ private:
     // LineData_t's.
     void reset() {
       if (isMaterialized()) {
-        LineDataMethods::deallocate(getData());
+        release();
         DataPtr = nullptr;
       }
       setLgGrainsize(LG_LINE_SIZE);
@@ -364,19 +619,43 @@ private:
       return byte >> getLgGrainsize();
     }
 
-    // Access the LineData_t object in this line for the byte address.
+    // Access the LineData_t object in this line for the byte address.  In a
+    // run-encoded line, the object is shared by all bytes in its run.
     __attribute__((always_inline)) LineData_t &operator[](uintptr_t byte) {
       cilksan_level_assert(DEBUG_SHADOWMEM,
                            getData() && "Data not materialized");
+      if constexpr (LineDataMethods::SupportsRuns)
+        if (__builtin_expect(isRunEncoded(), false)) {
+          Runs_t *Runs = getRuns();
+          return Runs->Value[Runs->find(byte)];
+        }
       return getData()[getIdx(byte)];
     }
     __attribute__((always_inline)) const LineData_t &
     operator[](uintptr_t byte) const {
       cilksan_level_assert(DEBUG_SHADOWMEM,
                            getData() && "Data not materialized");
+      if constexpr (LineDataMethods::SupportsRuns)
+        if (__builtin_expect(isRunEncoded(), false)) {
+          const Runs_t *Runs = getRuns();
+          return Runs->Value[Runs->find(byte)];
+        }
       return getData()[getIdx(byte)];
     }
 
+    // Get the chunk after Accessed that starts at the next entry in this line.
+    // For a run-encoded line, the next entry starts after the current run.
+    __attribute__((always_inline)) Chunk_t
+    nextEntry(const Chunk_t &Accessed) const {
+      if constexpr (LineDataMethods::SupportsRuns)
+        if (__builtin_expect(isRunEncoded(), false)) {
+          const Runs_t *Runs = getRuns();
+          return advanceInLine(Accessed,
+                               Runs->End[Runs->find(byte(Accessed.addr))]);
+        }
+      return Accessed.next(getLgGrainsize());
+    }
+
     // Set all entries in this line covered by Accessed to be the LineData_t
     // formed by LineDataSetFn.  The func parameter must be valid.
     __attribute__((always_inline)) void set(Chunk_t &Accessed,
@@ -427,6 +706,21 @@ private:
       if (!isMaterialized())
         materialize();
 
+      if constexpr (LineDataMethods::SupportsRuns) {
+        if (__builtin_expect(isRunEncoded(), false)) {
+          // Set the accessed bytes with a single run, if possible.
+          uintptr_t End = endByteInLine(Accessed);
+          LineData_t Val;
+          SetFn(Val);
+          if (assignRuns(byte(Accessed.addr), End, Val)) {
+            Accessed = advanceInLine(Accessed, End);
+            return;
+          }
+          decodeRuns();
+          AccessedLgGrainsize = 0;
+        }
+      }
+
       // Update the accesses in the line, until we find a new non-null Entry.
       LineData_t *Data = getData();
       do {
@@ -446,6 +740,37 @@ private:
       } while (!isLineStart(Accessed));
     }
 
+  protected:
+    // Implementation of insert() for a run-encoded line.  Returns false,
+    // leaving the line and Accessed unchanged, if the line needs too many runs.
+    bool insertRuns(Chunk_t &Accessed, LineDataSetFn SetFn) {
+      const Runs_t *Runs = getRuns();
+      uintptr_t Lo = byte(Accessed.addr);
+      uintptr_t AccEnd = endByteInLine(Accessed);
+      unsigned i = Runs->find(Lo);
+      const LineData_t Previous = Runs->Value[i];
+      bool PrevIsValid = LineDataMethods::isValid(Previous);
+      // Extend the inserted range through subsequent runs that are invalid or
+      // match the previous entry, just as insert() does entry by entry.
+      uintptr_t Hi = Runs->End[i];
+      while (Hi < AccEnd) {
+        const LineData_t &Entry = Runs->Value[++i];
+        if (LineDataMethods::isValid(Entry) && !(PrevIsValid && Previous == Entry))
+          break;
+        Hi = Runs->End[i];
+      }
+      if (Hi > AccEnd)
+        Hi = AccEnd;
+
+      LineData_t Val;
+      SetFn(Val);
+      if (!assignRuns(Lo, Hi, Val))
+        return false;
+      Accessed = advanceInLine(Accessed, Hi);
+      return true;
+    }
+
+  public:
     // Starting from the first address in Accessed, insert the LineData_t formed
     // by LineDataSet into entries in this AbstractLine_t until either the end
     // of this line is reached or a change is detected in the LineData_t object.
@@ -492,6 +817,16 @@ private:
         AccessedLgGrainsize = LgGrainsize;
       }
 
+      if constexpr (LineDataMethods::SupportsRuns) {
+        if (__builtin_expect(isRunEncoded(), false)) {
+          if (insertRuns(Accessed, SetFn))
+            return;
+          decodeRuns();
+          AccessedLgGrainsize = 0;
+          PrevIdx = byte(Accessed.addr);
+        }
+      }
+
       LineData_t *Data = getData();
       const LineData_t Previous = Data[PrevIdx];
       bool PrevIsValid = LineDataMethods::isValid(Previous);
@@ -551,6 +886,23 @@ private:
         return;
       }
 
+      if constexpr (LineDataMethods::SupportsRuns) {
+        if (__builtin_expect(isRunEncoded(), false)) {
+          uintptr_t End = endByteInLine(Accessed);
+          if (assignRuns(byte(Accessed.addr), End, LineData_t())) {
+            if (noNonNullEls()) {
+              // Reset the line to forget about any refinement.
+              Accessed = Accessed.next(LG_LINE_SIZE);
+              reset();
+            } else
+              Accessed = advanceInLine(Accessed, End);
+            return;
+          }
+          decodeRuns();
+          AccessedLgGrainsize = 0;
+        }
+      }
+
       LineData_t *Data = getData();
       do {
         uintptr_t Idx = getIdx(byte(Accessed.addr));
@@ -650,11 +1002,37 @@ private:
       return Chunk_t(nextAddr, Accessed.size - chunkSize);
     }
 
+    // Minimum number of whole occupancy words in an access for setOccupied to
+    // fill those words in bulk.
+    static constexpr size_t MIN_OCCUPANCY_SPAN = 4;
+
     __attribute__((always_inline)) bool
-    setOccupied(Chunk_t &Accessed, Vector_t<uintptr_t> &TouchedWords) {
+    setOccupied(Chunk_t &Accessed, Vector_t<uintptr_t> &TouchedWords,
+                Vector_t<OccupancySpan_t> &TouchedSpans) {
       bool foundUnoccupied = false;
       while (!Accessed.isEmpty()) {
         uintptr_t addr = Accessed.addr;
+        if (isOccupancyWordStart(addr) &&
+            Accessed.size >= MIN_OCCUPANCY_SPAN * OCCUPANCY_WORD_SIZE) {
+          // Fill the whole occupancy words covered by the access, up to the
+          // end of the page, and record them as a single span.
+          uintptr_t word = occupancyWord(addr);
+          size_t numWords = Accessed.size >> LG_OCCUPANCY_WORD_SIZE;
+          if (numWords > OCC_ARR_SIZE - word)
+            numWords = OCC_ARR_SIZE - word;
+          unsigned result = fillOccupancyWords(&occupancy[word], numWords);
+          if (result & OCC_FOUND_EMPTY)
+            TouchedSpans.push_back(OccupancySpan_t{addr, numWords});
+          if (result & OCC_FOUND_UNOCCUPIED)
+            foundUnoccupied = true;
+
+          size_t spanSize = numWords << LG_OCCUPANCY_WORD_SIZE;
+          Accessed = Chunk_t(addr + spanSize, Accessed.size - spanSize);
+          if (isPageStart(Accessed.addr))
+            return foundUnoccupied;
+          continue;
+        }
+
         uint64_t mask;
         if (Accessed.size >= OCCUPANCY_WORD_SIZE)
           mask = (uint64_t)(-1);
@@ -696,6 +1074,10 @@ private:
     __attribute__((always_inline)) void clear(uintptr_t wordAddr) {
       occupancy[occupancyWord(wordAddr)] = 0;
     }
+    void clear(const OccupancySpan_t &span) {
+      memset(&occupancy[occupancyWord(span.addr)], 0,
+             span.numWords * sizeof(uint64_t));
+    }
   };
 
   struct LockerLineMethods {
@@ -714,6 +1096,7 @@ private:
     __attribute__((always_inline)) static void invalidate(LockerList_t &LL) {
       LL.invalidate();
     }
+    static constexpr bool SupportsRuns = false;
   };
 
   struct LockerSetFn {
@@ -800,6 +1183,8 @@ private:
 
   // Vectors to track non-null values in the 2-level occupancy table.
   Vector_t<uintptr_t> TouchedWords;
+  Vector_t<OccupancySpan_t> TouchedSpans;
+  // Indices of all allocated pages in Table.
   Vector_t<uintptr_t> AllocatedPages;
   bool LockerTableUsed = false;
 
@@ -822,6 +1207,7 @@ private:
   template <>
   __attribute__((always_inline)) void setPage<Page_t>(uintptr_t idx,
                                                       Page_t *Page) {
+    AllocatedPages.push_back(idx);
     Table[idx] = Page;
   }
   template <>
@@ -1011,7 +1397,7 @@ public:
         if (Line->isEmpty())
           Accessed = Accessed.next(LG_LINE_SIZE);
         else
-          Accessed = Accessed.next(Line->getLgGrainsize());
+          Accessed = Line->nextEntry(Accessed);
 
         if (Accessed.isEmpty())
           return;
@@ -1146,7 +1532,7 @@ public:
       // Remember the previous Entry.
       const Entry_t Previous = Entry;
       do {
-        Accessed = Accessed.next(Line->getLgGrainsize());
+        Accessed = Line->nextEntry(Accessed);
         if (Accessed.isEmpty())
           return;
 
@@ -1318,9 +1704,6 @@ public:
   // High-level method to set the occupancy of the shadow memory
   __attribute__((always_inline))
   bool setOccupied(uintptr_t addr, size_t mem_size) {
-    assert(AllocIdx != AllocMAAllocator &&
-           "Called setOccupied on Alloc shadow memory");
-
     Chunk_t Accessed(addr, mem_size);
     bool foundUnoccupied = false;
     while (!Accessed.isEmpty()) {
@@ -1328,10 +1711,10 @@ public:
       if (__builtin_expect(!Page, false)) {
         foundUnoccupied = true;
         Page = new Page_t;
-        AllocatedPages.push_back(page(Accessed.addr));
-        Table[page(Accessed.addr)] = Page;
+        setPage<Page_t>(page(Accessed.addr), Page);
       }
-      foundUnoccupied |= Page->setOccupied(Accessed, TouchedWords);
+      foundUnoccupied |=
+          Page->setOccupied(Accessed, TouchedWords, TouchedSpans);
     }
     return foundUnoccupied;
   }
@@ -1340,14 +1723,10 @@ public:
   // small, aligned access.
   __attribute__((always_inline)) bool setOccupiedFast(uintptr_t addr,
                                                       size_t mem_size) {
-    assert(AllocIdx != AllocMAAllocator &&
-           "Called setOccupied on Alloc shadow memory");
-
     Page_t *Page = Table[page(addr)];
     if (__builtin_expect(!Page, false)) {
       Page = new Page_t;
-      AllocatedPages.push_back(page(addr));
-      Table[page(addr)] = Page;
+      setPage<Page_t>(page(addr), Page);
     }
     return Page->setOccupiedFast(addr, mem_size, TouchedWords);
   }
@@ -1357,11 +1736,18 @@ public:
     for (uintptr_t wordAddr : TouchedWords)
       Table[page(wordAddr)]->clear(wordAddr);
     TouchedWords.clear();
+    for (const OccupancySpan_t &span : TouchedSpans)
+      Table[page(span.addr)]->clear(span);
+    TouchedSpans.clear();
   }
 
+  // Returns the number of allocated pages of shadow memory.
+  size_t numAllocatedPages() const { return AllocatedPages.size(); }
+
   // Free pages of shadow memory.
   void freePages() {
     TouchedWords.clear();
+    TouchedSpans.clear();
     for (uintptr_t Addr : AllocatedPages) {
       delete Table[Addr];
       Table[Addr] = nullptr;
@@ -1421,12 +1807,13 @@ public:
 class SimpleShadowMem {
 private:
   CilkSanImpl_t &CilkSanImpl;
-  // The shadow memory involves three dictionaries to separately handle reads,
-  // writes, and allocations.  The template parameter allows each dictionary to
-  // use a different memory allocator.
+  // The shadow memory involves two dictionaries to separately handle reads and
+  // writes.  The template parameter allows each dictionary to use a different
+  // memory allocator.
   SimpleDictionary<ReadMAAllocator> Reads;
   SimpleDictionary<WriteMAAllocator> Writes;
-  SimpleDictionary<AllocMAAllocator> Allocs;
+  // Allocations are tracked separately, as intervals of memory.
+  AllocIndex_t Allocs;
 
   using RLine_t = SimpleDictionary<ReadMAAllocator>::Line_t;
   using WLine_t = SimpleDictionary<WriteMAAllocator>::Line_t;
@@ -1509,6 +1896,21 @@ public:
   __attribute__((always_inline)) void clearOccupied() {
     Reads.clearOccupied();
     Writes.clearOccupied();
+    // Invalidate the fast-path filters of accesses in the strand.
+    fast_filter_new_epoch();
+  }
+
+  // Returns the number of allocated pages of read and write shadow memory.
+  size_t numAllocatedPages() const {
+    return Reads.numAllocatedPages() + Writes.numAllocatedPages();
+  }
+
+  // Discard all read and write shadow memory, by unmapping its pages.  Only
+  // valid when every recorded access is in series with all future accesses.
+  // Allocations and lockers are kept, for reporting future races.
+  void resetAccesses() {
+    freePages();
+    fast_filter_new_epoch();
   }
 
   // Core routine for checking for a determinacy race, using the given
@@ -1521,7 +1923,8 @@ public:
     while (!QI.isEnd()) {
       // Find a previous access
       const MemoryAccess_t *PrevAccess = QI.get();
-      if (PrevAccess && PrevAccess->isValid()) {
+      if (PrevAccess && PrevAccess->isValid() &&
+          !CilkSanImpl.skip_raced_pair(PrevAccess, acc_id, type)) {
         // If the previous access was in parallel, then we have a race
         if (__builtin_expect(previousAccessInParallel(PrevAccess, f), false)) {
           uintptr_t AccAddr = QI.getAddress();
@@ -1642,11 +2045,13 @@ public:
         // If the previous access was in parallel, we have a race.
         if (__builtin_expect(previousAccessInParallel(PrevAccess, f), false)) {
           uintptr_t AccAddr = UI.getAddress();
-          // Report the race
-          CilkSanImpl.report_race(
-              PrevAccess->getLoc(),
-              AccessLoc_t(acc_id, type, CilkSanImpl.get_current_call_stack()),
-              findAllocLoc(AccAddr), AccAddr, WW_RACE);
+          // Report the race, unless this pair of instructions already raced.
+          if (!CilkSanImpl.skip_raced_pair(PrevAccess, acc_id, type))
+            CilkSanImpl.report_race(
+                PrevAccess->getLoc(),
+                AccessLoc_t(acc_id, type,
+                            CilkSanImpl.get_current_call_stack()),
+                findAllocLoc(AccAddr), AccAddr, WW_RACE);
 
           // Get the next location to check
           UI.next();
@@ -1684,9 +2089,10 @@ public:
     RLine_t *__restrict__ read_line =
         Reads.getLineMustExist<RDict::Page_t>(addr, mem_size);
     bool need_update = true;
-    if ((1 << read_line->getLgGrainsize()) != (unsigned)mem_size) {
-      // This access touches more than one entry in the line.  Handle it via the
-      // slow path.
+    if ((1 << read_line->getLgGrainsize()) != (unsigned)mem_size ||
+        read_line->usesRuns()) {
+      // This access touches more than one entry in the line, or the line's
+      // entries are shared by runs of bytes.  Handle it via the slow path.
       update_with_read(acc_id, type, addr, mem_size, f);
       need_update = false;
     }
@@ -1729,7 +2135,8 @@ public:
     if (need_check) {
       // Get the write MemoryAccess_t to query.
       const MemoryAccess_t &write_ma = (*write_line)[Writes.byte(addr)];
-      if (write_ma.isValid()) {
+      if (write_ma.isValid() &&
+          !CilkSanImpl.skip_raced_pair(&write_ma, acc_id, type)) {
         // If the previous access is in parallel, then we have a race
         if (__builtin_expect(previousAccessInParallel(&write_ma, f), false)) {
           // Report the race
@@ -1767,9 +2174,10 @@ public:
     WLine_t *__restrict__ write_line =
         Writes.getLineMustExist<WDict::Page_t>(addr, mem_size);
     bool need_update = true;
-    if ((1 << write_line->getLgGrainsize()) != (unsigned)mem_size) {
-      // This access touches more than one entry in the line.  Handle it via the
-      // slow path.
+    if ((1 << write_line->getLgGrainsize()) != (unsigned)mem_size ||
+        write_line->usesRuns()) {
+      // This access touches more than one entry in the line, or the line's
+      // entries are shared by runs of bytes.  Handle it via the slow path.
       check_and_update_write(acc_id, type, addr, mem_size, f);
       need_update = false;
     }
@@ -1798,11 +2206,13 @@ public:
       } else {
         // Otherwise, check against the existing write.
         if (previousAccessInParallel(write_ma, f)) {
-          // Report the race
-          CilkSanImpl.report_race(
-              write_ma->getLoc(),
-              AccessLoc_t(acc_id, type, CilkSanImpl.get_current_call_stack()),
-              findAllocLoc(addr), addr, WW_RACE);
+          // Report the race, unless this pair of instructions already raced.
+          if (!CilkSanImpl.skip_raced_pair(write_ma, acc_id, type))
+            CilkSanImpl.report_race(
+                write_ma->getLoc(),
+                AccessLoc_t(acc_id, type,
+                            CilkSanImpl.get_current_call_stack()),
+                findAllocLoc(addr), addr, WW_RACE);
         } else {
           // This write access is in series with the previous access, so update
           // the shadow memory.
@@ -1818,7 +2228,8 @@ public:
     if (need_read_check) {
       // Get the read MemoryAccess_t to query.
       const MemoryAccess_t &read_ma = (*read_line)[Reads.byte(addr)];
-      if (__builtin_expect(read_ma.isValid(), true)) {
+      if (__builtin_expect(read_ma.isValid(), true) &&
+          !CilkSanImpl.skip_raced_pair(&read_ma, acc_id, type)) {
         // If the previous access was in parallel, then we have a race
         if (previousAccessInParallel(&read_ma, f)) {
           // Report the race
@@ -1842,7 +2253,8 @@ public:
     while (!QI.isEnd()) {
       // Find a previous access
       const MemoryAccess_t *PrevAccess = QI.get();
-      if (PrevAccess && PrevAccess->isValid()) {
+      if (PrevAccess && PrevAccess->isValid() &&
+          !CilkSanImpl.skip_raced_pair(PrevAccess, acc_id, type)) {
         // If the previous access was in parallel, then we have a race
         if (__builtin_expect(previousAccessInParallel(PrevAccess, f), false)) {
           uintptr_t StartAddr = QI.getAddress();
@@ -1975,13 +2387,18 @@ public:
           // Create a locker update iterator for this range of addresses
           LUITy LUI =
               Writes.getLockerUpdateIterator(StartAddr, EndAddr - StartAddr);
+          // Only check the lockers for a data race if this pair of
+          // instructions has not already raced.
+          bool check_lockers =
+              !CilkSanImpl.skip_raced_pair(PrevAccess, acc_id, type);
           // Check and update the lockers in this range of addresses
           while (!LUI.isEnd()) {
             // Find lockers for previous accesses
             LockerList_t *PrevAccesses = LUI.get();
             // Check for a data race
-            if (!PrevAccesses || !PrevAccesses->isValid() ||
-                dataRaceWithPreviousAccesses(PrevAccesses, f, LS)) {
+            if (check_lockers &&
+                (!PrevAccesses || !PrevAccesses->isValid() ||
+                 dataRaceWithPreviousAccesses(PrevAccesses, f, LS))) {
               // Report the race
               uintptr_t AccAddr = LUI.getAddress();
               CilkSanImpl.report_race(
@@ -2012,6 +2429,8 @@ public:
   __attribute__((always_inline)) void clear(size_t start, size_t size) {
     Reads.clear(start, size);
     Writes.clear(start, size);
+    // The cleared accesses must be recorded again if the strand repeats them.
+    fast_filter_new_epoch();
   }
 
   void record_alloc(size_t start, size_t size, FrameData_t *f,
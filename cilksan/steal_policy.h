@@ -0,0 +1,139 @@
+// -*- C++ -*-
+#ifndef __STEAL_POLICY_H__
+#define __STEAL_POLICY_H__
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Policy for deciding which continuations Cilksan treats as stolen when
+// checking reducers.  A continuation that is treated as stolen gets fresh
+// reducer views, which are later reduced with the views of the preceding
+// strands.  A continuation that is not treated as stolen continues to use the
+// views of the strand that preceded it.
+//
+// The policy is selected with the CILKSAN_STEAL environment variable:
+//
+//   CILKSAN_STEAL=all          Every continuation is stolen (default).
+//   CILKSAN_STEAL=none         No continuation is stolen.
+//   CILKSAN_STEAL=every:K      Every Kth continuation is stolen.
+//   CILKSAN_STEAL=depth:D,...  Only continuations of frames at the given
+//                              depths in the frame stack are stolen.
+//   CILKSAN_STEAL=random:P     Each continuation is stolen with probability
+//                              1/P.  The random seed is taken from
+//                              CILKSAN_STEAL_SEED.
+class StealPolicy_t {
+public:
+  enum class Kind : uint8_t { ALL, NONE, EVERY, DEPTH, RANDOM };
+
+private:
+  // Maximum frame depth that can be selected with the DEPTH policy.
+  static constexpr unsigned MAX_DEPTH = 64;
+
+  Kind kind = Kind::ALL;
+  // Period for the EVERY and RANDOM policies.
+  uint64_t period = 1;
+  // Bitmask of frame depths selected by the DEPTH policy.
+  uint64_t depths = 0;
+  // Number of continuations seen so far.
+  uint64_t contin_count = 0;
+  // State of the pseudorandom number generator for the RANDOM policy.
+  uint64_t rng_state = 0x9e3779b97f4a7c15UL;
+
+  // Simple xorshift64* generator, so that the policy is reproducible from the
+  // seed alone and does not perturb the program's use of rand().
+  uint64_t next_random() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dUL;
+  }
+
+  static bool parse_period(const char *str, uint64_t &result) {
+    char *end;
+    unsigned long val = strtoul(str, &end, 10);
+    if (end == str || *end != '\0' || val == 0)
+      return false;
+    result = val;
+    return true;
+  }
+
+  bool parse_depths(const char *str) {
+    depths = 0;
+    while (*str) {
+      char *end;
+      unsigned long depth = strtoul(str, &end, 10);
+      if (end == str || depth >= MAX_DEPTH)
+        return false;
+      depths |= (1UL << depth);
+      if (*end == ',')
+        ++end;
+      else if (*end != '\0')
+        return false;
+      str = end;
+    }
+    return depths != 0;
+  }
+
+public:
+  // Parse the policy from the environment.  Prints a warning and falls back to
+  // stealing every continuation if the specification is malformed.
+  void init() {
+    const char *e = getenv("CILKSAN_STEAL");
+    if (!e)
+      return;
+
+    bool valid = true;
+    if (0 == strcmp(e, "all")) {
+      kind = Kind::ALL;
+    } else if (0 == strcmp(e, "none")) {
+      kind = Kind::NONE;
+    } else if (0 == strncmp(e, "every:", 6)) {
+      kind = Kind::EVERY;
+      valid = parse_period(e + 6, period);
+    } else if (0 == strncmp(e, "depth:", 6)) {
+      kind = Kind::DEPTH;
+      valid = parse_depths(e + 6);
+    } else if (0 == strncmp(e, "random:", 7)) {
+      kind = Kind::RANDOM;
+      valid = parse_period(e + 7, period);
+      if (const char *s = getenv("CILKSAN_STEAL_SEED")) {
+        uint64_t seed = strtoull(s, nullptr, 10);
+        // Avoid the all-zero state, which xorshift never leaves.
+        if (seed)
+          rng_state = seed;
+      }
+    } else {
+      valid = false;
+    }
+
+    if (!valid) {
+      std::cerr << "Cilksan: ignoring invalid CILKSAN_STEAL=\"" << e
+                << "\"; stealing every continuation.\n";
+      kind = Kind::ALL;
+    }
+  }
+
+  Kind get_kind() const { return kind; }
+
+  // Returns true if the continuation about to begin, in a frame at the given
+  // depth in the frame stack, should be treated as stolen.
+  __attribute__((always_inline)) bool steal(uint32_t depth) {
+    switch (kind) {
+    case Kind::ALL:
+      return true;
+    case Kind::NONE:
+      return false;
+    case Kind::EVERY:
+      return (contin_count++ % period) == 0;
+    case Kind::DEPTH:
+      return depth < MAX_DEPTH && (depths & (1UL << depth));
+    case Kind::RANDOM:
+      return (next_random() % period) == 0;
+    }
+    return true;
+  }
+};
+
+#endif // __STEAL_POLICY_H__
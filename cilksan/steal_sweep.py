@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Run a Cilksan-instrumented program under several steal-simulation policies.
+
+Treating every continuation as stolen gives Cilksan the most thorough check of
+reducer code, but it creates, reduces and frees reducer views at nearly every
+continuation.  This script runs a program under a handful of cheaper policies,
+selected with CILKSAN_STEAL, so that together the runs exercise many different
+steal patterns at a fraction of the cost.
+
+Usage:
+  steal_sweep.py [--policy SPEC]... [--seeds N] -- PROGRAM [ARGS...]
+
+By default the sweep runs CILKSAN_STEAL=every:2, every:3, depth:1, depth:2 and
+random:4 with seeds 1..N.  The script prints the number of distinct races each
+run found and exits with status 1 if any run found a race or failed to produce a
+Cilksan report.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import time
+
+DEFAULT_POLICIES = ["every:2", "every:3", "depth:1", "depth:2"]
+RACE_COUNT_RE = re.compile(r"Cilksan detected (\d+) distinct races")
+
+
+def run_policy(cmd, policy, seed=None):
+    env = dict(os.environ)
+    env["CILKSAN_STEAL"] = policy
+    if seed is not None:
+        env["CILKSAN_STEAL_SEED"] = str(seed)
+    start = time.time()
+    proc = subprocess.run(cmd, env=env, stdout=subprocess.DEVNULL,
+                          stderr=subprocess.PIPE, universal_newlines=True)
+    elapsed = time.time() - start
+    match = RACE_COUNT_RE.search(proc.stderr)
+    races = int(match.group(1)) if match else None
+    return races, elapsed, proc.returncode, proc.stderr
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run a Cilksan program under several steal policies.")
+    parser.add_argument("--policy", action="append", default=None,
+                        help="CILKSAN_STEAL specification to run (repeatable)")
+    parser.add_argument("--seeds", type=int, default=2,
+                        help="number of seeds for the random policy")
+    parser.add_argument("--random-period", type=int, default=4,
+                        help="steal each continuation with probability 1/P")
+    parser.add_argument("--verbose", action="store_true",
+                        help="print Cilksan output of runs that find races")
+    parser.add_argument("command", nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    cmd = args.command
+    if cmd and cmd[0] == "--":
+        cmd = cmd[1:]
+    if not cmd:
+        parser.error("no program to run")
+
+    runs = [(p, None) for p in (args.policy or DEFAULT_POLICIES)]
+    if args.policy is None:
+        runs += [("random:%d" % args.random_period, seed)
+                 for seed in range(1, args.seeds + 1)]
+
+    failed = False
+    for policy, seed in runs:
+        races, elapsed, rc, output = run_policy(cmd, policy, seed)
+        label = policy if seed is None else "%s seed=%d" % (policy, seed)
+        if races is None:
+            print("%-24s no Cilksan report (exit status %d)" % (label, rc))
+            failed = True
+            continue
+        print("%-24s %d races, %.2fs" % (label, races, elapsed))
+        if races:
+            failed = True
+            if args.verbose:
+                sys.stdout.write(output)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,219 @@
+// -*- C++ -*-
+#ifndef _STRAND_SAMPLER_H
+#define _STRAND_SAMPLER_H
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "csan.h"
+
+// Chooses which strands Cilksan checks when running in strand-sampling mode,
+// and accounts for the coverage of the sampled strands across runs.
+//
+// Each strand is identified by the program site that starts it, e.g., a spawn
+// or a sync, together with its frame depth and, for parallel-loop iterations,
+// its iteration number.  A strand is sampled if a seeded hash of this
+// identifier falls below the sampling rate, so a run with a given seed always
+// samples the same strands.
+//
+// A race between two strands can only be found if both strands are sampled.
+// Coverage is therefore measured over pairs of strands that may run in
+// parallel, which are approximated by the pairs of strands started in the same
+// parallel region, i.e., between two consecutive points where the whole
+// program is synced.  At the end of each region, the sampler counts, for each
+// pair of sites, the pairs of strands from those sites and the pairs of which
+// both strands were sampled.  A site pair is covered once some pair of its
+// strands was checked.  Covered site pairs are accumulated across runs, e.g.,
+// runs with different seeds, in a coverage file.
+class StrandSampler_t {
+public:
+  // Kinds of sites that start a strand.
+  enum SiteKind_t : uint8_t {
+    TASK_SITE = 1,
+    CONTINUE_SITE,
+    SYNC_SITE,
+    LOOP_ITER_SITE,
+    LOOP_EXIT_SITE,
+  };
+
+  // Encode a site of the given kind with the given CSI ID.
+  static uint64_t site(SiteKind_t kind, csi_id_t id) {
+    return ((uint64_t)kind << 56) | ((uint64_t)id & ((1UL << 56) - 1));
+  }
+
+private:
+  // Strands are sampled if the top 53 bits of their hash are below threshold.
+  static constexpr uint64_t ALL = 1UL << 53;
+  uint64_t threshold = ALL;
+  uint64_t seed = 0;
+  bool tracking = false;
+  std::string coverage_file;
+
+  // Number of strands started at each site, and number of those sampled.
+  struct SiteCounts_t {
+    uint64_t started = 0;
+    uint64_t sampled = 0;
+  };
+  // Counts for the whole run and for the current parallel region.
+  std::unordered_map<uint64_t, SiteCounts_t> sites;
+  std::unordered_map<uint64_t, SiteCounts_t> region_sites;
+
+  // Number of pairs of strands started in the same region, and the number of
+  // those pairs whose strands were both sampled.
+  uint64_t strand_pairs = 0;
+  uint64_t checked_strand_pairs = 0;
+
+  // Site pairs whose strands shared a region, and site pairs covered, in this
+  // run or in previous runs loaded from the coverage file.
+  struct PairHash_t {
+    size_t operator()(const std::pair<uint64_t, uint64_t> &p) const {
+      return std::hash<uint64_t>()(p.first * 0x9e3779b97f4a7c15UL ^ p.second);
+    }
+  };
+  std::unordered_set<uint64_t> known_sites;
+  std::unordered_set<std::pair<uint64_t, uint64_t>, PairHash_t> seen;
+  std::unordered_set<std::pair<uint64_t, uint64_t>, PairHash_t> covered;
+
+  static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9UL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebUL;
+    x ^= x >> 31;
+    return x;
+  }
+
+  static std::pair<uint64_t, uint64_t> make_pair(uint64_t a, uint64_t b) {
+    return (a < b) ? std::make_pair(a, b) : std::make_pair(b, a);
+  }
+
+  // Account for the pairs of strands from sites a and b in the current region,
+  // given the number of pairs and the number of checked pairs.
+  void add_pairs(uint64_t a, uint64_t b, uint64_t pairs, uint64_t checked) {
+    if (!pairs)
+      return;
+    strand_pairs += pairs;
+    checked_strand_pairs += checked;
+    seen.insert(make_pair(a, b));
+    if (checked)
+      covered.insert(make_pair(a, b));
+  }
+
+public:
+  // Set the fraction of strands to check, in [0, 1], and the seed.
+  void set_rate(double rate, uint64_t seed_) {
+    seed = seed_;
+    if (!(rate > 0.0))
+      threshold = 0;
+    else if (rate >= 1.0)
+      threshold = ALL;
+    else
+      threshold = (uint64_t)(rate * (double)ALL);
+    tracking = true;
+  }
+
+  // Accumulate coverage in the given file, loading the coverage of previous
+  // runs from it.
+  void set_coverage_file(const char *path) {
+    coverage_file = path;
+    tracking = true;
+    std::ifstream in(coverage_file);
+    std::string tag;
+    while (in >> tag) {
+      uint64_t a, b;
+      if (tag == "site") {
+        if (in >> a)
+          known_sites.insert(a);
+      } else if (tag == "seen") {
+        if (in >> a >> b)
+          seen.insert(make_pair(a, b));
+      } else if (tag == "pair") {
+        if (in >> a >> b)
+          covered.insert(make_pair(a, b));
+      }
+    }
+  }
+
+  // Returns true if strands are sampled or coverage is recorded.
+  bool enabled() const { return tracking; }
+
+  // Decide whether to check the strand started by site at the given frame depth
+  // and loop iteration.
+  bool sample(uint64_t site, uint64_t depth, uint64_t iteration) {
+    uint64_t h = mix(seed ^ mix(site ^ mix(depth ^ mix(iteration))));
+    bool sampled = (h >> 11) < threshold;
+    SiteCounts_t &counts = sites[site];
+    SiteCounts_t &region_counts = region_sites[site];
+    ++counts.started;
+    ++region_counts.started;
+    if (sampled) {
+      ++counts.sampled;
+      ++region_counts.sampled;
+    }
+    return sampled;
+  }
+
+  // End the current parallel region, at a point where the whole program is
+  // synced.
+  void end_region() {
+    if (region_sites.empty())
+      return;
+    std::vector<std::pair<uint64_t, SiteCounts_t>> region(region_sites.begin(),
+                                                          region_sites.end());
+    region_sites.clear();
+    for (size_t i = 0; i < region.size(); ++i) {
+      const SiteCounts_t &ci = region[i].second;
+      add_pairs(region[i].first, region[i].first,
+                ci.started * (ci.started - 1) / 2,
+                ci.sampled * (ci.sampled - 1) / 2);
+      for (size_t j = i + 1; j < region.size(); ++j) {
+        const SiteCounts_t &cj = region[j].second;
+        add_pairs(region[i].first, region[j].first, ci.started * cj.started,
+                  ci.sampled * cj.sampled);
+      }
+    }
+  }
+
+  // Merge the coverage of this run into the coverage file, if any, and print a
+  // summary of the sampled strands and the coverage.
+  void finish() {
+    if (!tracking)
+      return;
+    end_region();
+
+    uint64_t started = 0, sampled = 0;
+    for (const auto &entry : sites) {
+      started += entry.second.started;
+      sampled += entry.second.sampled;
+      known_sites.insert(entry.first);
+    }
+
+    std::cerr << "Cilksan checked " << sampled << " of " << started
+              << " strands; site-pair coverage " << covered.size() << " of "
+              << seen.size() << "; strand-pair coverage "
+              << checked_strand_pairs << " of " << strand_pairs << ".\n";
+
+    if (coverage_file.empty())
+      return;
+    std::ofstream out(coverage_file, std::ios::trunc);
+    if (!out) {
+      std::cerr << "Cilksan: cannot write coverage file '" << coverage_file
+                << "'.\n";
+      return;
+    }
+    for (uint64_t s : known_sites)
+      out << "site " << s << "\n";
+    for (const auto &p : seen)
+      out << "seen " << p.first << " " << p.second << "\n";
+    for (const auto &p : covered)
+      out << "pair " << p.first << " " << p.second << "\n";
+  }
+};
+
+#endif // _STRAND_SAMPLER_H
@@ -0,0 +1,67 @@
+// -*- C++ -*-
+#ifndef _WATCH_RANGES_H
+#define _WATCH_RANGES_H
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+
+// Set of address ranges that Cilksan checks for races.  The set is stored as
+// disjoint intervals [start, end), keyed by their starts.  An empty set means
+// that all of memory is watched.
+class WatchRanges_t {
+  using Map_t = std::map<uintptr_t, uintptr_t>;
+  Map_t Ranges;
+
+public:
+  // Returns true if no ranges have been registered.
+  bool empty() const { return Ranges.empty(); }
+
+  // Returns the number of disjoint ranges in the set.
+  size_t size() const { return Ranges.size(); }
+
+  // Add the range [start, start + size) to the set, merging it with any
+  // overlapping or adjacent ranges.
+  void add(uintptr_t start, size_t size) {
+    if (0 == size)
+      return;
+    uintptr_t end = start + size;
+    Map_t::iterator It = Ranges.upper_bound(start);
+    if (It != Ranges.begin()) {
+      Map_t::iterator Prev = std::prev(It);
+      if (Prev->second >= start) {
+        // Extend the preceding range.
+        start = Prev->first;
+        if (Prev->second > end)
+          end = Prev->second;
+        It = Ranges.erase(Prev);
+      }
+    }
+    // Absorb ranges that start within or just after the new range.
+    while (It != Ranges.end() && It->first <= end) {
+      if (It->second > end)
+        end = It->second;
+      It = Ranges.erase(It);
+    }
+    Ranges.emplace_hint(It, start, end);
+  }
+
+  // Call fn(start, size) on each part of [addr, addr + size) that lies within
+  // a watched range, in increasing order of address.
+  template <typename FnT>
+  void for_each_overlap(uintptr_t addr, size_t size, FnT fn) const {
+    uintptr_t end = addr + size;
+    Map_t::const_iterator It = Ranges.upper_bound(addr);
+    if (It != Ranges.begin())
+      --It;
+    for (; It != Ranges.end() && It->first < end; ++It) {
+      if (It->second <= addr)
+        continue;
+      uintptr_t lo = (It->first > addr) ? It->first : addr;
+      uintptr_t hi = (It->second < end) ? It->second : end;
+      fn(lo, hi - lo);
+    }
+  }
+};
+
+#endif // _WATCH_RANGES_H
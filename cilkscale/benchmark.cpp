@@ -1,4 +1,5 @@
 #include <cassert>
+#include <cinttypes>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -11,12 +12,21 @@
 #endif
 
 #include "cilkscale_timer.h"
+#include "timeline_trace.h"
+#include "wsp_stats.h"
 #include <csi/csi.h>
 #include <iostream>
 #include <fstream>
 
 #define CILKTOOL_API extern "C" __attribute__((visibility("default")))
 
+// The bitcode build of cilkscale-benchmark contains only the CSI hooks, which
+// the compiler links into the instrumented program so that it can inline them.
+// The hooks operate on the tool defined in the cilkscale-benchmark library.
+#ifndef CILKSCALE_BITCODE
+#define CILKSCALE_BITCODE 0
+#endif
+
 #ifndef SERIAL_TOOL
 #define SERIAL_TOOL 1
 #endif
@@ -80,6 +90,23 @@ public:
   out_reducer *outf_red = nullptr;
 #endif
 
+  // Per-worker timeline of strands, recorded if CILKSCALE_TRACE names an
+  // output file.
+  TimelineTrace_t trace;
+  const char *trace_path = nullptr;
+  bool trace_binary = false;
+
+  void record_trace_event(TraceEventKind_t kind, csi_id_t id) {
+    cilkscale_timer_t now;
+    now.gettime();
+    trace.record(__cilkrts_get_worker_number(), kind, id,
+                 cilk_time_t(elapsed_time(&now, &start)).get_raw_duration());
+  }
+  void write_trace();
+
+  // Statistics on tagged measurements, for queries by the program.
+  WspStats_t wsp_stats;
+
   std::basic_ostream<char> *out_view() {
 #if !SERIAL_TOOL
     // TODO: The compiler does not correctly bind the hyperobject
@@ -99,7 +126,12 @@ public:
 
 #pragma clang diagnostic pop
 
-// Top-level benchmarking tool.
+// Top-level benchmarking tool.  The tool is visible outside the
+// cilkscale-benchmark library, for the hooks in the bitcode build.
+namespace cilkscale_benchmark {
+#if CILKSCALE_BITCODE
+extern __attribute__((visibility("default"))) BenchmarkImpl_t *tool;
+#else
 static BenchmarkImpl_t *create_tool(void) {
   if (!__cilkrts_is_initialized())
     // If the OpenCilk runtime is not yet initialized, then csi_init will
@@ -111,8 +143,13 @@ static BenchmarkImpl_t *create_tool(void) {
   // create the tool.
   return new BenchmarkImpl_t();
 }
-static BenchmarkImpl_t *tool = create_tool();
+__attribute__((visibility("default"))) BenchmarkImpl_t *tool = create_tool();
+#endif // CILKSCALE_BITCODE
+} // namespace cilkscale_benchmark
+
+using cilkscale_benchmark::tool;
 
+#if !CILKSCALE_BITCODE
 static bool TOOL_INITIALIZED = false;
 
 ///////////////////////////////////////////////////////////////////////////
@@ -168,12 +205,38 @@ BenchmarkImpl_t::BenchmarkImpl_t() {
      &cilk::ostream_view<char, std::char_traits<char>>::reduce);
 #endif
 
+  trace_path = getenv("CILKSCALE_TRACE");
+  if (trace_path) {
+    const char *format = getenv("CILKSCALE_TRACE_FORMAT");
+    trace_binary = format && 0 == strcmp(format, "binary");
+    trace.init(__cilkrts_get_nworkers());
+  }
+
   start.gettime();
 }
 
+void BenchmarkImpl_t::write_trace() {
+  bool success = trace_binary ? trace.write_binary(trace_path)
+                              : trace.write_chrome_json(trace_path);
+  if (!success)
+    fprintf(stderr, "Cilkscale: cannot write trace to %s\n", trace_path);
+  if (trace.num_dropped_nonworker())
+    fprintf(stderr,
+            "Cilkscale: dropped %" PRIu64 " trace events from non-worker "
+            "threads\n",
+            trace.num_dropped_nonworker());
+  if (trace.num_dropped_overflow())
+    fprintf(stderr,
+            "Cilkscale: dropped %" PRIu64 " trace events that did not fit in "
+            "the trace buffers; set CILKSCALE_TRACE_EVENTS to record more\n",
+            trace.num_dropped_overflow());
+}
+
 BenchmarkImpl_t::~BenchmarkImpl_t() {
   stop.gettime();
   print_analysis();
+  if (trace.enabled())
+    write_trace();
   
   if (outf.is_open())
     outf.close();
@@ -223,7 +286,57 @@ CILKTOOL_API void __csi_unit_init(const char *const file_name,
                                   const instrumentation_counts_t counts) {
   return;
 }
+#endif // !CILKSCALE_BITCODE
+
+///////////////////////////////////////////////////////////////////////////
+// Hooks for timeline tracing.  These hooks do nothing unless CILKSCALE_TRACE
+// is set.
+
+static inline bool tracing() { return tool && tool->trace.enabled(); }
+
+CILKTOOL_API
+void __csi_detach(const csi_id_t detach_id, const unsigned sync_reg,
+                  const detach_prop_t prop) {
+  if (tracing())
+    tool->record_trace_event(TraceEventKind_t::DETACH, detach_id);
+}
+
+CILKTOOL_API
+void __csi_task(const csi_id_t task_id, const csi_id_t detach_id,
+                const task_prop_t prop) {
+  if (tracing())
+    tool->record_trace_event(TraceEventKind_t::TASK, detach_id);
+}
+
+CILKTOOL_API
+void __csi_task_exit(const csi_id_t task_exit_id, const csi_id_t task_id,
+                     const csi_id_t detach_id, const unsigned sync_reg,
+                     const task_exit_prop_t prop) {
+  if (tracing())
+    tool->record_trace_event(TraceEventKind_t::TASK_EXIT, detach_id);
+}
+
+CILKTOOL_API
+void __csi_detach_continue(const csi_id_t detach_continue_id,
+                           const csi_id_t detach_id, const unsigned sync_reg,
+                           const detach_continue_prop_t prop) {
+  if (tracing())
+    tool->record_trace_event(TraceEventKind_t::CONTINUE, detach_id);
+}
+
+CILKTOOL_API
+void __csi_before_sync(const csi_id_t sync_id, const unsigned sync_reg) {
+  if (tracing())
+    tool->record_trace_event(TraceEventKind_t::BEFORE_SYNC, sync_id);
+}
+
+CILKTOOL_API
+void __csi_after_sync(const csi_id_t sync_id, const unsigned sync_reg) {
+  if (tracing())
+    tool->record_trace_event(TraceEventKind_t::AFTER_SYNC, sync_id);
+}
 
+#if !CILKSCALE_BITCODE
 ///////////////////////////////////////////////////////////////////////////
 // Probes and associated routines
 
@@ -276,4 +389,24 @@ CILKTOOL_API void wsp_dump(wsp_t wsp, const char *tag) {
   std::basic_ostream<char> &output = *tool->out_view();
   ensure_header(output);
   print_results(output, tag, cilk_time_t(wsp.work));
+  tool->wsp_stats.record(wsp, tag, __builtin_return_address(0));
+}
+
+CILKTOOL_API void wsp_record(wsp_t wsp, const char *tag) {
+  if (tool)
+    tool->wsp_stats.record(wsp, tag, __builtin_return_address(0));
+}
+
+CILKTOOL_API int wsp_tag_stats(const char *tag, wsp_stats_t *stats) {
+  return tool && tool->wsp_stats.get_tag(tag, stats);
+}
+
+CILKTOOL_API uint64_t wsp_site_stats(wsp_stats_t *stats, uint64_t max_stats) {
+  return tool ? tool->wsp_stats.get_sites(stats, max_stats) : 0;
+}
+
+CILKTOOL_API void wsp_reset_stats(void) {
+  if (tool)
+    tool->wsp_stats.reset();
 }
+#endif // !CILKSCALE_BITCODE
@@ -5,6 +5,10 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <pthread.h>
+#ifndef __STDC_NO_THREADS__
+#include <threads.h>
+#endif // __STDC_NO_THREADS__
 
 // Ensure that __cilkscale__ is defined, so we can provide a nontrivial
 // definition of getworkspan().
@@ -12,7 +16,11 @@
 #define __cilkscale__
 #endif
 
+#include "lock_stats.h"
 #include "shadow_stack.h"
+#include "site_profile.h"
+#include "span_sampler.h"
+#include "wsp_stats.h"
 #include <cilk/cilk_api.h>
 #include <csi/csi.h>
 #include <iostream>
@@ -20,6 +28,14 @@
 
 #define CILKTOOL_API extern "C" __attribute__((visibility("default")))
 
+// The bitcode build of Cilkscale contains only the CSI hooks that maintain the
+// shadow stack.  The compiler links this bitcode into the instrumented program,
+// so that it can inline these hooks.  The hooks operate on the tool defined in
+// the Cilkscale library.
+#ifndef CILKSCALE_BITCODE
+#define CILKSCALE_BITCODE 0
+#endif
+
 #ifndef SERIAL_TOOL
 #define SERIAL_TOOL 1
 #endif
@@ -29,7 +45,9 @@
 #endif
 
 #if SERIAL_TOOL
+#if !CILKSCALE_BITCODE
 FILE *err_io = stderr;
+#endif
 #else
 #include <cilk/cilk_api.h>
 #include <cilk/ostream_reducer.h>
@@ -65,6 +83,27 @@ public:
   out_reducer *outf_red = nullptr;
 #endif
 
+  // Per-spawn-site work, recorded if CILKSCALE_SITE_PROFILE or
+  // CILKSCALE_SITE_BASELINE is set.
+  SiteProfile_t site_profile;
+  const char *site_profile_path = nullptr;
+  const char *site_baseline_path = nullptr;
+  unsigned site_report_top = 10;
+
+  void report_site_profile();
+
+  // Acquire counts, wait times, and hold times of mutexes, recorded and
+  // printed only if CILKSCALE_LOCK_STATS is set.
+  LockStats_t *lock_stats = nullptr;
+
+  // Statistics on tagged measurements, for queries by the program.
+  WspStats_t wsp_stats;
+
+  // Sampling profiler for the span profile, enabled if CILKSCALE_SAMPLE_PERIOD
+  // is set.
+  SpanSampler_t span_sampler;
+  unsigned span_report_top = 20;
+
   std::basic_ostream<char> *out_view() {
 #if !SERIAL_TOOL
     // TODO: The compiler does not correctly bind the hyperobject
@@ -82,7 +121,13 @@ public:
   ~CilkscaleImpl_t();
 };
 
-// Top-level Cilkscale tool.
+// Top-level Cilkscale tool.  The tool and its initialization flag are visible
+// outside the Cilkscale library, for the hooks in the bitcode build.
+namespace cilkscale {
+#if CILKSCALE_BITCODE
+extern __attribute__((visibility("default"))) CilkscaleImpl_t *tool;
+extern __attribute__((visibility("default"))) bool CILKSCALE_INITIALIZED;
+#else
 static CilkscaleImpl_t *create_tool(void) {
   if (!__cilkrts_is_initialized())
     // If the OpenCilk runtime is not yet initialized, then csi_init will
@@ -94,9 +139,29 @@ static CilkscaleImpl_t *create_tool(void) {
   // create the tool.
   return new CilkscaleImpl_t();
 }
-static CilkscaleImpl_t *tool = create_tool();
+__attribute__((visibility("default"))) CilkscaleImpl_t *tool = create_tool();
+
+__attribute__((visibility("default"))) bool CILKSCALE_INITIALIZED = false;
+#endif // CILKSCALE_BITCODE
+} // namespace cilkscale
 
-bool CILKSCALE_INITIALIZED = false;
+using cilkscale::tool;
+using cilkscale::CILKSCALE_INITIALIZED;
+
+// Append the profiling samples taken during the strand that just ended to the
+// path of samples of frame.
+static inline void drain_samples(shadow_stack_frame_t &frame) {
+  if (tool->span_sampler.enabled())
+    frame.contin_samples = tool->span_sampler.drain(frame.contin_samples);
+}
+
+// Drop the profiling samples taken since the end of the last strand.
+static inline void discard_samples(void) {
+  if (tool->span_sampler.enabled())
+    tool->span_sampler.discard();
+}
+
+#if !CILKSCALE_BITCODE
 
 ///////////////////////////////////////////////////////////////////////////
 // Utilities for printing analysis results
@@ -190,20 +255,67 @@ CilkscaleImpl_t::CilkscaleImpl_t() {
       &cilk::ostream_view<char, std::char_traits<char>>::reduce);
 #endif
 
+  site_profile_path = getenv("CILKSCALE_SITE_PROFILE");
+  site_baseline_path = getenv("CILKSCALE_SITE_BASELINE");
+  if (site_profile_path || site_baseline_path) {
+    site_profile.init(__cilkrts_get_nworkers());
+    if (const char *e = getenv("CILKSCALE_SITE_TOP"))
+      site_report_top = atoi(e);
+  }
+
+  if (const char *e = getenv("CILKSCALE_LOCK_STATS"))
+    if (0 != strcmp(e, "0"))
+      lock_stats = new LockStats_t();
+
+  if (const char *e = getenv("CILKSCALE_SAMPLE_PERIOD")) {
+    int period = atoi(e);
+    if (const char *top = getenv("CILKSCALE_SAMPLE_TOP"))
+      span_report_top = atoi(top);
+    if (period > 0 && !span_sampler.start(__cilkrts_get_nworkers(), period))
+      fprintf(stderr, "Cilkscale: cannot start the sampling profiler\n");
+  }
+
   shadow_stack->push(frame_type::SPAWNER);
   shadow_stack->start.gettime();
 }
 
+// Save the per-site work profile of this run and report the work inflation of
+// this run relative to the baseline profile.
+void CilkscaleImpl_t::report_site_profile() {
+  if (site_profile_path && !site_profile.save(site_profile_path))
+    fprintf(stderr, "Cilkscale: cannot write site profile to %s\n",
+            site_profile_path);
+  if (site_baseline_path) {
+    std::cerr << "Work inflation relative to " << site_baseline_path << ":\n";
+    if (!site_profile.report_inflation(site_baseline_path, site_report_top,
+                                       std::cerr))
+      fprintf(stderr, "Cilkscale: cannot read site profile %s\n",
+              site_baseline_path);
+  }
+}
+
 CilkscaleImpl_t::~CilkscaleImpl_t() {
   tool->shadow_stack->stop.gettime();
+  span_sampler.stop();
   shadow_stack_frame_t &bottom = tool->shadow_stack->peek_bot();
 
   duration_t strand_time = tool->shadow_stack->elapsed_time();
   bottom.contin_work += strand_time;
   bottom.contin_span += strand_time;
   bottom.contin_bspan += strand_time;
+  drain_samples(bottom);
 
   print_analysis();
+  if (span_sampler.enabled())
+    span_sampler.report(std::cerr, bottom.contin_samples, span_report_top);
+  if (site_profile.enabled())
+    report_site_profile();
+  if (lock_stats) {
+    std::cerr << "Mutex statistics:\n";
+    lock_stats->print(std::cerr, bottom.contin_work);
+    delete lock_stats;
+    lock_stats = nullptr;
+  }
 
   if (outf.is_open())
     outf.close();
@@ -262,6 +374,7 @@ CILKTOOL_API void __csi_unit_init(const char *const file_name,
                                   const instrumentation_counts_t counts) {
   return;
 }
+#endif // !CILKSCALE_BITCODE
 
 CILKTOOL_API
 void __csi_bb_entry(const csi_id_t bb_id, const bb_prop_t prop) {
@@ -302,6 +415,7 @@ void __csi_func_entry(const csi_id_t func_id, const func_prop_t prop) {
   cilk_time_t p_contin_work = p_bottom.contin_work;
   cilk_time_t p_contin_span = p_bottom.contin_span;
   cilk_time_t p_contin_bspan = p_bottom.contin_bspan;
+  const SpanSample_t *p_contin_samples = p_bottom.contin_samples;
 
   // Push new frame onto the stack
   shadow_stack_frame_t &c_bottom =
@@ -309,6 +423,7 @@ void __csi_func_entry(const csi_id_t func_id, const func_prop_t prop) {
   c_bottom.contin_work = p_contin_work;
   c_bottom.contin_span = p_contin_span;
   c_bottom.contin_bspan = p_contin_bspan;
+  c_bottom.contin_samples = p_contin_samples;
 
   // stack.start.gettime();
   // Because of the high overhead of calling gettime(), especially compared to
@@ -344,6 +459,8 @@ void __csi_func_exit(const csi_id_t func_exit_id, const csi_id_t func_id,
   p_bottom.contin_work = c_bottom.contin_work + strand_time;
   p_bottom.contin_span = c_bottom.contin_span + strand_time;
   p_bottom.contin_bspan = c_bottom.contin_bspan + strand_time;
+  p_bottom.contin_samples = c_bottom.contin_samples;
+  drain_samples(p_bottom);
 
   // stack.start.gettime();
   // Because of the high overhead of calling gettime(), especially compared to
@@ -369,6 +486,7 @@ void __csi_detach(const csi_id_t detach_id, const unsigned sync_reg,
   bottom.contin_work += strand_time;
   bottom.contin_span += strand_time;
   bottom.contin_bspan += strand_time;
+  drain_samples(bottom);
 }
 
 CILKTOOL_API
@@ -383,13 +501,16 @@ void __csi_task(const csi_id_t task_id, const csi_id_t detach_id,
   cilk_time_t p_contin_work = p_bottom.contin_work;
   cilk_time_t p_contin_span = p_bottom.contin_span;
   cilk_time_t p_contin_bspan = p_bottom.contin_bspan;
+  const SpanSample_t *p_contin_samples = p_bottom.contin_samples;
 
   // Push new frame onto the stack.
   shadow_stack_frame_t &c_bottom = tool->shadow_stack->push(frame_type::HELPER);
   c_bottom.contin_work = p_contin_work;
   c_bottom.contin_span = p_contin_span;
   c_bottom.contin_bspan = p_contin_bspan;
+  c_bottom.contin_samples = p_contin_samples;
 
+  discard_samples();
   tool->shadow_stack->start.gettime();
 }
 
@@ -410,16 +531,23 @@ void __csi_task_exit(const csi_id_t task_exit_id, const csi_id_t task_id,
   bottom.contin_work += strand_time;
   bottom.contin_span += strand_time;
   bottom.contin_bspan += strand_time;
+  drain_samples(bottom);
 
   assert(cilk_time_t::zero() == bottom.lchild_span);
 
   // Pop the stack
   shadow_stack_frame_t &c_bottom = tool->shadow_stack->pop();
   shadow_stack_frame_t &p_bottom = tool->shadow_stack->peek_bot();
-  p_bottom.achild_work += c_bottom.contin_work - p_bottom.contin_work;
+  cilk_time_t task_work = c_bottom.contin_work - p_bottom.contin_work;
+  p_bottom.achild_work += task_work;
+  if (tool->site_profile.enabled())
+    tool->site_profile.record(__cilkrts_get_worker_number(), detach_id,
+                              task_work.get_raw_duration());
   // Check if the span of c_bottom exceeds that of the previous longest child.
-  if (c_bottom.contin_span > p_bottom.lchild_span)
+  if (c_bottom.contin_span > p_bottom.lchild_span) {
     p_bottom.lchild_span = c_bottom.contin_span;
+    p_bottom.lchild_samples = c_bottom.contin_samples;
+  }
   if (c_bottom.contin_bspan + cilkscale_timer_t::burden
       > p_bottom.lchild_bspan)
     p_bottom.lchild_bspan = c_bottom.contin_bspan + cilkscale_timer_t::burden;
@@ -448,9 +576,12 @@ void __csi_detach_continue(const csi_id_t detach_continue_id,
 
     // Select the largest of lchild_span and contin_span, and then reset
     // lchild_span.
-    if (bottom.lchild_span > bottom.contin_span)
+    if (bottom.lchild_span > bottom.contin_span) {
       bottom.contin_span = bottom.lchild_span;
+      bottom.contin_samples = bottom.lchild_samples;
+    }
     bottom.lchild_span = cilk_time_t::zero();
+    bottom.lchild_samples = nullptr;
 
     if (bottom.lchild_bspan > bottom.contin_bspan)
       bottom.contin_bspan = bottom.lchild_bspan;
@@ -459,6 +590,7 @@ void __csi_detach_continue(const csi_id_t detach_continue_id,
     bottom.contin_bspan += cilkscale_timer_t::burden;
   }
 
+  discard_samples();
   tool->shadow_stack->start.gettime();
 }
 
@@ -477,6 +609,7 @@ void __csi_before_sync(const csi_id_t sync_id, const unsigned sync_reg) {
   bottom.contin_work += strand_time;
   bottom.contin_span += strand_time;
   bottom.contin_bspan += strand_time;
+  drain_samples(bottom);
 }
 
 CILKTOOL_API
@@ -495,17 +628,22 @@ void __csi_after_sync(const csi_id_t sync_id, const unsigned sync_reg) {
 
   // Select the largest of lchild_span and contin_span, and then reset
   // lchild_span.
-  if (bottom.lchild_span > bottom.contin_span)
+  if (bottom.lchild_span > bottom.contin_span) {
     bottom.contin_span = bottom.lchild_span;
+    bottom.contin_samples = bottom.lchild_samples;
+  }
   bottom.lchild_span = cilk_time_t::zero();
+  bottom.lchild_samples = nullptr;
 
   if (bottom.lchild_bspan > bottom.contin_bspan)
     bottom.contin_bspan = bottom.lchild_bspan;
   bottom.lchild_bspan = cilk_time_t::zero();
 
+  discard_samples();
   tool->shadow_stack->start.gettime();
 }
 
+#if !CILKSCALE_BITCODE
 ///////////////////////////////////////////////////////////////////////////
 // Probes and associated routines
 
@@ -621,6 +759,182 @@ CILKTOOL_API void wsp_dump(wsp_t wsp, const char *tag) {
   ensure_header(output);
   print_results(output, tag, cilk_time_t(wsp.work), cilk_time_t(wsp.span),
                 cilk_time_t(wsp.bspan));
+  tool->wsp_stats.record(wsp, tag, __builtin_return_address(0));
 
   tool->shadow_stack->start.gettime();
 }
+
+// Helper to end the current strand before a query of the recorded statistics,
+// so that the query is not counted as work.
+static inline void stop_strand(void) {
+  tool->shadow_stack->stop.gettime();
+
+  shadow_stack_frame_t &bottom = tool->shadow_stack->peek_bot();
+
+  duration_t strand_time = tool->shadow_stack->elapsed_time();
+  bottom.contin_work += strand_time;
+  bottom.contin_span += strand_time;
+  bottom.contin_bspan += strand_time;
+}
+
+CILKTOOL_API void wsp_record(wsp_t wsp, const char *tag) {
+  stop_strand();
+  tool->wsp_stats.record(wsp, tag, __builtin_return_address(0));
+  tool->shadow_stack->start.gettime();
+}
+
+CILKTOOL_API int wsp_tag_stats(const char *tag, wsp_stats_t *stats) {
+  stop_strand();
+  bool found = tool->wsp_stats.get_tag(tag, stats);
+  tool->shadow_stack->start.gettime();
+  return found;
+}
+
+CILKTOOL_API uint64_t wsp_site_stats(wsp_stats_t *stats, uint64_t max_stats) {
+  stop_strand();
+  uint64_t num_sites = tool->wsp_stats.get_sites(stats, max_stats);
+  tool->shadow_stack->start.gettime();
+  return num_sites;
+}
+
+CILKTOOL_API void wsp_reset_stats(void) {
+  stop_strand();
+  tool->wsp_stats.reset();
+  tool->shadow_stack->start.gettime();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Hooks for mutexes
+//
+// Time spent blocked waiting to acquire a mutex is not work, so these hooks end
+// the current strand before trying to acquire the mutex and start a new strand
+// once the mutex is acquired.  If lock statistics are enabled, the time each
+// mutex is held is recorded in them.
+
+static inline bool track_locks(void) {
+  return CILKSCALE_INITIALIZED && tool;
+}
+
+// End the current strand before a potentially blocking acquire.
+static inline void before_lock(void) {
+  tool->shadow_stack->stop.gettime();
+
+  shadow_stack_frame_t &bottom = tool->shadow_stack->peek_bot();
+
+  duration_t strand_time = tool->shadow_stack->elapsed_time();
+  bottom.contin_work += strand_time;
+  bottom.contin_span += strand_time;
+  bottom.contin_bspan += strand_time;
+  drain_samples(bottom);
+}
+
+// Start a new strand after an acquire attempt.  If the acquire succeeded,
+// record the time spent waiting and the start of the critical section.
+static inline void after_lock(const void *mutex, bool acquired,
+                              uintptr_t site) {
+  discard_samples();
+  tool->shadow_stack->start.gettime();
+  if (!acquired || !tool->lock_stats)
+    return;
+
+  if (LockStats_t::Entry_t *entry = tool->lock_stats->get(mutex)) {
+    LockStats_t::SiteStats_t *stats = entry->get_site(site);
+    ++stats->acquires;
+    stats->wait += elapsed_time(&tool->shadow_stack->start,
+                                &tool->shadow_stack->stop);
+    entry->holder = stats;
+    entry->acquired = tool->shadow_stack->start;
+    entry->held = true;
+  }
+}
+
+// Record the start of a critical section entered by a successful trylock.  A
+// trylock does not block, so it does not end the current strand.
+static inline void after_trylock(const void *mutex, uintptr_t site) {
+  if (!tool->lock_stats)
+    return;
+  if (LockStats_t::Entry_t *entry = tool->lock_stats->get(mutex)) {
+    LockStats_t::SiteStats_t *stats = entry->get_site(site);
+    ++stats->acquires;
+    entry->holder = stats;
+    entry->acquired.gettime();
+    entry->held = true;
+  }
+}
+
+// Record the end of a critical section before mutex is released.
+static inline void before_unlock(const void *mutex) {
+  if (!tool->lock_stats)
+    return;
+  LockStats_t::Entry_t *entry = tool->lock_stats->find(mutex);
+  if (!entry || !entry->held)
+    return;
+
+  cilkscale_timer_t released;
+  released.gettime();
+  entry->holder->hold += elapsed_time(&released, &entry->acquired);
+  entry->held = false;
+}
+
+CILKTOOL_API int __csan_pthread_mutex_lock(pthread_mutex_t *mutex) {
+  if (!track_locks())
+    return pthread_mutex_lock(mutex);
+
+  uintptr_t site = (uintptr_t)__builtin_return_address(0);
+  before_lock();
+  int result = pthread_mutex_lock(mutex);
+  after_lock(mutex, !result, site);
+  return result;
+}
+
+CILKTOOL_API int __csan_pthread_mutex_trylock(pthread_mutex_t *mutex) {
+  int result = pthread_mutex_trylock(mutex);
+  if (!result && track_locks())
+    after_trylock(mutex, (uintptr_t)__builtin_return_address(0));
+  return result;
+}
+
+CILKTOOL_API int __csan_pthread_mutex_unlock(pthread_mutex_t *mutex) {
+  if (track_locks())
+    before_unlock(mutex);
+  return pthread_mutex_unlock(mutex);
+}
+
+#ifndef __STDC_NO_THREADS__
+CILKTOOL_API int __csan_mtx_lock(mtx_t *mutex) {
+  if (!track_locks())
+    return mtx_lock(mutex);
+
+  uintptr_t site = (uintptr_t)__builtin_return_address(0);
+  before_lock();
+  int result = mtx_lock(mutex);
+  after_lock(mutex, thrd_success == result, site);
+  return result;
+}
+
+CILKTOOL_API int __csan_mtx_timedlock(mtx_t *__restrict mutex,
+                                      const struct timespec *__restrict ts) {
+  if (!track_locks())
+    return mtx_timedlock(mutex, ts);
+
+  uintptr_t site = (uintptr_t)__builtin_return_address(0);
+  before_lock();
+  int result = mtx_timedlock(mutex, ts);
+  after_lock(mutex, thrd_success == result, site);
+  return result;
+}
+
+CILKTOOL_API int __csan_mtx_trylock(mtx_t *mutex) {
+  int result = mtx_trylock(mutex);
+  if (thrd_success == result && track_locks())
+    after_trylock(mutex, (uintptr_t)__builtin_return_address(0));
+  return result;
+}
+
+CILKTOOL_API int __csan_mtx_unlock(mtx_t *mutex) {
+  if (track_locks())
+    before_unlock(mutex);
+  return mtx_unlock(mutex);
+}
+#endif // __STDC_NO_THREADS__
+#endif // !CILKSCALE_BITCODE
@@ -137,7 +137,7 @@ public:
   }
 };
 
-const char *cilk_time_t::units =
+inline const char *cilk_time_t::units =
 #if CSCALETIMER == RDTSC
     "Gcycles"
 #elif CSCALETIMER == INST
@@ -147,7 +147,7 @@ const char *cilk_time_t::units =
 #endif // CSCALETIMER
     ;
 
-const double cilk_time_t::scale_factor =
+inline const double cilk_time_t::scale_factor =
 #if CSCALETIMER == CLOCK
     1.0
 #elif CSCALETIMER == RDTSC
@@ -202,7 +202,7 @@ struct cilkscale_timer_t {
   static duration_t burden;
 };
 
-duration_t cilkscale_timer_t::burden =
+inline duration_t cilkscale_timer_t::burden =
 #if CSCALETIMER == RDTSC
       15000
 #elif CSCALETIMER == CLOCK
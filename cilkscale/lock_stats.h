@@ -0,0 +1,176 @@
+// -*- C++ -*-
+#ifndef INCLUDED_LOCK_STATS_H
+#define INCLUDED_LOCK_STATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <dlfcn.h>
+#include <iostream>
+#include <vector>
+
+#include "cilkscale_timer.h"
+
+// Statistics on the mutexes acquired by the program.
+//
+// Cilkscale does not count time spent blocked on a mutex as work.  Instead,
+// for each mutex and each site that acquires it, it records the number of
+// acquires, the time spent waiting to acquire the mutex, and the time it was
+// held.  Critical sections on the same mutex execute one at a time, so the
+// total hold time of any one mutex is a lower bound on the running time of the
+// program, just as the span is.
+//
+// The statistics for each mutex are kept in a fixed-size, open-addressed table
+// keyed by the address of the mutex.  Entries are claimed with an atomic
+// compare-and-swap and never removed.  Each entry holds the statistics of up to
+// MAX_SITES acquire sites, with any further sites combined.  The statistics in
+// an entry are updated only by the thread that holds the mutex, so they need no
+// further synchronization.
+class LockStats_t {
+public:
+  struct SiteStats_t {
+    // Return address of the acquire, or 0 for the combined other sites.
+    uintptr_t site = 0;
+    uint64_t acquires = 0;
+    cilk_time_t wait = cilk_time_t::zero();
+    cilk_time_t hold = cilk_time_t::zero();
+  };
+
+  static constexpr unsigned MAX_SITES = 8;
+
+  struct Entry_t {
+    uintptr_t mutex = 0;
+    SiteStats_t sites[MAX_SITES];
+    unsigned num_sites = 0;
+    // Acquires from sites beyond the first MAX_SITES.
+    SiteStats_t other_sites;
+    // Site of the current critical section, time of the most recent acquire,
+    // and whether the mutex is still held.
+    SiteStats_t *holder = nullptr;
+    cilkscale_timer_t acquired;
+    bool held = false;
+
+    // Get the statistics for acquires from site, adding them if necessary.
+    SiteStats_t *get_site(uintptr_t site) {
+      for (unsigned i = 0; i < num_sites; ++i)
+        if (sites[i].site == site)
+          return &sites[i];
+      if (num_sites == MAX_SITES)
+        return &other_sites;
+      sites[num_sites].site = site;
+      return &sites[num_sites++];
+    }
+
+    cilk_time_t total_hold() const {
+      cilk_time_t hold = other_sites.hold;
+      for (unsigned i = 0; i < num_sites; ++i)
+        hold += sites[i].hold;
+      return hold;
+    }
+  };
+
+private:
+  static constexpr unsigned LG_TABLE_SIZE = 12;
+  static constexpr uintptr_t TABLE_MASK = (1UL << LG_TABLE_SIZE) - 1;
+  Entry_t table[1UL << LG_TABLE_SIZE];
+  // Set if the table filled up, so that some mutexes were not tracked.
+  bool overflow = false;
+
+  static uintptr_t hash(uintptr_t mutex) {
+    return ((mutex >> 3) * 0x9e3779b97f4a7c15UL) >> (64 - LG_TABLE_SIZE);
+  }
+
+public:
+  // Get the entry for mutex, creating it if necessary.  Returns nullptr if the
+  // table is full.
+  Entry_t *get(const void *mutex) {
+    uintptr_t key = reinterpret_cast<uintptr_t>(mutex);
+    uintptr_t idx = hash(key);
+    for (uintptr_t probe = 0; probe <= TABLE_MASK; ++probe) {
+      Entry_t &e = table[(idx + probe) & TABLE_MASK];
+      uintptr_t cur = __atomic_load_n(&e.mutex, __ATOMIC_ACQUIRE);
+      if (cur == key)
+        return &e;
+      if (0 == cur) {
+        uintptr_t expected = 0;
+        if (__atomic_compare_exchange_n(&e.mutex, &expected, key, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+          return &e;
+        if (expected == key)
+          return &e;
+      }
+    }
+    overflow = true;
+    return nullptr;
+  }
+
+  // Find the entry for mutex, or nullptr if none exists.
+  Entry_t *find(const void *mutex) {
+    uintptr_t key = reinterpret_cast<uintptr_t>(mutex);
+    uintptr_t idx = hash(key);
+    for (uintptr_t probe = 0; probe <= TABLE_MASK; ++probe) {
+      Entry_t &e = table[(idx + probe) & TABLE_MASK];
+      uintptr_t cur = __atomic_load_n(&e.mutex, __ATOMIC_ACQUIRE);
+      if (cur == key)
+        return &e;
+      if (0 == cur)
+        return nullptr;
+    }
+    return nullptr;
+  }
+
+  // Print the statistics for each mutex and acquire site, ordered by decreasing
+  // hold time, along with the bound on parallelism that the most held mutex
+  // implies.
+  void print(std::ostream &OS, cilk_time_t work) const {
+    std::vector<std::pair<const Entry_t *, const SiteStats_t *>> sites;
+    const Entry_t *top = nullptr;
+    cilk_time_t top_hold = cilk_time_t::zero();
+    for (const Entry_t &e : table) {
+      if (!e.mutex)
+        continue;
+      for (unsigned i = 0; i < e.num_sites; ++i)
+        sites.emplace_back(&e, &e.sites[i]);
+      if (e.other_sites.acquires)
+        sites.emplace_back(&e, &e.other_sites);
+      cilk_time_t hold = e.total_hold();
+      if (!top || hold > top_hold) {
+        top = &e;
+        top_hold = hold;
+      }
+    }
+    if (sites.empty())
+      return;
+    std::sort(sites.begin(), sites.end(),
+              [](const std::pair<const Entry_t *, const SiteStats_t *> &a,
+                 const std::pair<const Entry_t *, const SiteStats_t *> &b) {
+                return a.second->hold > b.second->hold;
+              });
+
+    OS << "lock,site,acquires,wait (" << cilk_time_t::units << "),hold ("
+       << cilk_time_t::units << ")\n";
+    for (const auto &entry : sites) {
+      const SiteStats_t *s = entry.second;
+      OS << reinterpret_cast<void *>(entry.first->mutex) << ",";
+      Dl_info info;
+      if (!s->site)
+        OS << "(other sites)";
+      else if (dladdr(reinterpret_cast<void *>(s->site), &info) &&
+               info.dli_sname)
+        OS << info.dli_sname << "+0x" << std::hex
+           << s->site - (uintptr_t)info.dli_saddr << std::dec;
+      else
+        OS << "??+0x" << std::hex << s->site << std::dec;
+      OS << "," << s->acquires << "," << s->wait << "," << s->hold << "\n";
+    }
+    OS << "lock-serialized span (" << cilk_time_t::units << ")," << top_hold
+       << "\n";
+    // Critical sections too short for the timer to measure bound nothing.
+    if (top_hold > cilk_time_t::zero())
+      OS << "lock-serialized parallelism,"
+         << work.get_val_d() / top_hold.get_val_d() << "\n";
+    if (overflow)
+      OS << "warning: too many mutexes, some were not tracked\n";
+  }
+};
+
+#endif // INCLUDED_LOCK_STATS_H
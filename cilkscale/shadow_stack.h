@@ -3,6 +3,7 @@
 #define INCLUDED_SHADOW_STACK_H
 
 #include "cilkscale_timer.h"
+#include "span_sampler.h"
 
 #ifndef SERIAL_TOOL
 #define SERIAL_TOOL 1
@@ -48,6 +49,11 @@ struct shadow_stack_frame_t {
   // child
   cilk_time_t contin_bspan = cilk_time_t::zero();
 
+  // Paths of profiling samples corresponding to lchild_span and contin_span,
+  // maintained only if span sampling is enabled.
+  const SpanSample_t *lchild_samples = nullptr;
+  const SpanSample_t *contin_samples = nullptr;
+
   // Function type
   frame_type type = frame_type::NONE;
 
@@ -60,6 +66,8 @@ struct shadow_stack_frame_t {
     contin_span = cilk_time_t::zero();
     lchild_bspan = cilk_time_t::zero();
     contin_bspan = cilk_time_t::zero();
+    lchild_samples = nullptr;
+    contin_samples = nullptr;
   }
 };
 
@@ -177,11 +185,18 @@ public:
 
     // If the left stack has a longer path from the root to the end of its
     // longest child, set this new span in keft.
+    SpanSampler_t *sampler = SpanSampler_t::get();
     if (l_bot.contin_span + r_bot.lchild_span > l_bot.lchild_span) {
       l_bot.lchild_span = l_bot.contin_span + r_bot.lchild_span;
+      if (sampler)
+        l_bot.lchild_samples =
+            sampler->join(l_bot.contin_samples, r_bot.lchild_samples);
     }
     // Add the continuation span from the right stack into the left.
     l_bot.contin_span += r_bot.contin_span;
+    if (sampler)
+      l_bot.contin_samples =
+          sampler->join(l_bot.contin_samples, r_bot.contin_samples);
 
     // If the left stack has a longer path from the root to the end of its
     // longest child, set this new span in keft.
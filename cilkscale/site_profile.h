@@ -0,0 +1,196 @@
+// -*- C++ -*-
+#ifndef INCLUDED_SITE_PROFILE_H
+#define INCLUDED_SITE_PROFILE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <csi/csi.h>
+
+#include "cilkscale_timer.h"
+
+// Per-spawn-site work profile, for measuring work inflation.
+//
+// The work of each spawned task, including the work of its synced
+// descendants, is attributed to the spawn site of that task.  Each worker
+// accumulates the work of the tasks it executes in its own table, so recording
+// needs no synchronization.  At the end of the run, the tables are combined and
+// optionally saved.  A profile saved from a serial run, i.e., with
+// CILK_NWORKERS=1, can then serve as the baseline for a parallel run.  The
+// parallel run reports the spawn sites whose work grew the most relative to
+// the baseline, which points to the sites whose locality suffers in parallel.
+//
+// Spawn sites are identified by source location, when available, so that
+// profiles can be compared across builds.  A saved profile is a text file with
+// one line per site:
+//
+//   <file>:<line>:<column> TAB <function> TAB <task count> TAB <raw work>
+class SiteProfile_t {
+  struct SiteWork_t {
+    uint64_t count = 0;
+    raw_duration_t work = 0;
+  };
+
+  struct SiteSummary_t {
+    std::string name;
+    uint64_t count = 0;
+    raw_duration_t work = 0;
+  };
+
+  // Per-worker tables of the work of each spawn site, indexed by detach ID.
+  std::vector<SiteWork_t> *worker_sites = nullptr;
+  unsigned num_workers = 0;
+
+  static std::string site_key(csi_id_t detach_id, std::string &name) {
+    const source_loc_t *loc = __csi_get_detach_source_loc(detach_id);
+    std::ostringstream key;
+    if (loc && loc->filename) {
+      key << loc->filename << ":" << loc->line_number << ":"
+          << loc->column_number;
+      name = loc->name ? loc->name : "";
+    } else {
+      key << "detach:" << detach_id;
+      name = "";
+    }
+    return key.str();
+  }
+
+  // Combine the per-worker tables into a summary keyed by site.
+  std::unordered_map<std::string, SiteSummary_t> summarize() const {
+    std::unordered_map<std::string, SiteSummary_t> summary;
+    for (unsigned w = 0; w < num_workers; ++w) {
+      const std::vector<SiteWork_t> &sites = worker_sites[w];
+      for (csi_id_t id = 0; id < (csi_id_t)sites.size(); ++id) {
+        if (!sites[id].count)
+          continue;
+        std::string name;
+        SiteSummary_t &s = summary[site_key(id, name)];
+        s.name = name;
+        s.count += sites[id].count;
+        s.work += sites[id].work;
+      }
+    }
+    return summary;
+  }
+
+  // Parse the decimal number in str into val.  Returns false if str is not
+  // entirely a nonnegative number that fits in val.
+  template <typename T>
+  static bool parse_field(const std::string &str, T &val) {
+    if (str.empty() || str[0] == '-')
+      return false;
+    char *end;
+    errno = 0;
+    unsigned long long parsed = strtoull(str.c_str(), &end, 10);
+    if (errno || *end != '\0' ||
+        parsed > (unsigned long long)std::numeric_limits<T>::max())
+      return false;
+    val = (T)parsed;
+    return true;
+  }
+
+public:
+  ~SiteProfile_t() { delete[] worker_sites; }
+
+  bool enabled() const { return worker_sites != nullptr; }
+
+  void init(unsigned nworkers) {
+    num_workers = nworkers;
+    worker_sites = new std::vector<SiteWork_t>[nworkers];
+  }
+
+  // Record a task spawned at detach_id that performed the given work.
+  void record(unsigned worker, csi_id_t detach_id, raw_duration_t work) {
+    if (worker >= num_workers || detach_id < 0)
+      return;
+    std::vector<SiteWork_t> &sites = worker_sites[worker];
+    if ((size_t)detach_id >= sites.size())
+      sites.resize(detach_id + 1);
+    ++sites[detach_id].count;
+    sites[detach_id].work += work;
+  }
+
+  // Save the profile of this run to path.
+  bool save(const char *path) const {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+      return false;
+    for (const auto &entry : summarize())
+      out << entry.first << "\t" << entry.second.name << "\t"
+          << entry.second.count << "\t" << entry.second.work << "\n";
+    return bool(out);
+  }
+
+  // Compare this run against the baseline profile at path, and print the top
+  // sites by increase in work to OS.
+  bool report_inflation(const char *path, unsigned top,
+                        std::ostream &OS) const {
+    std::ifstream in(path);
+    if (!in)
+      return false;
+    std::unordered_map<std::string, SiteSummary_t> baseline;
+    std::string line;
+    unsigned line_no = 0;
+    while (std::getline(in, line)) {
+      ++line_no;
+      std::istringstream fields(line);
+      std::string key, name, count, work;
+      SiteSummary_t s;
+      if (!std::getline(fields, key, '\t') || !std::getline(fields, name, '\t')
+          || !std::getline(fields, count, '\t') || !std::getline(fields, work)
+          || !parse_field(count, s.count) || !parse_field(work, s.work)) {
+        std::cerr << "Cilkscale: skipping malformed line " << line_no << " of "
+                  << path << "\n";
+        continue;
+      }
+      s.name = name;
+      baseline[key] = s;
+    }
+
+    struct Inflation_t {
+      std::string key;
+      const SiteSummary_t *parallel;
+      const SiteSummary_t *serial;
+      double extra;
+    };
+    std::unordered_map<std::string, SiteSummary_t> current = summarize();
+    std::vector<Inflation_t> sites;
+    for (const auto &entry : current) {
+      auto base = baseline.find(entry.first);
+      // Inflation is undefined for sites with no serial work.
+      if (base == baseline.end() || !base->second.work)
+        continue;
+      double extra = cilk_time_t(entry.second.work).get_val_d() -
+                     cilk_time_t(base->second.work).get_val_d();
+      sites.push_back({entry.first, &entry.second, &base->second, extra});
+    }
+    std::sort(sites.begin(), sites.end(),
+              [](const Inflation_t &a, const Inflation_t &b) {
+                return a.extra > b.extra;
+              });
+    if (sites.size() > top)
+      sites.resize(top);
+
+    OS << "site,function,serial work (" << cilk_time_t::units
+       << "),parallel work (" << cilk_time_t::units << "),inflation\n";
+    for (const Inflation_t &s : sites) {
+      cilk_time_t serial_work(s.serial->work);
+      cilk_time_t parallel_work(s.parallel->work);
+      OS << s.key << "," << s.parallel->name << "," << serial_work << ","
+         << parallel_work << ","
+         << parallel_work.get_val_d() / serial_work.get_val_d() << "\n";
+    }
+    return true;
+  }
+};
+
+#endif // INCLUDED_SITE_PROFILE_H
@@ -0,0 +1,324 @@
+// -*- C++ -*-
+#ifndef INCLUDED_SPAN_SAMPLER_H
+#define INCLUDED_SPAN_SAMPLER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <dlfcn.h>
+#include <iostream>
+#include <pthread.h>
+#include <signal.h>
+#include <string>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unordered_map>
+#include <vector>
+
+#include <cilk/cilk_api.h>
+
+// Sampling profiler that attributes running time to functions and to the
+// critical path of the computation.
+//
+// A profiling timer periodically interrupts the running worker, which records
+// the program counter in a per-worker buffer.  When a strand ends, the shadow
+// stack drains the samples taken during that strand and appends them to the
+// path of samples for that frame, alongside the span of the frame.  Whenever
+// Cilkscale selects the longest of two paths for the span, it selects the
+// corresponding path of samples as well.  Hence, at the end of the run, the
+// path of samples of the root frame consists of the samples taken along the
+// critical path, which form the span profile.  The work profile consists of all
+// samples.
+//
+// Paths of samples are immutable, so selecting or copying a path just copies a
+// pointer.  Each sample is a node that points to the preceding part of the
+// path.  Joining two paths, when reducing shadow-stack views, allocates a join
+// node that points to both parts.  Nodes are allocated from per-worker arenas
+// and freed only when the profiler is destroyed.
+struct SpanSample_t {
+  // Preceding part of the path, or the first part of a join.
+  const SpanSample_t *prev;
+  // Second part of a join, or nullptr for a sample.
+  const SpanSample_t *next;
+  // Program counter of a sample, or 0 for a join.
+  uintptr_t pc;
+};
+
+class SpanSampler_t {
+  // Samples taken by the signal handler and not yet drained.  Only the owning
+  // worker thread reads or writes this buffer, either in the signal handler or
+  // in a hook that the signal handler may interrupt.
+  struct PendingSamples_t {
+    static constexpr unsigned CAPACITY = 64;
+    uintptr_t pcs[CAPACITY];
+    unsigned count = 0;
+    pthread_t owner;
+    bool owned = false;
+  };
+
+  struct alignas(64) WorkerState_t {
+    PendingSamples_t pending;
+    // Number of samples of each program counter on this worker.
+    std::unordered_map<uintptr_t, uint64_t> work_samples;
+    // Arena for nodes of sample paths.
+    std::vector<SpanSample_t *> chunks;
+    unsigned chunk_used = 0;
+    uint64_t dropped = 0;
+  };
+
+  static constexpr unsigned CHUNK_SIZE = 1024;
+
+  WorkerState_t *workers = nullptr;
+  unsigned num_workers = 0;
+  unsigned period_us = 0;
+  bool running = false;
+  struct sigaction old_action;
+
+  // The sampler in use, for the signal handler and the shadow-stack reducer.
+  static SpanSampler_t *current;
+
+  static uintptr_t get_pc(void *context) {
+    const ucontext_t *uc = static_cast<const ucontext_t *>(context);
+#if defined(__APPLE__) && defined(__x86_64__)
+    return uc->uc_mcontext->__ss.__rip;
+#elif defined(__APPLE__) && defined(__aarch64__)
+    return uc->uc_mcontext->__ss.__pc;
+#elif defined(__linux__) && defined(__x86_64__)
+    return uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__linux__) && defined(__aarch64__)
+    return uc->uc_mcontext.pc;
+#else
+    (void)uc;
+    return 0;
+#endif
+  }
+
+  static void handler(int sig, siginfo_t *info, void *context) {
+    SpanSampler_t *sampler = current;
+    if (!sampler || !sampler->running)
+      return;
+    int w = __cilkrts_get_worker_number();
+    if (w < 0 || (unsigned)w >= sampler->num_workers)
+      return;
+    WorkerState_t &state = sampler->workers[w];
+    PendingSamples_t &pending = state.pending;
+    if (!pending.owned || !pthread_equal(pending.owner, pthread_self()))
+      return;
+    uintptr_t pc = get_pc(context);
+    if (!pc)
+      return;
+    unsigned n = __atomic_load_n(&pending.count, __ATOMIC_RELAXED);
+    if (n >= PendingSamples_t::CAPACITY) {
+      ++state.dropped;
+      return;
+    }
+    pending.pcs[n] = pc;
+    __atomic_store_n(&pending.count, n + 1, __ATOMIC_RELEASE);
+  }
+
+  SpanSample_t *new_node(WorkerState_t &state) {
+    if (state.chunks.empty() || state.chunk_used == CHUNK_SIZE) {
+      state.chunks.push_back(new SpanSample_t[CHUNK_SIZE]);
+      state.chunk_used = 0;
+    }
+    return &state.chunks.back()[state.chunk_used++];
+  }
+
+  // Get the state of the calling worker, or nullptr if the caller is not a
+  // worker.
+  WorkerState_t *get_worker_state() {
+    int w = __cilkrts_get_worker_number();
+    if (w < 0 || (unsigned)w >= num_workers)
+      return nullptr;
+    WorkerState_t &state = workers[w];
+    if (!state.pending.owned) {
+      state.pending.owner = pthread_self();
+      __atomic_store_n(&state.pending.owned, true, __ATOMIC_RELEASE);
+    }
+    return &state;
+  }
+
+public:
+  ~SpanSampler_t() {
+    stop();
+    if (!workers)
+      return;
+    for (unsigned w = 0; w < num_workers; ++w)
+      for (SpanSample_t *chunk : workers[w].chunks)
+        delete[] chunk;
+    delete[] workers;
+    if (current == this)
+      current = nullptr;
+  }
+
+  static SpanSampler_t *get() { return current; }
+
+  bool enabled() const { return workers != nullptr; }
+
+  // Start sampling every period_us microseconds of CPU time.
+  bool start(unsigned nworkers, unsigned period_us_) {
+    num_workers = nworkers;
+    period_us = period_us_;
+    workers = new WorkerState_t[nworkers];
+    current = this;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &old_action))
+      return false;
+    running = true;
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = period_us / 1000000;
+    timer.it_interval.tv_usec = period_us % 1000000;
+    timer.it_value = timer.it_interval;
+    return 0 == setitimer(ITIMER_PROF, &timer, nullptr);
+  }
+
+  void stop() {
+    if (!running)
+      return;
+    running = false;
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &old_action, nullptr);
+  }
+
+  // Discard the samples taken since the last drain on this worker, which were
+  // taken outside of any strand, e.g., in the runtime system.
+  void discard() {
+    if (WorkerState_t *state = get_worker_state())
+      __atomic_store_n(&state->pending.count, 0, __ATOMIC_RELEASE);
+  }
+
+  // Append the samples taken since the last drain on this worker to path, and
+  // return the new path.
+  const SpanSample_t *drain(const SpanSample_t *path) {
+    WorkerState_t *state = get_worker_state();
+    if (!state)
+      return path;
+    PendingSamples_t &pending = state->pending;
+    uintptr_t pcs[PendingSamples_t::CAPACITY];
+    unsigned n;
+    // The signal handler may append samples while they are copied.  In that
+    // case, the exchange fails and the copy is retried.
+    do {
+      n = __atomic_load_n(&pending.count, __ATOMIC_ACQUIRE);
+      if (0 == n)
+        return path;
+      std::copy(pending.pcs, pending.pcs + n, pcs);
+    } while (!__atomic_compare_exchange_n(&pending.count, &n, 0, false,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    for (unsigned i = 0; i < n; ++i) {
+      ++state->work_samples[pcs[i]];
+      SpanSample_t *node = new_node(*state);
+      *node = {path, nullptr, pcs[i]};
+      path = node;
+    }
+    return path;
+  }
+
+  // Return the concatenation of paths first and second.
+  const SpanSample_t *join(const SpanSample_t *first,
+                           const SpanSample_t *second) {
+    if (!second)
+      return first;
+    if (!first)
+      return second;
+    WorkerState_t *state = get_worker_state();
+    if (!state)
+      return first;
+    SpanSample_t *node = new_node(*state);
+    *node = {first, second, 0};
+    return node;
+  }
+
+  // Print the functions with the most samples on the critical path, given by
+  // path, and in total.
+  void report(std::ostream &OS, const SpanSample_t *path, unsigned top) const {
+    struct FunctionSamples_t {
+      uint64_t work = 0;
+      uint64_t span = 0;
+    };
+    std::unordered_map<uintptr_t, FunctionSamples_t> functions;
+    std::unordered_map<uintptr_t, std::string> names;
+    auto function_of = [&](uintptr_t pc) {
+      Dl_info info;
+      uintptr_t start = pc;
+      std::string name = "??";
+      if (dladdr(reinterpret_cast<void *>(pc), &info) && info.dli_sname) {
+        start = reinterpret_cast<uintptr_t>(info.dli_saddr);
+        name = info.dli_sname;
+      }
+      names.emplace(start, name);
+      return start;
+    };
+
+    uint64_t total_work = 0, total_span = 0, dropped = 0;
+    std::unordered_map<uintptr_t, uintptr_t> pc_function;
+    for (unsigned w = 0; w < num_workers; ++w) {
+      dropped += workers[w].dropped;
+      for (const auto &entry : workers[w].work_samples) {
+        auto fn = pc_function.find(entry.first);
+        if (fn == pc_function.end())
+          fn = pc_function.emplace(entry.first, function_of(entry.first)).first;
+        functions[fn->second].work += entry.second;
+        total_work += entry.second;
+      }
+    }
+
+    // Count the samples on the critical path.
+    std::vector<const SpanSample_t *> worklist;
+    if (path)
+      worklist.push_back(path);
+    while (!worklist.empty()) {
+      const SpanSample_t *node = worklist.back();
+      worklist.pop_back();
+      if (node->prev)
+        worklist.push_back(node->prev);
+      if (node->pc) {
+        auto fn = pc_function.find(node->pc);
+        if (fn == pc_function.end())
+          fn = pc_function.emplace(node->pc, function_of(node->pc)).first;
+        ++functions[fn->second].span;
+        ++total_span;
+      } else if (node->next) {
+        worklist.push_back(node->next);
+      }
+    }
+
+    std::vector<std::pair<uintptr_t, FunctionSamples_t>> sorted(
+        functions.begin(), functions.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const std::pair<uintptr_t, FunctionSamples_t> &a,
+                 const std::pair<uintptr_t, FunctionSamples_t> &b) {
+                if (a.second.span != b.second.span)
+                  return a.second.span > b.second.span;
+                return a.second.work > b.second.work;
+              });
+    if (sorted.size() > top)
+      sorted.resize(top);
+
+    OS << "Span profile, sampled every " << period_us << " us: "
+       << total_work << " samples of work, " << total_span
+       << " samples on the critical path";
+    if (dropped)
+      OS << ", " << dropped << " samples dropped";
+    OS << "\nfunction,work samples,work %,span samples,span %\n";
+    for (const auto &entry : sorted) {
+      OS << names[entry.first] << "," << entry.second.work << ","
+         << (total_work ? 100.0 * entry.second.work / total_work : 0.0) << ","
+         << entry.second.span << ","
+         << (total_span ? 100.0 * entry.second.span / total_span : 0.0)
+         << "\n";
+    }
+  }
+};
+
+inline SpanSampler_t *SpanSampler_t::current = nullptr;
+
+#endif // INCLUDED_SPAN_SAMPLER_H
@@ -0,0 +1,252 @@
+// -*- C++ -*-
+#ifndef INCLUDED_TIMELINE_TRACE_H
+#define INCLUDED_TIMELINE_TRACE_H
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <csi/csi.h>
+
+#include "cilkscale_timer.h"
+
+// Per-worker timeline of strand begin and end events, for
+// cilkscale-benchmark.
+//
+// Each worker appends events to its own fixed-size buffer, so recording an
+// event needs no synchronization or allocation.  The buffers are allocated
+// before the computation starts, with room for CILKSCALE_TRACE_EVENTS events
+// per worker, and events that do not fit are counted as dropped.  The buffers
+// are read only when the trace is exported, after the parallel computation has
+// finished.  The trace can be exported in the Chrome trace-event JSON format,
+// which chrome://tracing and Perfetto display, or in a compact binary format,
+// with all values little-endian and unpadded:
+//
+//   char     magic[8] = "CSTRACE1"
+//   uint32_t number of workers
+//   for each worker:
+//     uint32_t worker number
+//     uint64_t number of events
+//     for each event:
+//       uint64_t time
+//       int64_t  CSI ID
+//       uint8_t  TraceEventKind_t
+//
+// Event times are in the raw units of the Cilkscale timer, measured from the
+// start of the program: nanoseconds for the default timer, cycles for the
+// RDTSC timer, and instructions for cilkscale-instructions.
+
+enum class TraceEventKind_t : uint8_t {
+  // Events that begin a strand.
+  TASK,         // Start of a spawned task.
+  CONTINUE,     // Start of the continuation of a spawn.
+  AFTER_SYNC,   // Start of the strand after a sync.
+  // Events that end a strand.
+  DETACH,       // Spawn of a task.
+  TASK_EXIT,    // End of a spawned task.
+  BEFORE_SYNC,  // Sync.
+};
+
+static inline bool is_strand_begin(TraceEventKind_t kind) {
+  return kind <= TraceEventKind_t::AFTER_SYNC;
+}
+
+static inline const char *trace_event_name(TraceEventKind_t kind) {
+  switch (kind) {
+  case TraceEventKind_t::TASK: return "task";
+  case TraceEventKind_t::CONTINUE: return "continue";
+  case TraceEventKind_t::AFTER_SYNC: return "after_sync";
+  case TraceEventKind_t::DETACH: return "detach";
+  case TraceEventKind_t::TASK_EXIT: return "task_exit";
+  case TraceEventKind_t::BEFORE_SYNC: return "sync";
+  }
+  return "unknown";
+}
+
+struct TraceEvent_t {
+  // Time of the event since the start of the program.
+  raw_duration_t time;
+  // CSI ID of the detach for spawn-related events, or of the sync for
+  // sync-related events.
+  csi_id_t id;
+  TraceEventKind_t kind;
+};
+
+// Buffer of events recorded by one worker.  Aligned to avoid false sharing
+// between workers.
+struct alignas(64) TraceBuffer_t {
+  TraceEvent_t *events = nullptr;
+  uint64_t count = 0;
+  // Events that did not fit in the buffer.
+  uint64_t dropped = 0;
+};
+
+class TimelineTrace_t {
+  static constexpr uint64_t DEFAULT_CAPACITY = 1 << 16;
+
+  TraceBuffer_t *buffers = nullptr;
+  unsigned num_workers = 0;
+  // Number of events each buffer can hold.
+  uint64_t capacity = 0;
+  // Events recorded on threads that are not Cilk workers are dropped.
+  uint64_t dropped = 0;
+
+#if CSCALETIMER == CLOCK
+  // The clock timer measures nanoseconds, which the trace-event format shows
+  // in microseconds.
+  static constexpr const char *TIME_UNIT = "us";
+  static double to_trace_time(raw_duration_t time) {
+    return (double)time / 1000.0;
+  }
+#else
+  // Other timers do not measure time, so their raw values are written as is,
+  // and the trace records their unit.
+#if CSCALETIMER == RDTSC
+  static constexpr const char *TIME_UNIT = "cycles";
+#else
+  static constexpr const char *TIME_UNIT = "instructions";
+#endif
+  static double to_trace_time(raw_duration_t time) { return (double)time; }
+#endif
+
+  template <typename T>
+  static void write_value(std::ofstream &out, T value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+public:
+  ~TimelineTrace_t() {
+    if (!buffers)
+      return;
+    for (unsigned w = 0; w < num_workers; ++w)
+      delete[] buffers[w].events;
+    delete[] buffers;
+  }
+
+  bool enabled() const { return buffers != nullptr; }
+
+  void init(unsigned nworkers) {
+    num_workers = nworkers;
+    capacity = DEFAULT_CAPACITY;
+    if (const char *e = getenv("CILKSCALE_TRACE_EVENTS"))
+      if (uint64_t n = strtoull(e, nullptr, 10))
+        capacity = n;
+    buffers = new TraceBuffer_t[nworkers];
+    for (unsigned w = 0; w < nworkers; ++w)
+      buffers[w].events = new TraceEvent_t[capacity];
+  }
+
+  void record(int worker, TraceEventKind_t kind, csi_id_t id,
+              raw_duration_t time) {
+    if (worker < 0 || (unsigned)worker >= num_workers) {
+      __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    TraceBuffer_t &buffer = buffers[worker];
+    if (buffer.count == capacity) {
+      ++buffer.dropped;
+      return;
+    }
+    buffer.events[buffer.count++] = {time, id, kind};
+  }
+
+  // Export the trace in the Chrome trace-event JSON format.  Each strand
+  // becomes a complete event on the timeline of the worker that executed it,
+  // and each continuation that started on a different worker than its task
+  // ended on is marked as a steal.
+  bool write_chrome_json(const char *path) const {
+    FILE *out = fopen(path, "w");
+    if (!out)
+      return false;
+    fprintf(out,
+            "{\"displayTimeUnit\":\"ns\","
+            "\"otherData\":{\"timeUnit\":\"%s\"},\"traceEvents\":[\n",
+            TIME_UNIT);
+    bool first = true;
+    auto sep = [&]() {
+      if (!first)
+        fprintf(out, ",\n");
+      first = false;
+    };
+    for (unsigned w = 0; w < num_workers; ++w) {
+      sep();
+      fprintf(out,
+              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+              "\"args\":{\"name\":\"worker %u\"}}",
+              w, w);
+      const TraceBuffer_t &buffer = buffers[w];
+      const TraceEvent_t *open = nullptr;
+      const TraceEvent_t *prev = nullptr;
+      for (uint64_t i = 0; i < buffer.count; ++i) {
+        const TraceEvent_t &ev = buffer.events[i];
+        if (is_strand_begin(ev.kind)) {
+          if (TraceEventKind_t::CONTINUE == ev.kind &&
+              !(prev && TraceEventKind_t::TASK_EXIT == prev->kind &&
+                prev->id == ev.id)) {
+            sep();
+            fprintf(out,
+                    "{\"name\":\"steal\",\"cat\":\"steal\",\"ph\":\"i\","
+                    "\"s\":\"t\",\"ts\":%.3f,\"pid\":0,\"tid\":%u,"
+                    "\"args\":{\"detach\":%" PRId64 "}}",
+                    to_trace_time(ev.time), w, ev.id);
+          }
+          open = &ev;
+        } else if (open) {
+          sep();
+          fprintf(out,
+                  "{\"name\":\"%s %" PRId64 "\",\"cat\":\"strand\","
+                  "\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,"
+                  "\"tid\":%u,\"args\":{\"end\":\"%s %" PRId64 "\"}}",
+                  trace_event_name(open->kind), open->id,
+                  to_trace_time(open->time),
+                  to_trace_time(ev.time - open->time), w,
+                  trace_event_name(ev.kind), ev.id);
+          open = nullptr;
+        }
+        prev = &ev;
+      }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    return true;
+  }
+
+  // Export the trace in the compact binary format.
+  bool write_binary(const char *path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    out.write("CSTRACE1", 8);
+    write_value<uint32_t>(out, num_workers);
+    for (uint32_t w = 0; w < num_workers; ++w) {
+      const TraceBuffer_t &buffer = buffers[w];
+      write_value<uint32_t>(out, w);
+      write_value<uint64_t>(out, buffer.count);
+      // Write each field separately, so that the file does not depend on the
+      // padding of TraceEvent_t.
+      for (uint64_t i = 0; i < buffer.count; ++i) {
+        const TraceEvent_t &ev = buffer.events[i];
+        write_value<uint64_t>(out, ev.time);
+        write_value<int64_t>(out, ev.id);
+        write_value<uint8_t>(out, static_cast<uint8_t>(ev.kind));
+      }
+    }
+    return bool(out);
+  }
+
+  // Number of events recorded on threads that are not Cilk workers.
+  uint64_t num_dropped_nonworker() const { return dropped; }
+
+  // Number of events that did not fit in the buffers.
+  uint64_t num_dropped_overflow() const {
+    uint64_t total = 0;
+    for (unsigned w = 0; w < num_workers; ++w)
+      total += buffers[w].dropped;
+    return total;
+  }
+};
+
+#endif // INCLUDED_TIMELINE_TRACE_H
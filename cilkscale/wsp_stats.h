@@ -0,0 +1,86 @@
+// -*- C++ -*-
+#ifndef INCLUDED_WSP_STATS_H
+#define INCLUDED_WSP_STATS_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <cilk/cilkscale.h>
+
+// Statistics on the measurements passed to wsp_dump and wsp_record, which the
+// program can query while it runs through wsp_tag_stats and wsp_site_stats.
+//
+// Measurements are aggregated by tag, and by call site and tag.  Recording and
+// querying are rare compared to the hooks that maintain the shadow stack, so
+// the statistics are simply protected by a mutex.
+class WspStats_t {
+  struct Entry_t {
+    uint64_t count = 0;
+    wsp_t total = {0, 0, 0};
+    wsp_t last = {0, 0, 0};
+  };
+
+  std::mutex lock;
+  std::map<std::string, Entry_t> tags;
+  std::map<std::pair<uintptr_t, std::string>, Entry_t> sites;
+
+  static void add(Entry_t &entry, wsp_t wsp) {
+    ++entry.count;
+    entry.total.work += wsp.work;
+    entry.total.span += wsp.span;
+    entry.total.bspan += wsp.bspan;
+    entry.last = wsp;
+  }
+
+  static void fill(wsp_stats_t *stats, const std::string &tag, uintptr_t site,
+                   const Entry_t &entry) {
+    stats->tag = tag.c_str();
+    stats->site = reinterpret_cast<const void *>(site);
+    stats->count = entry.count;
+    stats->total = entry.total;
+    stats->last = entry.last;
+    stats->parallelism =
+        entry.total.span ? (double)entry.total.work / entry.total.span : 0.0;
+    stats->burdened_parallelism =
+        entry.total.bspan ? (double)entry.total.work / entry.total.bspan : 0.0;
+  }
+
+public:
+  void record(wsp_t wsp, const char *tag, const void *site) {
+    std::string key(tag ? tag : "");
+    std::lock_guard<std::mutex> guard(lock);
+    add(tags[key], wsp);
+    add(sites[std::make_pair(reinterpret_cast<uintptr_t>(site), key)], wsp);
+  }
+
+  bool get_tag(const char *tag, wsp_stats_t *stats) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto entry = tags.find(tag ? tag : "");
+    if (entry == tags.end())
+      return false;
+    fill(stats, entry->first, 0, entry->second);
+    return true;
+  }
+
+  uint64_t get_sites(wsp_stats_t *stats, uint64_t max_stats) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t i = 0;
+    for (const auto &entry : sites) {
+      if (i >= max_stats)
+        break;
+      fill(&stats[i++], entry.first.second, entry.first.first, entry.second);
+    }
+    return sites.size();
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> guard(lock);
+    tags.clear();
+    sites.clear();
+  }
+};
+
+#endif // INCLUDED_WSP_STATS_H
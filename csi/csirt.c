@@ -1,8 +1,11 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
 #include <stdatomic.h>
+#include <dlfcn.h>
+#include <link.h>
 #include <csi/csi.h>
 
 // Compile-time assert the property structs are 64 bits.
@@ -37,6 +40,8 @@ static_assert(sizeof(free_prop_t) == 8, "Size of free_prop_t is not 64 bits.");
 typedef struct {
     uint64_t num_entries;
     source_loc_t *entries;
+    // PC recorded for each entry, or 0 if none was recorded.
+    _Atomic uintptr_t *pcs;
 } fed_table_t;
 
 // A FED table index is an array of pointers to equally-sized FED
@@ -73,6 +78,8 @@ static_assert(sizeof(instrumentation_counts_t) ==
               sizeof(csi_id_t) * NUM_FED_TYPES,
               "Mismatch between NUM_FED_TYPES and size of "
               "instrumentation_counts_t");
+static_assert((int)CSI_NUM_FED_TYPES == (int)NUM_FED_TYPES,
+              "Mismatch between NUM_FED_TYPES and CSI_NUM_FED_TYPES");
 
 // A SizeInfo table is a flat list of SizeInfo entries, indexed by a CSI ID.
 typedef struct {
@@ -206,6 +213,8 @@ allocate_new_table_and_append_to_index(fed_table_index_t *index) {
   new_table->num_entries = 0;
   new_table->entries =
       (source_loc_t *)malloc(sizeof(source_loc_t) * NUM_ELEMENTS_PER_TABLE);
+  new_table->pcs = (_Atomic uintptr_t *)calloc(NUM_ELEMENTS_PER_TABLE,
+                                               sizeof(uintptr_t));
   index->num_tables++;
 
   return new_table;
@@ -356,6 +365,164 @@ const sizeinfo_t *get_sizeinfo_entry(sizeinfo_type_t sizeinfo_type,
     }
 }
 
+// ------------------------------------------------------------------------
+// PC index
+// ------------------------------------------------------------------------
+
+// The PC index maps the PCs recorded for the IDs of one type back to those
+// IDs.  The index is a sorted array of (PC, ID) pairs, in which each pair
+// covers the PCs from its PC up to the next recorded PC, but not past the end
+// of the function containing its PC.  Each ID has at most one recorded PC, so
+// the index has at most one pair per ID.
+//
+// Newly recorded PCs are appended to a pending list, under pc_lock, and merged
+// into a new index by the next lookup.  Lookups search the current index
+// without locking.  An index that has been replaced is retired and freed once
+// no lookup is reading any index.
+
+typedef struct {
+  uintptr_t pc;
+  // End of the range of PCs that this entry can cover.
+  uintptr_t end;
+  csi_id_t id;
+} pc_entry_t;
+
+// Maximum number of bytes past a recorded PC that its entry covers, when the
+// size of the function containing that PC is unknown.
+static const uintptr_t MAX_PC_RANGE = 1024;
+
+typedef struct pc_index_t {
+  uint64_t num_entries;
+  struct pc_index_t *next_retired;
+  pc_entry_t entries[];
+} pc_index_t;
+
+typedef struct {
+  _Atomic(pc_index_t *) index;
+  // PCs recorded since the index was last rebuilt.
+  _Atomic uint64_t num_pending;
+  uint64_t pending_capacity;
+  pc_entry_t *pending;
+} pc_table_t;
+
+static pc_table_t pc_tables[NUM_FED_TYPES];
+
+// Lock protecting the pending lists and the list of retired indices.
+static _Atomic int32_t pc_lock = 0;
+
+// Number of lookups currently reading an index.
+static _Atomic uint64_t pc_readers = 0;
+
+static pc_index_t *retired_pc_indices = NULL;
+
+static inline void acquire_pc_lock() {
+  int32_t expected = 0;
+  while (!atomic_compare_exchange_weak(&pc_lock, &expected, 1))
+    expected = 0;
+}
+
+static inline void release_pc_lock() { atomic_store(&pc_lock, 0); }
+
+static int compare_pc_entries(const void *a, const void *b) {
+  uintptr_t pc_a = ((const pc_entry_t *)a)->pc;
+  uintptr_t pc_b = ((const pc_entry_t *)b)->pc;
+  return (pc_a > pc_b) - (pc_a < pc_b);
+}
+
+// Return the end of the range of PCs that an entry for pc can cover: the end of
+// the function containing pc, if the symbol table records its size, or else
+// MAX_PC_RANGE bytes past pc.
+static uintptr_t get_pc_range_end(uintptr_t pc) {
+  Dl_info info;
+  void *sym_ent = NULL;
+  if (dladdr1((void *)pc, &info, &sym_ent, RTLD_DL_SYMENT) && sym_ent &&
+      info.dli_saddr) {
+    const ElfW(Sym) *sym = (const ElfW(Sym) *)sym_ent;
+    uintptr_t end = (uintptr_t)info.dli_saddr + sym->st_size;
+    if (end > pc)
+      return end;
+  }
+  return pc + MAX_PC_RANGE < pc ? UINTPTR_MAX : pc + MAX_PC_RANGE;
+}
+
+// Add a newly recorded PC to the pending list of its table.  Must be called
+// with pc_lock held.
+static void add_pending_pc(pc_table_t *table, uintptr_t pc, uintptr_t end,
+                           csi_id_t id) {
+  uint64_t num_pending = atomic_load(&table->num_pending);
+  if (num_pending == table->pending_capacity) {
+    table->pending_capacity =
+        table->pending_capacity ? 2 * table->pending_capacity : 64;
+    table->pending = (pc_entry_t *)realloc(
+        table->pending, table->pending_capacity * sizeof(pc_entry_t));
+    assert(table->pending != NULL);
+  }
+  table->pending[num_pending].pc = pc;
+  table->pending[num_pending].end = end;
+  table->pending[num_pending].id = id;
+  atomic_store(&table->num_pending, num_pending + 1);
+}
+
+// Merge the pending PCs of table into a new index, and retire the old index.
+// Must be called with pc_lock held.
+static void rebuild_pc_index(pc_table_t *table) {
+  uint64_t num_pending = atomic_load(&table->num_pending);
+  if (num_pending == 0)
+    return;
+  qsort(table->pending, num_pending, sizeof(pc_entry_t), compare_pc_entries);
+
+  pc_index_t *old_index = atomic_load(&table->index);
+  uint64_t num_old = old_index ? old_index->num_entries : 0;
+  pc_index_t *new_index = (pc_index_t *)malloc(
+      sizeof(pc_index_t) + (num_old + num_pending) * sizeof(pc_entry_t));
+  assert(new_index != NULL);
+  new_index->next_retired = NULL;
+
+  uint64_t i = 0, j = 0, n = 0;
+  while (i < num_old || j < num_pending) {
+    if (j == num_pending ||
+        (i < num_old && old_index->entries[i].pc <= table->pending[j].pc))
+      new_index->entries[n++] = old_index->entries[i++];
+    else
+      new_index->entries[n++] = table->pending[j++];
+  }
+  new_index->num_entries = n;
+
+  atomic_store(&table->index, new_index);
+  atomic_store(&table->num_pending, 0);
+
+  if (old_index) {
+    old_index->next_retired = retired_pc_indices;
+    retired_pc_indices = old_index;
+  }
+  // A lookup that started before the new index was published might still be
+  // reading a retired index.
+  if (atomic_load(&pc_readers) == 0) {
+    while (retired_pc_indices) {
+      pc_index_t *next = retired_pc_indices->next_retired;
+      free(retired_pc_indices);
+      retired_pc_indices = next;
+    }
+  }
+}
+
+// Return the ID in index whose PC is the closest at or below pc, if pc is
+// within the range of that ID's entry.
+static csi_id_t search_pc_index(const pc_index_t *index, uintptr_t pc) {
+  uint64_t lo = 0, hi = index->num_entries;
+  // Find the first entry whose PC is above pc.
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (index->entries[mid].pc <= pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0 || pc >= index->entries[lo - 1].end)
+    return UNKNOWN_CSI_ID;
+  return index->entries[lo - 1].id;
+}
+
 // ------------------------------------------------------------------------
 // External function definitions, including CSIRT API functions.
 // ------------------------------------------------------------------------
@@ -565,4 +732,56 @@ const char *__csi_get_free_str(const free_prop_t prop) {
   return free_str[prop.free_ty];
 }
 
+CSIRT_API
+void __csi_record_pc(const csi_fed_type_t type, const csi_id_t id,
+                     const uintptr_t pc) {
+  if (!fed_tables_initialized || (unsigned)type >= NUM_FED_TYPES || id < 0 ||
+      (uint64_t)id >= fed_tables[type].num_total_entries || !pc)
+    return;
+
+  fed_table_t *table = get_table_for_id(&fed_tables[type], id);
+  _Atomic uintptr_t *slot = &table->pcs[id % NUM_ELEMENTS_PER_TABLE];
+  // Keep only the first PC recorded for this ID.  Check the slot before trying
+  // to claim it, so that repeated calls from a hook do not write to it.
+  uintptr_t expected = 0;
+  if (atomic_load_explicit(slot, memory_order_relaxed) ||
+      !atomic_compare_exchange_strong(slot, &expected, pc))
+    return;
+
+  // Look up the function bounds before taking the lock.
+  uintptr_t end = get_pc_range_end(pc);
+  acquire_pc_lock();
+  add_pending_pc(&pc_tables[type], pc, end, id);
+  release_pc_lock();
+}
+
+CSIRT_API
+uintptr_t __csi_get_pc(const csi_fed_type_t type, const csi_id_t id) {
+  if (!fed_tables_initialized || (unsigned)type >= NUM_FED_TYPES || id < 0 ||
+      (uint64_t)id >= fed_tables[type].num_total_entries)
+    return 0;
+
+  fed_table_t *table = get_table_for_id(&fed_tables[type], id);
+  return atomic_load(&table->pcs[id % NUM_ELEMENTS_PER_TABLE]);
+}
+
+CSIRT_API
+csi_id_t __csi_get_id_for_pc(const csi_fed_type_t type, const uintptr_t pc) {
+  if ((unsigned)type >= NUM_FED_TYPES)
+    return UNKNOWN_CSI_ID;
+
+  pc_table_t *table = &pc_tables[type];
+  if (atomic_load(&table->num_pending)) {
+    acquire_pc_lock();
+    rebuild_pc_index(table);
+    release_pc_lock();
+  }
+
+  atomic_fetch_add(&pc_readers, 1);
+  const pc_index_t *index = atomic_load(&table->index);
+  csi_id_t id = index ? search_pc_index(index, pc) : UNKNOWN_CSI_ID;
+  atomic_fetch_sub(&pc_readers, 1);
+  return id;
+}
+
 EXTERN_C_END
@@ -2,6 +2,8 @@
 #ifndef INCLUDED_CILK_CILKSAN_H
 #define INCLUDED_CILK_CILKSAN_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 
 #define CILKSAN_EXTERN_C extern "C"
@@ -21,6 +23,9 @@
 CILKSAN_EXTERN_C void __cilksan_enable_checking(void) CILKSAN_NOTHROW;
 CILKSAN_EXTERN_C void __cilksan_disable_checking(void) CILKSAN_NOTHROW;
 CILKSAN_EXTERN_C bool __cilksan_is_checking_enabled(void) CILKSAN_NOTHROW;
+CILKSAN_EXTERN_C void __cilksan_phase_boundary(void) CILKSAN_NOTHROW;
+CILKSAN_EXTERN_C void __cilksan_watch(const void *addr,
+                                      size_t size) CILKSAN_NOTHROW;
 
 CILKSAN_EXTERN_C void __cilksan_acquire_lock(const void *mutex) CILKSAN_NOTHROW;
 CILKSAN_EXTERN_C void __cilksan_release_lock(const void *mutex) CILKSAN_NOTHROW;
@@ -40,6 +45,9 @@ extern "C" {
 static inline void __cilksan_enable_checking(void) CILKSAN_NOTHROW {}
 static inline void __cilksan_disable_checking(void) CILKSAN_NOTHROW {}
 static inline bool __cilksan_is_checking_enabled(void) { return false; }
+static inline void __cilksan_phase_boundary(void) CILKSAN_NOTHROW {}
+static inline void __cilksan_watch(const void *addr,
+                                   size_t size) CILKSAN_NOTHROW {}
 
 static inline void __cilksan_acquire_lock(const void *mutex) CILKSAN_NOTHROW {}
 static inline void __cilksan_release_lock(const void *mutex) CILKSAN_NOTHROW {}
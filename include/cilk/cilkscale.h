@@ -15,6 +15,26 @@ typedef struct wsp_t {
   raw_duration_t bspan;
 } wsp_t;
 
+// Statistics on the measurements recorded with a tag, and optionally at a call
+// site, by wsp_dump or wsp_record.  The tag string remains valid until the
+// next call to wsp_reset_stats.
+typedef struct wsp_stats_t {
+  const char *tag;
+  // Return address of the call to wsp_dump or wsp_record, or NULL for the
+  // statistics of all call sites with this tag.
+  const void *site;
+  // Number of measurements.
+  uint64_t count;
+  // Sum of the measurements.
+  wsp_t total;
+  // Most recent measurement.
+  wsp_t last;
+  // Parallelism and burdened parallelism of the sum of the measurements, or 0
+  // if the span is not measured.
+  double parallelism;
+  double burdened_parallelism;
+} wsp_stats_t;
+
 #ifdef __cplusplus
 
 #include <fstream>
@@ -94,6 +114,18 @@ static inline wsp_t wsp_sub(wsp_t lhs, wsp_t rhs) CILKSCALE_NOTHROW {
 
 static inline void wsp_dump(wsp_t wsp, const char *tag) { return; }
 
+static inline void wsp_record(wsp_t wsp, const char *tag) { return; }
+
+static inline int wsp_tag_stats(const char *tag, wsp_stats_t *stats) {
+  return 0;
+}
+
+static inline uint64_t wsp_site_stats(wsp_stats_t *stats, uint64_t max_stats) {
+  return 0;
+}
+
+static inline void wsp_reset_stats(void) { return; }
+
 #ifdef __cplusplus
 } // extern "C"
 #endif // __cplusplus
@@ -111,6 +143,26 @@ wsp_t wsp_sub(wsp_t lhs, wsp_t rhs) CILKSCALE_NOTHROW;
 CILKSCALE_EXTERN_C
 void wsp_dump(wsp_t wsp, const char *tag);
 
+// Record the measurement wsp with the given tag, like wsp_dump, but without
+// printing it.
+CILKSCALE_EXTERN_C
+void wsp_record(wsp_t wsp, const char *tag);
+
+// Get the statistics of all measurements recorded with tag.  Returns nonzero
+// if any measurement has been recorded with tag.
+CILKSCALE_EXTERN_C
+int wsp_tag_stats(const char *tag, wsp_stats_t *stats);
+
+// Get the statistics of the measurements recorded at each call site with each
+// tag, storing up to max_stats entries in stats.  Returns the number of
+// entries available.
+CILKSCALE_EXTERN_C
+uint64_t wsp_site_stats(wsp_stats_t *stats, uint64_t max_stats);
+
+// Discard all recorded statistics, e.g., at the end of a warm-up phase.
+CILKSCALE_EXTERN_C
+void wsp_reset_stats(void);
+
 #endif // #ifndef __cilkscale__
 
 #endif // INCLUDED_CILK_CILKSCALE_H
@@ -347,4 +347,45 @@ const char *__csan_get_allocfn_str(const allocfn_prop_t prop);
 __attribute__((pure))
 const char *__csan_get_free_str(const free_prop_t prop);
 
+// Types of CSI IDs.  Each type has its own ID space and front-end data table.
+typedef enum {
+  CSI_FED_FUNCTION,
+  CSI_FED_FUNCTION_EXIT,
+  CSI_FED_LOOP,
+  CSI_FED_LOOP_EXIT,
+  CSI_FED_BASICBLOCK,
+  CSI_FED_CALLSITE,
+  CSI_FED_LOAD,
+  CSI_FED_STORE,
+  CSI_FED_DETACH,
+  CSI_FED_TASK,
+  CSI_FED_TASK_EXIT,
+  CSI_FED_DETACH_CONTINUE,
+  CSI_FED_SYNC,
+  CSI_FED_ALLOCA,
+  CSI_FED_ALLOCFN,
+  CSI_FED_FREE,
+  CSI_NUM_FED_TYPES // Must be last
+} csi_fed_type_t;
+
+// Mapping between program counters and CSI IDs.  The CSI runtime learns the PC
+// of an instrumented instruction when a tool records it, typically the first
+// time the hook for that ID runs, by passing the return address of the hook.
+//
+// Record pc as the program counter of the given ID.  Only the first PC recorded
+// for an ID is kept.
+void __csi_record_pc(const csi_fed_type_t type, const csi_id_t id,
+                     const uintptr_t pc);
+// Get the PC recorded for the given ID, or 0 if none was recorded.
+uintptr_t __csi_get_pc(const csi_fed_type_t type, const csi_id_t id);
+// Get the ID of the given type whose recorded PC is the closest at or below pc,
+// or UNKNOWN_CSI_ID if there is none or if pc lies past the end of the function
+// containing that recorded PC.  When the function's size is unknown, a recorded
+// PC covers at most 1024 bytes.  Lookups take O(log n) time in the number of
+// recorded PCs and do not lock, except that the first lookup after new PCs are
+// recorded adds them to the index.  Lookups are therefore not
+// async-signal safe; a sampling tool should save the sampled PCs and look them
+// up later.
+csi_id_t __csi_get_id_for_pc(const csi_fed_type_t type, const uintptr_t pc);
+
 EXTERN_C_END
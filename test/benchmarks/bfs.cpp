@@ -0,0 +1,68 @@
+// Level-synchronous breadth-first search of a random graph.  Each level's
+// frontier is gathered with a reducer.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <cilk/cilk.h>
+
+using frontier_t = std::vector<int>;
+
+static void frontier_identity(void *view) { new (view) frontier_t(); }
+
+static void frontier_reduce(void *left_view, void *right_view) {
+  frontier_t *left = static_cast<frontier_t *>(left_view);
+  frontier_t *right = static_cast<frontier_t *>(right_view);
+  left->insert(left->end(), right->begin(), right->end());
+  right->~frontier_t();
+}
+
+int main(int argc, char *argv[]) {
+  int n = (argc > 1) ? atoi(argv[1]) : (1 << 18);
+  int degree = (argc > 2) ? atoi(argv[2]) : 8;
+
+  // Build a random graph in compressed sparse row form.
+  std::vector<long> offsets(n + 1);
+  std::vector<int> edges((long)n * degree);
+  uint64_t x = 88172645463325252UL;
+  for (int u = 0; u < n; ++u) {
+    offsets[u] = (long)u * degree;
+    for (int e = 0; e < degree; ++e) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      edges[(long)u * degree + e] = (int)(x % (uint64_t)n);
+    }
+  }
+  offsets[n] = (long)n * degree;
+
+  std::vector<int> dist(n, -1);
+  int *d = dist.data();
+  d[0] = 0;
+  frontier_t frontier = {0};
+  int level = 0;
+  long reached = 1;
+  while (!frontier.empty()) {
+    frontier_t cilk_reducer(frontier_identity, frontier_reduce) next;
+    cilk_for (long f = 0; f < (long)frontier.size(); ++f) {
+      int u = frontier[f];
+      for (long e = offsets[u]; e < offsets[u + 1]; ++e) {
+        int v = edges[e];
+        int unvisited = -1;
+        if (__atomic_load_n(&d[v], __ATOMIC_RELAXED) == -1 &&
+            __atomic_compare_exchange_n(&d[v], &unvisited, level + 1, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+          next.push_back(v);
+      }
+    }
+    frontier.swap(next);
+    reached += frontier.size();
+    if (!frontier.empty())
+      ++level;
+  }
+  printf("bfs(%d, %d) reached %ld vertices in %d levels\n", n, degree, reached,
+         level);
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Cilksort: parallel merge sort with a parallel, divide-and-conquer merge.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <cilk/cilk.h>
+
+using elm = long;
+
+static constexpr long SORT_BASE = 1024;
+static constexpr long MERGE_BASE = 2048;
+
+// Merge the sorted ranges [a, a_end) and [b, b_end) into out.
+static void merge(const elm *a, const elm *a_end, const elm *b,
+                  const elm *b_end, elm *out) {
+  long na = a_end - a, nb = b_end - b;
+  if (na < nb) {
+    std::swap(a, b);
+    std::swap(a_end, b_end);
+    std::swap(na, nb);
+  }
+  if (na + nb <= MERGE_BASE || 0 == nb) {
+    std::merge(a, a_end, b, b_end, out);
+    return;
+  }
+  const elm *a_mid = a + na / 2;
+  const elm *b_mid = std::lower_bound(b, b_end, *a_mid);
+  elm *out_mid = out + (a_mid - a) + (b_mid - b);
+  cilk_spawn merge(a, a_mid, b, b_mid, out);
+  merge(a_mid, a_end, b_mid, b_end, out_mid);
+  cilk_sync;
+}
+
+// Sort [a, a + n), using tmp as scratch space.
+static void cilksort(elm *a, elm *tmp, long n) {
+  if (n <= SORT_BASE) {
+    std::sort(a, a + n);
+    return;
+  }
+  long q = n / 4;
+  elm *a1 = a, *a2 = a + q, *a3 = a + 2 * q, *a4 = a + 3 * q;
+  elm *t1 = tmp, *t2 = tmp + q, *t3 = tmp + 2 * q, *t4 = tmp + 3 * q;
+  cilk_spawn cilksort(a1, t1, q);
+  cilk_spawn cilksort(a2, t2, q);
+  cilk_spawn cilksort(a3, t3, q);
+  cilksort(a4, t4, n - 3 * q);
+  cilk_sync;
+  cilk_spawn merge(a1, a1 + q, a2, a2 + q, t1);
+  merge(a3, a3 + q, a4, a + n, t3);
+  cilk_sync;
+  merge(t1, t1 + 2 * q, t3, tmp + n, a);
+}
+
+int main(int argc, char *argv[]) {
+  long n = (argc > 1) ? atol(argv[1]) : (1L << 21);
+  std::vector<elm> a(n), tmp(n);
+  uint64_t x = 88172645463325252UL;
+  for (long i = 0; i < n; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    a[i] = (elm)(x % (uint64_t)n);
+  }
+  cilksort(a.data(), tmp.data(), n);
+  bool sorted = std::is_sorted(a.begin(), a.end());
+  printf("cilksort(%ld) %s\n", n, sorted ? "sorted" : "NOT SORTED");
+  return sorted ? 0 : 1;
+}
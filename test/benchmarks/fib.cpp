@@ -0,0 +1,20 @@
+// Recursive Fibonacci: fine-grained spawns with almost no memory traffic.
+#include <cstdio>
+#include <cstdlib>
+
+#include <cilk/cilk.h>
+
+static long fib(int n) {
+  if (n < 2)
+    return n;
+  long x = cilk_spawn fib(n - 1);
+  long y = fib(n - 2);
+  cilk_sync;
+  return x + y;
+}
+
+int main(int argc, char *argv[]) {
+  int n = (argc > 1) ? atoi(argv[1]) : 30;
+  printf("fib(%d) = %ld\n", n, fib(n));
+  return 0;
+}
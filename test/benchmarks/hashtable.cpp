@@ -0,0 +1,89 @@
+// Lock-heavy hash table: parallel inserts into and lookups in a chained hash
+// table whose buckets are protected by a small number of striped mutexes.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <vector>
+
+#include <cilk/cilk.h>
+#include <cilk/opadd_reducer.h>
+
+class HashTable_t {
+  struct Node_t {
+    uint64_t key;
+    Node_t *next;
+  };
+
+  static constexpr int NUM_LOCKS = 64;
+  std::vector<Node_t *> buckets;
+  pthread_mutex_t locks[NUM_LOCKS];
+
+  size_t bucket(uint64_t key) const {
+    return (key * 0x9e3779b97f4a7c15UL >> 17) % buckets.size();
+  }
+
+public:
+  HashTable_t(size_t nbuckets) : buckets(nbuckets, nullptr) {
+    for (int i = 0; i < NUM_LOCKS; ++i)
+      pthread_mutex_init(&locks[i], nullptr);
+  }
+
+  ~HashTable_t() {
+    for (Node_t *head : buckets)
+      while (head) {
+        Node_t *next = head->next;
+        delete head;
+        head = next;
+      }
+    for (int i = 0; i < NUM_LOCKS; ++i)
+      pthread_mutex_destroy(&locks[i]);
+  }
+
+  // Insert key, and return true if it was not already present.
+  bool insert(uint64_t key) {
+    size_t b = bucket(key);
+    pthread_mutex_t *lock = &locks[b % NUM_LOCKS];
+    pthread_mutex_lock(lock);
+    for (Node_t *n = buckets[b]; n; n = n->next)
+      if (n->key == key) {
+        pthread_mutex_unlock(lock);
+        return false;
+      }
+    buckets[b] = new Node_t{key, buckets[b]};
+    pthread_mutex_unlock(lock);
+    return true;
+  }
+
+  bool contains(uint64_t key) {
+    size_t b = bucket(key);
+    pthread_mutex_t *lock = &locks[b % NUM_LOCKS];
+    pthread_mutex_lock(lock);
+    bool found = false;
+    for (Node_t *n = buckets[b]; n && !found; n = n->next)
+      found = (n->key == key);
+    pthread_mutex_unlock(lock);
+    return found;
+  }
+};
+
+int main(int argc, char *argv[]) {
+  long n = (argc > 1) ? atol(argv[1]) : (1L << 19);
+  HashTable_t table(n / 4);
+
+  // Insert keys with many duplicates, then look up a mix of present and
+  // absent keys.
+  cilk::opadd_reducer<long> inserted = 0;
+  cilk_for (long i = 0; i < n; ++i)
+    if (table.insert((uint64_t)(i * 7) % (uint64_t)(n / 2)))
+      inserted += 1;
+
+  cilk::opadd_reducer<long> found = 0;
+  cilk_for (long i = 0; i < n; ++i)
+    if (table.contains((uint64_t)i))
+      found += 1;
+
+  printf("hashtable(%ld) inserted %ld, found %ld\n", n, (long)inserted,
+         (long)found);
+  return 0;
+}
@@ -0,0 +1,34 @@
+// Heat diffusion: Jacobi iterations of a five-point stencil on an n x n grid.
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include <cilk/cilk.h>
+
+int main(int argc, char *argv[]) {
+  int n = (argc > 1) ? atoi(argv[1]) : 512;
+  int steps = (argc > 2) ? atoi(argv[2]) : 50;
+  std::vector<double> cur(n * n, 0.0), next(n * n, 0.0);
+  // Hold the top edge at a fixed temperature.
+  for (int j = 0; j < n; ++j)
+    cur[j] = next[j] = 100.0;
+
+  for (int t = 0; t < steps; ++t) {
+    const double *u = cur.data();
+    double *v = next.data();
+    cilk_for (int i = 1; i < n - 1; ++i)
+      for (int j = 1; j < n - 1; ++j)
+        v[i * n + j] = u[i * n + j] +
+                       0.2 * (u[(i - 1) * n + j] + u[(i + 1) * n + j] +
+                              u[i * n + j - 1] + u[i * n + j + 1] -
+                              4.0 * u[i * n + j]);
+    std::swap(cur, next);
+  }
+
+  double total = 0.0;
+  for (double x : cur)
+    total += x;
+  printf("heat(%d, %d) total = %.6f\n", n, steps, total);
+  return 0;
+}
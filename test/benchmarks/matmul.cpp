@@ -0,0 +1,56 @@
+// Divide-and-conquer matrix multiplication, C += A * B, on row-major n x n
+// matrices.
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <cilk/cilk.h>
+
+static constexpr int BASE = 32;
+
+static void matmul(double *C, const double *A, const double *B, int n,
+                   int stride) {
+  if (n <= BASE) {
+    for (int i = 0; i < n; ++i)
+      for (int k = 0; k < n; ++k)
+        for (int j = 0; j < n; ++j)
+          C[i * stride + j] += A[i * stride + k] * B[k * stride + j];
+    return;
+  }
+  int h = n / 2;
+  const double *A11 = A, *A12 = A + h, *A21 = A + h * stride,
+               *A22 = A + h * stride + h;
+  const double *B11 = B, *B12 = B + h, *B21 = B + h * stride,
+               *B22 = B + h * stride + h;
+  double *C11 = C, *C12 = C + h, *C21 = C + h * stride,
+         *C22 = C + h * stride + h;
+  cilk_spawn matmul(C11, A11, B11, h, stride);
+  cilk_spawn matmul(C12, A11, B12, h, stride);
+  cilk_spawn matmul(C21, A21, B11, h, stride);
+  matmul(C22, A21, B12, h, stride);
+  cilk_sync;
+  cilk_spawn matmul(C11, A12, B21, h, stride);
+  cilk_spawn matmul(C12, A12, B22, h, stride);
+  cilk_spawn matmul(C21, A22, B21, h, stride);
+  matmul(C22, A22, B22, h, stride);
+  cilk_sync;
+}
+
+int main(int argc, char *argv[]) {
+  int n = (argc > 1) ? atoi(argv[1]) : 256;
+  if (n < BASE || (n & (n - 1))) {
+    fprintf(stderr, "Usage: %s [n, a power of 2 >= %d]\n", argv[0], BASE);
+    return 1;
+  }
+  std::vector<double> A(n * n), B(n * n), C(n * n, 0.0);
+  for (int i = 0; i < n * n; ++i) {
+    A[i] = (double)(i % 7);
+    B[i] = (double)(i % 5);
+  }
+  matmul(C.data(), A.data(), B.data(), n, n);
+  double trace = 0.0;
+  for (int i = 0; i < n; ++i)
+    trace += C[i * n + i];
+  printf("matmul(%d) trace = %.0f\n", n, trace);
+  return 0;
+}
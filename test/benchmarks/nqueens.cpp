@@ -0,0 +1,56 @@
+// N-queens: counts all solutions, copying the partial board into each spawned
+// task.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <cilk/cilk.h>
+#include <cilk/opadd_reducer.h>
+
+using count_t = cilk::opadd_reducer<long>;
+
+static bool ok(int n, const char *a) {
+  for (int i = 0; i < n; ++i) {
+    char p = a[i];
+    for (int j = i + 1; j < n; ++j) {
+      char q = a[j];
+      if (q == p || q == p - (j - i) || q == p + (j - i))
+        return false;
+    }
+  }
+  return true;
+}
+
+static void nqueens(int n, int j, const char *a, count_t &count);
+
+// Try placing a queen in row j, column i.
+static void place(int n, int j, const char *a, int i, count_t &count) {
+  char b[32];
+  memcpy(b, a, j);
+  b[j] = i;
+  if (ok(j + 1, b))
+    nqueens(n, j + 1, b, count);
+}
+
+static void nqueens(int n, int j, const char *a, count_t &count) {
+  if (n == j) {
+    count += 1;
+    return;
+  }
+  for (int i = 0; i < n; ++i)
+    cilk_spawn place(n, j, a, i, count);
+  cilk_sync;
+}
+
+int main(int argc, char *argv[]) {
+  int n = (argc > 1) ? atoi(argv[1]) : 10;
+  if (n < 1 || n > 32) {
+    fprintf(stderr, "Usage: %s [n <= 32]\n", argv[0]);
+    return 1;
+  }
+  char a[32] = {0};
+  count_t count = 0;
+  nqueens(n, 0, a, count);
+  printf("nqueens(%d) = %ld\n", n, (long)count);
+  return 0;
+}
@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+"""Measure the overhead of the Cilktools on a suite of Cilk programs.
+
+Each benchmark is compiled without instrumentation and once for each tool.
+Each build is then run several times.  The best running time and the
+corresponding peak resident set size of each tool build are compared against
+those of the uninstrumented build.  The resulting slowdown and peak-RSS ratios
+are written to a JSON file.  A tool build must print the same output as the
+uninstrumented build, or the benchmark fails.
+
+If a baselines file is given, each ratio is checked against the stored ratio
+for that benchmark and tool.  A ratio that exceeds its baseline by more than
+the tolerance is reported as a regression, and the runner exits with a nonzero
+status.  Ratios that have no stored baseline are reported but never fail.
+Baselines are machine-specific.  Record them on a reference machine with
+--update-baselines, which stores the ratios measured by that run.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCHMARKS = ['fib', 'nqueens', 'cilksort', 'matmul', 'heat', 'bfs',
+              'hashtable']
+
+# Compiler flags for each build, in addition to the common flags.
+TOOL_FLAGS = {
+    'none': [],
+    'cilksan': ['-fsanitize=cilk'],
+    'cilkscale': ['-fcilktool=cilkscale'],
+    'cilkscale-instructions': ['-fcilktool=cilkscale-instructions'],
+    'cilkscale-benchmark': ['-fcilktool=cilkscale-benchmark'],
+}
+
+COMMON_FLAGS = ['-fopencilk', '-O3', '-g']
+
+
+def parse_list(value, known, what):
+    items = [item for item in value.split(',') if item]
+    for item in items:
+        if item not in known:
+            sys.exit('error: unknown %s %r; expected one of %s' %
+                     (what, item, ', '.join(sorted(known))))
+    return items
+
+
+def compile_benchmark(args, name, tool):
+    source = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                          name + '.cpp')
+    binary = os.path.join(args.build_dir, '%s.%s' % (name, tool))
+    cmd = ([args.cc] + args.cxx_mode + COMMON_FLAGS + TOOL_FLAGS[tool] +
+           args.cflags + [source, '-o', binary])
+    if args.verbose:
+        print(' '.join(cmd))
+    result = subprocess.run(cmd, stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0:
+        print(result.stdout, end='')
+        return None
+    return binary
+
+
+def run_once(args, binary):
+    """Run binary once, and return its output, time in seconds, and peak RSS in
+    kilobytes, or None if it failed."""
+    env = dict(os.environ)
+    if args.workers:
+        env['CILK_NWORKERS'] = str(args.workers)
+    with tempfile.TemporaryDirectory(dir=args.build_dir) as tmp:
+        # Keep the Cilkscale reports out of the program's output.
+        env['CILKSCALE_OUT'] = os.path.join(tmp, 'cilkscale.csv')
+        out_path = os.path.join(tmp, 'stdout')
+        err_path = os.path.join(tmp, 'stderr')
+        with open(out_path, 'w') as out, open(err_path, 'w') as err:
+            start = time.perf_counter()
+            proc = subprocess.Popen([binary], stdout=out, stderr=err, env=env)
+            _, status, usage = os.wait4(proc.pid, 0)
+            elapsed = time.perf_counter() - start
+        with open(out_path) as out:
+            output = out.read()
+        if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+            with open(err_path) as err:
+                sys.stdout.write(err.read())
+            print('error: %s failed with wait status %d' % (binary, status))
+            return None
+    # ru_maxrss is in kilobytes on Linux, but in bytes on macOS.
+    rss = usage.ru_maxrss
+    if sys.platform == 'darwin':
+        rss //= 1024
+    return output, elapsed, rss
+
+
+def measure(args, binary):
+    """Run binary args.repeat times and return its output, best time, and the
+    peak RSS of that run."""
+    best = None
+    for _ in range(args.repeat):
+        result = run_once(args, binary)
+        if result is None:
+            return None
+        if best is not None and result[0] != best[0]:
+            print('error: %s output differs between runs' % binary)
+            return None
+        if best is None or result[1] < best[1]:
+            best = result
+    return best
+
+
+def check(name, tool, metric, value, baselines, tolerance):
+    """Return True if value is within tolerance of its stored baseline."""
+    limit = baselines.get(name, {}).get(tool, {}).get(metric)
+    if limit is None:
+        print('  %-24s %-10s %8.2fx  (no baseline)' % (tool, metric, value))
+        return True
+    ok = value <= limit * (1.0 + tolerance)
+    print('  %-24s %-10s %8.2fx  baseline %.2fx%s' %
+          (tool, metric, value, limit, '' if ok else '  REGRESSION'))
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--cc', required=True,
+                        help='OpenCilk compiler to build the benchmarks with')
+    parser.add_argument('--cflags', default='',
+                        help='additional compiler flags')
+    parser.add_argument('--build-dir', default='.',
+                        help='directory for the benchmark binaries')
+    parser.add_argument('--benchmarks', default=','.join(BENCHMARKS),
+                        help='comma-separated list of benchmarks to run')
+    parser.add_argument('--tools',
+                        default=','.join(t for t in TOOL_FLAGS if t != 'none'),
+                        help='comma-separated list of tools to measure')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='number of runs of each build')
+    parser.add_argument('--workers', type=int, default=0,
+                        help='value of CILK_NWORKERS for each run')
+    parser.add_argument('--output', default='benchmark-results.json',
+                        help='JSON file to write the results to')
+    parser.add_argument('--baselines',
+                        help='JSON file of baseline ratios to check against')
+    parser.add_argument('--tolerance', type=float, default=0.25,
+                        help='allowed relative increase over a baseline ratio')
+    parser.add_argument('--update-baselines', action='store_true',
+                        help='store the measured ratios as the baselines')
+    parser.add_argument('-v', '--verbose', action='store_true')
+    args = parser.parse_args()
+
+    benchmarks = parse_list(args.benchmarks, BENCHMARKS, 'benchmark')
+    tools = parse_list(args.tools, TOOL_FLAGS, 'tool')
+    args.cflags = args.cflags.split()
+    # Compile C++ with a C compiler driver, as the lit tests do.
+    args.cxx_mode = ([] if args.cc.endswith('++') else ['--driver-mode=g++'])
+    os.makedirs(args.build_dir, exist_ok=True)
+
+    baselines = {}
+    if args.baselines and os.path.exists(args.baselines):
+        with open(args.baselines) as f:
+            baselines = json.load(f)
+
+    results = {}
+    failures = []
+    for name in benchmarks:
+        print('%s:' % name)
+        binary = compile_benchmark(args, name, 'none')
+        base = binary and measure(args, binary)
+        if not base:
+            failures.append('%s (uninstrumented)' % name)
+            continue
+        base_output, base_time, base_rss = base
+        entry = {'none': {'time': base_time, 'max_rss_kb': base_rss}}
+        for tool in tools:
+            binary = compile_benchmark(args, name, tool)
+            measured = binary and measure(args, binary)
+            if not measured:
+                failures.append('%s (%s)' % (name, tool))
+                continue
+            output, elapsed, rss = measured
+            if output != base_output:
+                print('error: %s output differs with %s' % (name, tool))
+                failures.append('%s (%s output)' % (name, tool))
+                continue
+            slowdown = elapsed / base_time
+            rss_ratio = float(rss) / base_rss
+            entry[tool] = {'time': elapsed, 'max_rss_kb': rss,
+                           'slowdown': slowdown, 'rss_ratio': rss_ratio}
+            if not check(name, tool, 'slowdown', slowdown, baselines,
+                         args.tolerance):
+                failures.append('%s (%s slowdown)' % (name, tool))
+            if not check(name, tool, 'rss_ratio', rss_ratio, baselines,
+                         args.tolerance):
+                failures.append('%s (%s peak RSS)' % (name, tool))
+        results[name] = entry
+
+    with open(args.output, 'w') as f:
+        json.dump({'compiler': args.cc, 'workers': args.workers,
+                   'repeat': args.repeat, 'results': results},
+                  f, indent=2, sort_keys=True)
+        f.write('\n')
+    print('Wrote results to %s' % args.output)
+
+    if args.update_baselines and args.baselines:
+        for name, entry in results.items():
+            for tool, stats in entry.items():
+                if tool == 'none':
+                    continue
+                baselines.setdefault(name, {})[tool] = {
+                    'slowdown': round(stats['slowdown'], 2),
+                    'rss_ratio': round(stats['rss_ratio'], 2)}
+        with open(args.baselines, 'w') as f:
+            json.dump(baselines, f, indent=2, sort_keys=True)
+            f.write('\n')
+        print('Updated baselines in %s' % args.baselines)
+        return 0
+
+    if failures:
+        print('Failed: %s' % ', '.join(failures))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
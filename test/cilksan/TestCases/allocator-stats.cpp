@@ -0,0 +1,37 @@
+// RUN: %clangxx_cilksan -fopencilk -Og %s -o %t
+// RUN: env CILKSAN_STATS=1 %run %t 2>&1 | FileCheck %s
+#include <cstdio>
+#include <cstdlib>
+
+#include <cilk/cilk.h>
+
+__attribute__((noinline)) long fill(long *data, long n) {
+  cilk_for (long i = 0; i < n; ++i)
+    data[i] = i;
+  long sum = 0;
+  for (long i = 0; i < n; ++i)
+    sum += data[i];
+  return sum;
+}
+
+// CILKSAN_STATS reports the footprint of the shadow-memory allocators.
+
+// CHECK: write line slabs,{{[0-9]+}},{{[1-9][0-9]*}}
+// CHECK-NEXT: write line empty slabs,{{[0-9]+}},{{[0-9]+}}
+// CHECK-NEXT: write lines used,{{[0-9]+}},{{[0-9]+}}
+// CHECK-NEXT: write line bytes resident,{{[0-9]+}},{{[1-9][0-9]*}}
+// CHECK: disjoint-set slabs,,{{[1-9][0-9]*}}
+// CHECK-NEXT: disjoint-set empty slabs,,{{[0-9]+}}
+// CHECK-NEXT: disjoint-set nodes,,{{[0-9]+}}
+// CHECK-NEXT: disjoint-set bytes resident,,{{[1-9][0-9]*}}
+
+int main(int argc, char *argv[]) {
+  long n = 4096;
+  if (argc > 1)
+    n = atol(argv[1]);
+
+  long *data = (long *)malloc(n * sizeof(long));
+  printf("%ld\n", fill(data, n));
+  free(data);
+  return 0;
+}
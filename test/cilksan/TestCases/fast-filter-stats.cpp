@@ -0,0 +1,28 @@
+// RUN: %clangxx_cilksan -fopencilk -Og %s -o %t
+// RUN: env CILKSAN_STATS=1 %run %t 2>&1 | FileCheck %s
+
+#include <cstdio>
+
+#include <cilk/cilk.h>
+
+static constexpr int N = 10000;
+int x = 1;
+
+// Each load after the first one in a strand repeats a check that the fast-path
+// filter skips.  The statistics still count every load.
+__attribute__((noinline)) int sum(int n) {
+  int s = 0;
+  for (int i = 0; i < n; ++i)
+    s += *(volatile int *)&x;
+  return s;
+}
+
+int main(int argc, char *argv[]) {
+  int a = cilk_spawn sum(N);
+  int b = sum(N);
+  cilk_sync;
+  printf("%d\n", a + b);
+  return 0;
+}
+
+// CHECK: total reads,,{{[2-9][0-9][0-9][0-9][0-9]$}}
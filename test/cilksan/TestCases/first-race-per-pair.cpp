@@ -0,0 +1,40 @@
+// RUN: %clangxx_cilksan -fopencilk -Og %s -o %t
+// RUN: %run %t 2>&1 | FileCheck %s
+// RUN: env CILKSAN_FIRST_RACE_PER_PAIR=1 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-PAIR
+
+#include <cstdio>
+#include <cilk/cilk.h>
+
+static constexpr int N = 64;
+int a[N];
+
+__attribute__((noinline)) void set(int *x, int n) {
+  for (int i = 0; i < n; ++i)
+    x[i] = i;
+}
+
+__attribute__((noinline)) void inc(int *x, int n) {
+  for (int i = 0; i < n; ++i)
+    x[i]++;
+}
+
+// The same pair of instructions races on every element of a.  The small,
+// aligned accesses are checked on the fast path.
+int main(int argc, char *argv[]) {
+  cilk_spawn set(a, N);
+  inc(a, N);
+  cilk_sync;
+  printf("%d\n", a[N - 1]);
+  return 0;
+}
+
+// CHECK: Race detected on location
+// CHECK: Cilksan detected {{[1-9][0-9]*}} distinct races.
+// CHECK-NEXT: Cilksan suppressed {{[1-9][0-9]*}} duplicate race reports.
+
+// Once a pair of instructions has raced, checks between them are skipped, so
+// no duplicate is even found.
+
+// CHECK-PAIR: Race detected on location
+// CHECK-PAIR: Cilksan detected {{[1-9][0-9]*}} distinct races.
+// CHECK-PAIR-NEXT: Cilksan suppressed 0 duplicate race reports.
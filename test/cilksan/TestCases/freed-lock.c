@@ -0,0 +1,47 @@
+// RUN: %clang_cilksan -fopencilk -Og %s -o %t
+// RUN: %run %t 2>&1 | FileCheck %s
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cilk/cilk.h>
+
+// Each counter holds its own lock, which is never explicitly initialized or
+// destroyed, so Cilksan registers the lock when it is first acquired.
+typedef struct {
+  pthread_mutex_t lock;
+} counter_t;
+
+int global = 0;
+
+__attribute__((noinline)) static void locked_inc(counter_t *c) {
+  pthread_mutex_lock(&c->lock);
+  global++;
+  pthread_mutex_unlock(&c->lock);
+}
+
+// Increment global while holding the lock of a fresh counter, then free the
+// counter.  The allocator typically reuses the freed counter for the next one,
+// so both counters' locks live at the same address.  Cilksan must forget the
+// lock of the freed counter and treat the next lock as a different one.
+__attribute__((noinline)) static void inc_with_new_lock(void) {
+  counter_t *c = (counter_t *)malloc(sizeof(counter_t));
+  pthread_mutex_t init = PTHREAD_MUTEX_INITIALIZER;
+  c->lock = init;
+  locked_inc(c);
+  free(c);
+}
+
+int main(int argc, char *argv[]) {
+  cilk_spawn inc_with_new_lock();
+  inc_with_new_lock();
+  cilk_sync;
+  printf("%d\n", global);
+  return 0;
+}
+
+// CHECK: Race detected on location
+// CHECK-NEXT: * {{Read|Write}} {{[0-9a-f]+}} locked_inc
+// CHECK: * {{Read|Write}} {{[0-9a-f]+}} locked_inc
+// CHECK: Cilksan detected {{[1-9][0-9]*}} distinct races.
@@ -1,5 +1,7 @@
 // RUN: %clang_cilksan -fopencilk -Og -mavx2 -g %s -o %t
 // RUN: %run %t 2>&1 | FileCheck %s
+// RUN: not env CILKSAN_MAX_RACES=2 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-MAX
+// RUN: env CILKSAN_FIRST_RACE_PER_PAIR=1 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-PAIR
 // REQUIRES: x86_64-target-arch
 
 #include <cilk/cilk.h>
@@ -238,3 +240,11 @@ int main() {
 
 // CHECK: Cilksan detected 8 distinct races.
 // CHECK-NEXT: Cilksan suppressed 13 duplicate race reports.
+
+// CHECK-MAX: Cilksan detected 2 distinct races.
+// CHECK-MAX: Cilksan stopped the program after 2 distinct races
+
+// Each test races on one pair of instructions.  Once a pair has raced, later
+// accesses by that pair are not checked, so no duplicates are found.
+// CHECK-PAIR: Cilksan detected 8 distinct races.
+// CHECK-PAIR-NEXT: Cilksan suppressed 0 duplicate race reports.
@@ -1,5 +1,7 @@
 // RUN: %clangxx_cilksan -fopencilk -Og %s -o %t -g
 // RUN: %run %t 2>&1 | FileCheck %s
+// RUN: %clangxx_cilksan -fopencilk -Og %s -o %t.fp -g -fno-omit-frame-pointer
+// RUN: env CILKSAN_LAZY_STACKS=1 %run %t.fp 2>&1 | FileCheck %s --check-prefix=CHECK-LAZY
 
 #include <iostream>
 #include <cilk/cilk.h>
@@ -169,3 +171,7 @@ int main(int argc, char** argv) {
 }
 
 // CHECK: Cilksan detected 10 distinct races.
+
+// CHECK-LAZY: Race detected on location
+// CHECK-LAZY: Call {{[0-9a-f]+}} in {{.*}}increment
+// CHECK-LAZY: Cilksan detected {{[0-9]+}} distinct races.
@@ -0,0 +1,46 @@
+// RUN: %clangxx_cilksan -fopencilk -Og %s -o %t -g -fno-omit-frame-pointer
+// RUN: env CILKSAN_LAZY_STACKS=1 %run %t 2>&1 | FileCheck %s --implicit-check-not="unknown frames"
+
+#include <cstdio>
+#include <cilk/cilk.h>
+
+int global = 0;
+
+__attribute__((noinline)) void inc(int *x) { (*x)++; }
+
+__attribute__((noinline)) void nop() {}
+
+// Spawning makes wrapper a Cilk function, which unwinds its call stack on entry
+// when call stacks are recorded lazily.
+__attribute__((noinline)) void wrapper(int *x) {
+  cilk_spawn nop();
+  inc(x);
+  cilk_sync;
+}
+
+__attribute__((noinline)) void spawner(int *x) {
+  cilk_spawn wrapper(x);
+  inc(x);
+  cilk_sync;
+}
+
+int main(int argc, char **argv) {
+  spawner(&global);
+  printf("%d\n", global);
+  return 0;
+}
+
+// The stack of the spawned function must continue from the spawn in spawner,
+// with no repeated frames from spawner's own stack.
+
+// CHECK: Race detected on location
+// CHECK-NEXT: * Write {{[0-9a-f]+}} inc
+// CHECK: Func wrapper
+// CHECK-NEXT: Call {{[0-9a-f]+}}
+// CHECK-NEXT: Spawn {{[0-9a-f]+}} spawner
+// CHECK-NEXT: * Read {{[0-9a-f]+}} inc
+// CHECK: Common calling context
+// CHECK-NEXT: Func spawner
+// CHECK-NEXT: Call {{[0-9a-f]+}}
+
+// CHECK: Cilksan detected {{[0-9]+}} distinct races.
@@ -0,0 +1,47 @@
+// RUN: %clangxx_cilksan -fopencilk -Og %s -o %t
+// RUN: %run %t 2>&1 | FileCheck %s
+// RUN: env CILKSAN_PHASE_RESET=0 %run %t 2>&1 | FileCheck %s
+// RUN: env CILKSAN_PHASE_RESET_PAGES=1 %run %t 2>&1 | FileCheck %s
+// RUN: env CILKSAN_STATS=1 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-STATS
+#include <cstdio>
+#include <cstdlib>
+
+#include <cilk/cilk.h>
+#include <cilk/cilksan.h>
+
+__attribute__((noinline)) void phase(long *data, long n, long *racy) {
+  cilk_for (long i = 0; i < n; ++i) {
+    data[i] += i;
+    *racy += data[i];
+  }
+}
+
+// Races within each phase are still found after the shadow memory of earlier
+// phases is discarded.
+
+// CHECK: Race detected on location [[RACY:[a-fA-F0-9]+]]
+// CHECK-NOT: Race detected on location
+// CHECK: Cilksan detected 1 distinct races.
+
+// CHECK-STATS: phase resets,,{{[1-9][0-9]*}}
+
+int main(int argc, char *argv[]) {
+  long n = 1000;
+  long phases = 4;
+  if (argc > 1)
+    n = atol(argv[1]);
+  if (argc > 2)
+    phases = atol(argv[2]);
+
+  long *data = (long *)calloc(n, sizeof(long));
+  long racy = 0;
+  for (long p = 0; p < phases; ++p) {
+    phase(data, n, &racy);
+    for (long i = 0; i < n; ++i)
+      data[i] -= p;
+    __cilksan_phase_boundary();
+  }
+  printf("%ld\n", racy);
+  free(data);
+  return 0;
+}
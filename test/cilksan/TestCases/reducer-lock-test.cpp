@@ -1,5 +1,11 @@
 // RUN: %clangxx_cilksan -fopencilk -Og %s -o %t
 // RUN: %run %t 2>&1 | FileCheck %s
+// RUN: env CILKSAN_STEAL=none %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-SHARED
+// RUN: env CILKSAN_STEAL=every:3 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-SHARED
+// RUN: env CILKSAN_STEAL=depth:1,2 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-SHARED
+// RUN: env CILKSAN_STEAL=random:4 CILKSAN_STEAL_SEED=7 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-SHARED
+// RUN: env CILKSAN_STATS=1 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-STATS
+// RUN: env CILKSAN_STEAL=every:3 CILKSAN_STATS=1 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-SHARED-STATS
 
 #include <stdio.h>
 #include <cilk/cilk.h>
@@ -52,5 +58,19 @@ int main() {
 // CHECK-NEXT: 50005000
 // CHECK-NEXT: 50005000
 
+// Simulated steals reuse the buffers of reduced views.
+// CHECK-STATS: reducer views reused,,{{[1-9][0-9]*}}
+
+// Iterations whose continuations are not treated as stolen share views of sum.
+// Shared views other than the leftmost one are cleared once per continuation.
+// The leftmost view is checked like any other memory.
+// CHECK-SHARED: to variable rsum
+// CHECK-SHARED: 50005000
+// CHECK-SHARED-NEXT: 50005000
+// CHECK-SHARED-NEXT: 50005000
+// CHECK-SHARED: Cilksan detected {{[2-9]}} distinct races.
+
+// CHECK-SHARED-STATS: shared reducer view clears,,{{[1-9][0-9]*}}
+
 // CHECK: Cilksan detected 2 distinct races.
 // CHECK-NEXT: Cilksan suppressed {{[0-9]+}} duplicate race reports.
@@ -0,0 +1,39 @@
+// RUN: %clangxx_cilksan -fopencilk -Og %s -o %t
+// RUN: %run %t 2>&1 | FileCheck %s
+// RUN: env CILKSAN_STATS=1 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-STATS
+
+#include <cstdio>
+
+#include <cilk/cilk.h>
+#include <cilk/opadd_reducer.h>
+
+// Each call creates a short-lived reducer.  The recursion on depth places the
+// reducers at different stack addresses, so they have different keys.
+__attribute__((noinline)) long sum_range(long n, int depth) {
+  if (depth > 0)
+    return sum_range(n, depth - 1);
+  cilk::opadd_reducer<long> sum = 0;
+  cilk_for (long i = 0; i < n; ++i)
+    sum += i;
+  return sum;
+}
+
+int main() {
+  // The outer loop keeps the program from being fully synced, so the pooled
+  // views of each reducer must be freed when that reducer goes away.
+  long totals[1000];
+  cilk_for (int k = 0; k < 1000; ++k)
+    totals[k] = sum_range(256, k % 16);
+  long total = 0;
+  for (int k = 0; k < 1000; ++k)
+    total += totals[k];
+  printf("%ld\n", total);
+  return 0;
+}
+
+// CHECK: 32640000
+// CHECK: Cilksan detected 0 distinct races.
+
+// The pools stay bounded no matter how many reducers are created.
+// CHECK-STATS: reducer views freed,,{{[1-9][0-9]*$}}
+// CHECK-STATS-NEXT: max pooled reducer views,,{{[1-8]$}}
@@ -0,0 +1,84 @@
+// RUN: %clangxx_cilksan -fopencilk -Og %s -o %t
+// RUN: %run %t padded 0 2>&1 | FileCheck %s --check-prefix=CHECK-NORACE
+// RUN: %run %t wide 0 2>&1 | FileCheck %s --check-prefix=CHECK-NORACE
+// RUN: %run %t padded 1 2>&1 | FileCheck %s --check-prefix=CHECK-RACE
+// RUN: %run %t wide 1 2>&1 | FileCheck %s --check-prefix=CHECK-RACE
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <cilk/cilk.h>
+
+// Accesses to the fields of Padded refine the shadow memory below 8 bytes, so
+// Cilksan stores those lines as runs of identical entries.  Accesses to the
+// fields of Wide never refine the shadow memory that far, so Cilksan stores
+// those lines densely.  Both layouts must give the same reports.
+struct Padded {
+  char c;
+  int i;
+};
+
+struct Wide {
+  long c;
+  long i;
+};
+
+static constexpr int MAX_ELS = 64;
+static constexpr size_t LINE_ALIGN = 512;
+
+// Write the first N elements of a with 8-byte stores from parallel strands.
+template <typename T, int N> __attribute__((noinline)) void init(T *a) {
+  long *words = reinterpret_cast<long *>(a);
+  cilk_for (size_t i = 0; i < N * sizeof(T) / sizeof(long); ++i)
+    words[i] = i;
+}
+
+// Write the fields of the first N elements of a from parallel strands.  If
+// race is true, each strand also reads a field that another strand writes.
+template <typename T, int N>
+__attribute__((noinline)) void write_fields(T *a, bool race) {
+  cilk_for (int i = 0; i < N; ++i) {
+    a[i].c = i;
+    a[i].i = race ? a[(i + 1) % N].c : i;
+  }
+}
+
+template <typename T> long test(bool race) {
+  T *a = static_cast<T *>(aligned_alloc(LINE_ALIGN, MAX_ELS * sizeof(T)));
+  // Refine a dense line with a few distinct entries, which switches it to
+  // runs.
+  init<T, 4>(a);
+  write_fields<T, 4>(a, race);
+  // Write more distinct entries than a line can hold as runs, which switches
+  // it back to a dense line.
+  write_fields<T, MAX_ELS>(a, race);
+  long sum = 0;
+  for (int i = 0; i < MAX_ELS; ++i)
+    sum += a[i].i;
+  free(a);
+
+  // Materialize fresh lines directly as runs.
+  a = static_cast<T *>(aligned_alloc(LINE_ALIGN, MAX_ELS * sizeof(T)));
+  write_fields<T, 2>(a, race);
+  for (int i = 0; i < 2; ++i)
+    sum += a[i].i;
+  free(a);
+  return sum;
+}
+
+// CHECK-NORACE-NOT: Race detected on location
+// CHECK-NORACE: Cilksan detected 0 distinct races.
+
+// CHECK-RACE: Race detected on location
+// CHECK-RACE: Race detected on location
+// CHECK-RACE: Race detected on location
+// CHECK-RACE-NOT: Race detected on location
+// CHECK-RACE: Cilksan detected 3 distinct races.
+
+int main(int argc, char *argv[]) {
+  bool wide = argc > 1 && 0 == strcmp(argv[1], "wide");
+  bool race = argc > 2 && atoi(argv[2]);
+  long sum = wide ? test<Wide>(race) : test<Padded>(race);
+  printf("%ld\n", sum);
+  return 0;
+}
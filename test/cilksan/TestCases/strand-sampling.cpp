@@ -0,0 +1,43 @@
+// RUN: %clangxx_cilksan -fopencilk -Og %s -o %t
+// RUN: env CILKSAN_SAMPLE_RATE=1 %run %t 2>&1 | FileCheck %s --check-prefixes=CHECK,CHECK-ALL
+// RUN: env CILKSAN_SAMPLE_RATE=0 %run %t 2>&1 | FileCheck %s --check-prefixes=CHECK,CHECK-NONE
+// RUN: rm -f %t.cov
+// RUN: env CILKSAN_SAMPLE_RATE=0 CILKSAN_COVERAGE_FILE=%t.cov %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-NONE
+// RUN: env CILKSAN_SAMPLE_RATE=1 CILKSAN_COVERAGE_FILE=%t.cov %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-ALL
+// RUN: env CILKSAN_SAMPLE_RATE=0 CILKSAN_COVERAGE_FILE=%t.cov %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-COV
+// RUN: FileCheck %s --check-prefix=CHECK-FILE < %t.cov
+
+#include <cstdio>
+
+#include <cilk/cilk.h>
+
+__attribute__((noinline)) void inc(long *x) { ++(*x); }
+
+// The two spawned tasks and the two continuations start four strands, each at
+// its own site, in the same parallel region.  That region has six pairs of
+// strands, one for each pair of sites.
+
+// CHECK-ALL: Race detected on location
+// CHECK-ALL: Cilksan detected 1 distinct races.
+// CHECK-ALL: Cilksan checked [[N:[0-9]+]] of [[N]] strands; site-pair coverage 6 of 6; strand-pair coverage 6 of 6.
+
+// CHECK-NONE-NOT: Race detected on location
+// CHECK-NONE: Cilksan checked 0 of {{[1-9][0-9]*}} strands; site-pair coverage 0 of 6; strand-pair coverage 0 of 6.
+
+// Site pairs covered by earlier runs stay covered, but this run checked no
+// pairs of strands.
+// CHECK-COV: Cilksan checked 0 of {{[1-9][0-9]*}} strands; site-pair coverage 6 of 6; strand-pair coverage 0 of 6.
+
+// CHECK-FILE-DAG: site {{[0-9]+}}
+// CHECK-FILE-DAG: seen {{[0-9]+}} {{[0-9]+}}
+// CHECK-FILE-DAG: pair {{[0-9]+}} {{[0-9]+}}
+
+int main(int argc, char *argv[]) {
+  long x = 0;
+  cilk_spawn inc(&x);
+  cilk_spawn inc(&x);
+  inc(&x);
+  cilk_sync;
+  printf("%ld\n", x);
+  return 0;
+}
@@ -1,5 +1,7 @@
 // RUN: %clangxx_cilksan -fopencilk -O2 %s -o %t
 // RUN: %run %t 10000 2>&1 | FileCheck %s
+// RUN: env CILKSAN_RACE_LOG=%t.jsonl %run %t 10000 2>&1 | FileCheck %s --check-prefix=CHECK-LOG
+// RUN: FileCheck %s --check-prefix=CHECK-JSON < %t.jsonl
 
 /**		-*- C++ -*-
  *
@@ -377,3 +379,10 @@ sum_t accum_wls (num_t n) {
 
 // CHECK: Cilksan detected 2 distinct races.
 // CHECK-NEXT: Cilksan suppressed {{[0-9]+}} duplicate race reports.
+
+// CHECK-LOG-NOT: Race detected on location
+// CHECK-LOG: Cilksan detected 2 distinct races.
+
+// CHECK-JSON: {"race":"{{RW|WW|WR}}","addr":"0x{{[0-9a-f]+}}","first":{"acc":
+// CHECK-JSON: {"race":
+// CHECK-JSON: {"sym":
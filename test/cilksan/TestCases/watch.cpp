@@ -0,0 +1,40 @@
+// RUN: %clangxx_cilksan -fopencilk -Og -rdynamic %s -o %t
+// RUN: %run %t 2>&1 | FileCheck %s --check-prefixes=CHECK,CHECK-ALL
+// RUN: %run %t watch 2>&1 | FileCheck %s --check-prefixes=CHECK,CHECK-WATCH
+// RUN: env CILKSAN_WATCH_SYMBOLS=watched %run %t 2>&1 | FileCheck %s --check-prefixes=CHECK,CHECK-WATCH
+
+#include <cstdio>
+#include <cstring>
+
+#include <cilk/cilk.h>
+#include <cilk/cilksan.h>
+
+long watched[4];
+long unwatched[4];
+
+__attribute__((noinline)) void inc_watched(long *x) { ++(*x); }
+__attribute__((noinline)) void inc_unwatched(long *x) { ++(*x); }
+
+// CHECK: Race detected on location
+// CHECK-NEXT: * {{Read|Write}} {{[0-9a-f]+}} inc_watched
+
+// CHECK-ALL: Race detected on location
+// CHECK-ALL-NEXT: * {{Read|Write}} {{[0-9a-f]+}} inc_unwatched
+
+// CHECK-WATCH-NOT: inc_unwatched
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && 0 == strcmp(argv[1], "watch"))
+    __cilksan_watch(watched, sizeof(watched));
+
+  cilk_spawn inc_watched(&watched[1]);
+  inc_watched(&watched[1]);
+  cilk_sync;
+
+  cilk_spawn inc_unwatched(&unwatched[1]);
+  inc_unwatched(&unwatched[1]);
+  cilk_sync;
+
+  printf("%ld %ld\n", watched[1], unwatched[1]);
+  return 0;
+}
@@ -0,0 +1,30 @@
+// RUN: %clang_csi_toolc %tooldir/null-tool.c -o %t-null-tool.o
+// RUN: %clang_csi_toolc %tooldir/pc-index-test-tool.c -o %t-tool.o
+// RUN: %link_csi %t-tool.o %t-null-tool.o -o %t-tool.o
+// RUN: %clang_csi_c %s -o %t.o
+// RUN: %clang_csi %t.o %t-tool.o -o %t
+// RUN: %run %t | FileCheck %s
+
+#include <stdio.h>
+
+static void foo() {
+  printf("In foo.\n");
+}
+
+static void bar() {
+  printf("In bar.\n");
+  foo();
+}
+
+int main(int argc, char **argv) {
+  printf("In main.\n");
+  foo();
+  bar();
+  // CHECK: Function 0: PC recorded, lookup matches
+  // CHECK-NEXT: Function 1: PC recorded, lookup matches
+  // CHECK-NEXT: Function 2: PC recorded, lookup matches
+  // CHECK-NEXT: Below all PCs: -1
+  // CHECK-NEXT: Above all PCs: -1
+  // CHECK-NEXT: Other type: -1
+  return 0;
+}
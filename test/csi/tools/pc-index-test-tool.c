@@ -0,0 +1,36 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "csi.h"
+
+static csi_id_t num_functions = 0;
+
+void report() {
+    for (csi_id_t func_id = 0; func_id < num_functions; ++func_id) {
+        uintptr_t pc = __csi_get_pc(CSI_FED_FUNCTION, func_id);
+        printf("Function %ld: PC %s, lookup %s\n", func_id,
+               pc ? "recorded" : "missing",
+               __csi_get_id_for_pc(CSI_FED_FUNCTION, pc) == func_id
+                   ? "matches" : "differs");
+    }
+    uintptr_t pc = __csi_get_pc(CSI_FED_FUNCTION, 0);
+    printf("Below all PCs: %ld\n", __csi_get_id_for_pc(CSI_FED_FUNCTION, 1));
+    printf("Above all PCs: %ld\n",
+           __csi_get_id_for_pc(CSI_FED_FUNCTION, UINTPTR_MAX));
+    printf("Other type: %ld\n", __csi_get_id_for_pc(CSI_FED_LOOP, pc));
+}
+
+void __csi_init() {
+    num_functions = 0;
+    atexit(report);
+}
+
+// Keep this hook out of line, so that its return address lies in the
+// instrumented function.
+__attribute__((noinline))
+void __csi_func_entry(const csi_id_t func_id, const func_prop_t prop) {
+    __csi_record_pc(CSI_FED_FUNCTION, func_id,
+                    (uintptr_t)__builtin_return_address(0));
+    if (func_id >= num_functions)
+        num_functions = func_id + 1;
+}